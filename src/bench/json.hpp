@@ -0,0 +1,151 @@
+#pragma once
+
+#include <cctype>
+#include <cstdlib>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <utility>
+#include <vector>
+
+// Just enough JSON to read back the results written by the benchmark suite:
+// objects, arrays, numbers, strings (without escapes other than \" and \\),
+// booleans and null
+namespace json {
+    struct Value {
+        enum Type { Null, Bool, Number, String, Array, Object };
+
+        Type type = Null;
+        double number = 0;
+        std::string string;
+        std::vector<Value> array;
+        std::vector<std::pair<std::string, Value>> object;
+
+        // Member `key` of an object (null if there isn't one)
+        const Value* find(const std::string& key) const {
+            for (const auto& member : object) {
+                if (member.first == key) return &member.second;
+            }
+            return nullptr;
+        }
+
+        // Number member `key` of an object (`fallback` if there isn't one)
+        double numberAt(const std::string& key, double fallback = 0) const {
+            const Value* v = find(key);
+            return (v && v->type == Number) ? v->number : fallback;
+        }
+    };
+
+    class Parser {
+        public:
+            explicit Parser(const std::string& text) : text(text) {}
+
+            // Parses the whole text. Returns false if it isn't valid JSON.
+            bool parse(Value& value) {
+                if (!parseValue(value)) return false;
+                skipSpaces();
+                return position == text.size();
+            }
+
+        private:
+            const std::string& text;
+            size_t position = 0;
+
+            void skipSpaces() {
+                while (position < text.size() && std::isspace((unsigned char)text[position])) position++;
+            }
+
+            bool consume(char c) {
+                skipSpaces();
+                if (position < text.size() && text[position] == c) {
+                    position++;
+                    return true;
+                }
+                return false;
+            }
+
+            bool consumeWord(const char* word) {
+                size_t length = std::char_traits<char>::length(word);
+                if (text.compare(position, length, word) != 0) return false;
+                position += length;
+                return true;
+            }
+
+            bool parseString(std::string& s) {
+                if (!consume('"')) return false;
+                while (position < text.size() && text[position] != '"') {
+                    if (text[position] == '\\' && position + 1 < text.size()) position++;
+                    s += text[position++];
+                }
+                return consume('"');
+            }
+
+            bool parseValue(Value& value) {
+                skipSpaces();
+                if (position >= text.size()) return false;
+                char c = text[position];
+                if (c == '{') {
+                    value.type = Value::Object;
+                    position++;
+                    if (consume('}')) return true;
+                    do {
+                        std::pair<std::string, Value> member;
+                        if (!parseString(member.first) || !consume(':') || !parseValue(member.second)) return false;
+                        value.object.push_back(std::move(member));
+                    } while (consume(','));
+                    return consume('}');
+                }
+                if (c == '[') {
+                    value.type = Value::Array;
+                    position++;
+                    if (consume(']')) return true;
+                    do {
+                        value.array.emplace_back();
+                        if (!parseValue(value.array.back())) return false;
+                    } while (consume(','));
+                    return consume(']');
+                }
+                if (c == '"') {
+                    value.type = Value::String;
+                    return parseString(value.string);
+                }
+                if (consumeWord("true")) {
+                    value.type = Value::Bool;
+                    value.number = 1;
+                    return true;
+                }
+                if (consumeWord("false")) {
+                    value.type = Value::Bool;
+                    return true;
+                }
+                if (consumeWord("null")) return true;
+                const char* start = text.c_str() + position;
+                char* end;
+                value.number = std::strtod(start, &end);
+                if (end == start) return false;
+                value.type = Value::Number;
+                position += end - start;
+                return true;
+            }
+    };
+
+    // Reads and parses file `filePath`. Returns false if it can't be read or parsed.
+    inline bool readFile(const std::string& filePath, Value& value) {
+        std::ifstream file(filePath);
+        if (!file) return false;
+        std::stringstream contents;
+        contents << file.rdbuf();
+        std::string text = contents.str();
+        return Parser(text).parse(value);
+    }
+
+    // `s` as a JSON string
+    inline std::string quote(const std::string& s) {
+        std::string quoted = "\"";
+        for (char c : s) {
+            if (c == '"' || c == '\\') quoted += '\\';
+            quoted += c;
+        }
+        return quoted + "\"";
+    }
+}
@@ -0,0 +1,339 @@
+#include "../pathTracer/myPT.hpp"
+#include "../pathTracer/scenes.hpp"
+#include "json.hpp"
+
+#include <filesystem>
+#include <fstream>
+#include <iomanip>
+#include <thread>
+
+// BENCHMARK SUITE
+// Renders a fixed matrix of scenes (the hard-coded ones and every bundled model)
+// at a fixed resolution, sample count and seed, with 1, 2, 4, ... threads.
+// Writes the measurements to a JSON file, and compares them with a baseline
+// written by an earlier run, flagging regressions.
+
+using Clock = std::chrono::steady_clock;
+
+struct Options {
+    std::string output = "bench/results.json";
+    // No comparison if empty
+    std::string baseline;
+    unsigned int seed = 1;
+    int maxThreads = std::max(1u, std::thread::hardware_concurrency());
+    int imageWidth = 160;
+    int samplesPerPixel = 8;
+    // Each render is repeated, and the fastest run is kept
+    int repetitions = 1;
+    // Relative slowdown above which a measurement is flagged as a regression
+    double tolerance = 0.10;
+};
+
+// Rendering of a scene with a given number of threads
+struct Run {
+    int threads;
+    double renderSeconds;
+    uint64_t rays;
+    double mRaysPerSecond;
+};
+
+struct SceneResult {
+    std::string name;
+    // Loading of the model files (0 for hard-coded scenes)
+    double loadMs;
+    // Construction of the primitives and BVH
+    double bvhBuildMs;
+    // Peak resident set size while the scene was built and rendered
+    size_t peakRssKb;
+    std::vector<Run> runs;
+};
+
+struct BenchScene {
+    std::string name;
+    // Makes the scene in `arena`, setting the time taken by each phase
+    std::function<const Hittable*(SceneArena& arena, double& loadMs, double& bvhBuildMs)> make;
+    // Camera for the scene made by `make`
+    std::function<Camera(const Hittable& scene)> camera;
+};
+
+double milliseconds(Clock::duration d) {
+    return std::chrono::duration<double, std::milli>(d).count();
+}
+
+// Resets the peak resident set size of the process. Returns false if the
+// kernel doesn't support it (peaks then include everything before).
+bool resetPeakResident() {
+    std::ofstream clearRefs("/proc/self/clear_refs");
+    clearRefs << "5";
+    clearRefs.close();
+    return bool(clearRefs);
+}
+
+// Peak resident set size of the process, in kB (0 if unknown)
+size_t peakResidentKb() {
+    std::ifstream status("/proc/self/status");
+    std::string line;
+    while (std::getline(status, line)) {
+        if (line.rfind("VmHWM:", 0) == 0) return std::stoul(line.substr(6));
+    }
+    return 0;
+}
+
+// Hard-coded scene: everything is BVH construction
+BenchScene hardCodedScene(const std::string& name, const Hittable* (*make)(SceneArena&),
+                          Camera (*camera)()) {
+    return {name,
+            [make](SceneArena& arena, double& loadMs, double& bvhBuildMs) {
+                auto start = Clock::now();
+                const Hittable* scene = make(arena);
+                loadMs = 0;
+                bvhBuildMs = milliseconds(Clock::now() - start);
+                return scene;
+            },
+            [camera](const Hittable&) { return camera(); }};
+}
+
+// Bundled model, loaded from its .obj file (bypassing its caches, so that every
+// run times the same work), seen from above one corner of its bounding box
+BenchScene modelScene(const std::string& name, const std::string& objFilePath) {
+    return {name,
+            [objFilePath](SceneArena& arena, double& loadMs, double& bvhBuildMs) {
+                Model model(objFilePath, arena);
+                model.bypassCaches();
+                auto start = Clock::now();
+                model.initialize();
+                loadMs = milliseconds(Clock::now() - start);
+                start = Clock::now();
+                const Hittable* scene = model.buildBvh();
+                bvhBuildMs = milliseconds(Clock::now() - start);
+                return scene;
+            },
+            [](const Hittable& scene) {
+                Aabb box = scene.boundingBox();
+                Point3 center((box.x.min + box.x.max) / 2, (box.y.min + box.y.max) / 2,
+                              (box.z.min + box.z.max) / 2);
+                float size = box.x.size() + box.y.size() + box.z.size();
+                Camera cam(1, 100, 40, center + Vec3(0.3f, 0.4f, 1.2f) * size, center);
+                cam.setMaxDepth(8);
+                cam.setBackground(Color(0.70, 0.80, 1.00));
+                return cam;
+            }};
+}
+
+std::vector<BenchScene> benchScenes() {
+    std::vector<BenchScene> scenes;
+    scenes.push_back(hardCodedScene("oneWeekendSpheres", ptScenes::oneWeekendSpheres,
+                                    ptScenes::oneWeekendSpheresCamera));
+    scenes.push_back(hardCodedScene("cornellBox", ptScenes::cornellBox, ptScenes::cornellBoxCamera));
+    scenes.push_back(hardCodedScene("mirrorRoom", ptScenes::mirrorRoom, ptScenes::mirrorRoomCamera));
+    // Every model directory with a .obj file of the same name, in name order
+    std::vector<std::string> models;
+    for (const auto& entry : std::filesystem::directory_iterator("models")) {
+        std::string name = entry.path().filename().string();
+        if (std::filesystem::exists(entry.path() / (name + ".obj"))) models.push_back(name);
+    }
+    std::sort(models.begin(), models.end());
+    for (const std::string& name : models) {
+        scenes.push_back(modelScene(name, "models/" + name + "/" + name + ".obj"));
+    }
+    return scenes;
+}
+
+// 1, 2, 4, ... up to `maxThreads` (always included)
+std::vector<int> threadCounts(int maxThreads) {
+    std::vector<int> counts;
+    for (int n = 1; n < maxThreads; n *= 2) counts.push_back(n);
+    counts.push_back(maxThreads);
+    return counts;
+}
+
+SceneResult benchScene(const BenchScene& benchScene, const Options& options) {
+    SceneResult result;
+    result.name = benchScene.name;
+    resetPeakResident();
+    // The logs of scene construction and rendering aren't part of the results
+    std::streambuf* log = std::clog.rdbuf(nullptr);
+    std::streambuf* out = std::cout.rdbuf(nullptr);
+    {
+        SceneArena arena;
+        srand(options.seed);
+        const Hittable* scene = benchScene.make(arena, result.loadMs, result.bvhBuildMs);
+        for (int threads : threadCounts(options.maxThreads)) {
+            Camera cam = benchScene.camera(*scene);
+            cam.setImageWidth(options.imageWidth);
+            cam.setSamplesPerPixel(options.samplesPerPixel);
+            cam.setNumThreads(threads);
+            cam.setImageName("bench_" + benchScene.name);
+            Run run = {threads, infinity, 0, 0};
+            for (int i = 0; i < options.repetitions; i++) {
+                // Every run traces the same paths (exactly, with a single thread)
+                srand(options.seed);
+                auto start = Clock::now();
+                cam.render(*scene);
+                double seconds = std::chrono::duration<double>(Clock::now() - start).count();
+                if (seconds < run.renderSeconds) run = {threads, seconds, cam.raysTraced(), cam.raysTraced() / seconds / 1e6};
+            }
+            result.runs.push_back(run);
+        }
+    }
+    std::clog.rdbuf(log);
+    std::cout.rdbuf(out);
+    result.peakRssKb = peakResidentKb();
+    return result;
+}
+
+void writeResults(const std::string& filePath, const Options& options,
+                  const std::vector<SceneResult>& results) {
+    std::filesystem::path parent = std::filesystem::path(filePath).parent_path();
+    if (!parent.empty()) std::filesystem::create_directories(parent);
+    std::ofstream file(filePath);
+    if (!file) fatalError("Error: failed opening output file " + filePath);
+    file << std::setprecision(6);
+    file << "{\n"
+         << "  \"settings\": {\"imageWidth\": " << options.imageWidth
+         << ", \"samplesPerPixel\": " << options.samplesPerPixel
+         << ", \"seed\": " << options.seed
+         << ", \"repetitions\": " << options.repetitions
+         << ", \"maxThreads\": " << options.maxThreads << "},\n"
+         << "  \"scenes\": [";
+    for (size_t i = 0; i < results.size(); i++) {
+        const SceneResult& r = results[i];
+        file << (i ? ",\n" : "\n")
+             << "    {\"name\": " << json::quote(r.name)
+             << ", \"loadMs\": " << r.loadMs
+             << ", \"bvhBuildMs\": " << r.bvhBuildMs
+             << ", \"peakRssKb\": " << r.peakRssKb << ",\n"
+             << "     \"runs\": [";
+        for (size_t j = 0; j < r.runs.size(); j++) {
+            const Run& run = r.runs[j];
+            file << (j ? ",\n              " : "")
+                 << "{\"threads\": " << run.threads
+                 << ", \"renderSeconds\": " << run.renderSeconds
+                 << ", \"rays\": " << run.rays
+                 << ", \"mRaysPerSecond\": " << run.mRaysPerSecond << "}";
+        }
+        file << "]}";
+    }
+    file << "\n  ]\n}\n";
+}
+
+// Compares `results` with the baseline in `filePath`, printing the differences.
+// Returns the number of regressions.
+int compareWithBaseline(const std::string& filePath, const Options& options,
+                        const std::vector<SceneResult>& results) {
+    json::Value baseline;
+    if (!json::readFile(filePath, baseline)) {
+        fatalError("Error: no baseline in " + filePath + " (it's written by `make bench-baseline`)");
+    }
+    const json::Value* settings = baseline.find("settings");
+    if (!settings || settings->numberAt("imageWidth") != options.imageWidth
+        || settings->numberAt("samplesPerPixel") != options.samplesPerPixel
+        || settings->numberAt("seed") != options.seed) {
+        fatalError("Error: baseline " + filePath + " was made with a different width, spp or seed"
+                   " (rewrite it with `make bench-baseline`)");
+    }
+
+    std::cout << "\nComparison with " << filePath << " (tolerance "
+              << options.tolerance * 100 << "%)\n";
+    int regressions = 0;
+    // Flags `value` if it's worse than `previous` by more than the tolerance
+    auto compare = [&](const std::string& what, double value, double previous, bool higherIsBetter) {
+        if (previous <= 0) return;
+        double change = value / previous - 1;
+        bool regression = higherIsBetter ? change < -options.tolerance : change > options.tolerance;
+        std::cout << "  " << std::left << std::setw(44) << what << std::right
+                  << std::setw(10) << previous << " -> " << std::setw(10) << value
+                  << "  (" << std::showpos << change * 100 << std::noshowpos << "%)"
+                  << (regression ? "  REGRESSION" : "") << "\n";
+        if (regression) regressions++;
+    };
+    const json::Value* scenes = baseline.find("scenes");
+    for (const SceneResult& r : results) {
+        const json::Value* previous = nullptr;
+        for (size_t i = 0; scenes && i < scenes->array.size() && !previous; i++) {
+            const json::Value* name = scenes->array[i].find("name");
+            if (name && name->string == r.name) previous = &scenes->array[i];
+        }
+        if (!previous) {
+            std::cout << "  " << r.name << ": not in the baseline\n";
+            continue;
+        }
+        // Times of a few milliseconds are too noisy to compare
+        if (previous->numberAt("loadMs") >= 5) {
+            compare(r.name + " load (ms)", r.loadMs, previous->numberAt("loadMs"), false);
+        }
+        if (previous->numberAt("bvhBuildMs") >= 5) {
+            compare(r.name + " BVH build (ms)", r.bvhBuildMs, previous->numberAt("bvhBuildMs"), false);
+        }
+        compare(r.name + " peak memory (kB)", double(r.peakRssKb), previous->numberAt("peakRssKb"), false);
+        const json::Value* runs = previous->find("runs");
+        for (const Run& run : r.runs) {
+            for (size_t i = 0; runs && i < runs->array.size(); i++) {
+                if (runs->array[i].numberAt("threads") != run.threads) continue;
+                compare(r.name + ", " + std::to_string(run.threads) + " threads (Mrays/s)",
+                        run.mRaysPerSecond, runs->array[i].numberAt("mRaysPerSecond"), true);
+            }
+        }
+    }
+    std::cout << regressions << " regression(s)\n";
+    return regressions;
+}
+
+Options parseOptions(int argc, char** argv) {
+    Options options;
+    for (int i = 1; i < argc; i++) {
+        std::string option = argv[i];
+        if (i + 1 >= argc) fatalError("Error: missing value for option " + option);
+        std::string value = argv[++i];
+        if (option == "--output") options.output = value;
+        else if (option == "--baseline") options.baseline = value;
+        else if (option == "--seed") options.seed = std::stoul(value);
+        else if (option == "--threads") options.maxThreads = std::max(1, std::stoi(value));
+        else if (option == "--width") options.imageWidth = std::stoi(value);
+        else if (option == "--spp") options.samplesPerPixel = std::stoi(value);
+        else if (option == "--repeat") options.repetitions = std::max(1, std::stoi(value));
+        else if (option == "--tolerance") options.tolerance = std::stod(value);
+        else fatalError("Error: unknown option " + option);
+    }
+    return options;
+}
+
+int main(int argc, char** argv) {
+    Options options = parseOptions(argc, argv);
+    std::cout << "Benchmark: " << options.imageWidth << " pixels wide, "
+              << options.samplesPerPixel << " samples per pixel, seed " << options.seed
+              << ", up to " << options.maxThreads << " threads, best of "
+              << options.repetitions << " render(s)\n\n"
+              << std::left << std::setw(20) << "scene" << std::right
+              << std::setw(10) << "load ms" << std::setw(10) << "BVH ms" << std::setw(12) << "peak MB"
+              << std::setw(9) << "threads" << std::setw(11) << "render s" << std::setw(10) << "Mrays/s"
+              << std::setw(10) << "scaling" << "\n" << std::fixed;
+
+    std::vector<SceneResult> results;
+    for (const BenchScene& scene : benchScenes()) {
+        SceneResult r = benchScene(scene, options);
+        for (size_t i = 0; i < r.runs.size(); i++) {
+            const Run& run = r.runs[i];
+            if (i == 0) {
+                std::cout << std::left << std::setw(20) << r.name << std::right << std::setprecision(1)
+                          << std::setw(10) << r.loadMs << std::setw(10) << r.bvhBuildMs
+                          << std::setw(12) << r.peakRssKb / 1024.0;
+            } else {
+                std::cout << std::setw(52) << "";
+            }
+            // Speed-up over a single thread
+            std::cout << std::setw(9) << run.threads << std::setprecision(3)
+                      << std::setw(11) << run.renderSeconds << std::setw(10) << run.mRaysPerSecond
+                      << std::setprecision(2) << std::setw(9) << r.runs[0].renderSeconds / run.renderSeconds
+                      << "x\n";
+        }
+        results.push_back(std::move(r));
+    }
+    std::cout.unsetf(std::ios::fixed);
+    std::cout << std::setprecision(4);
+
+    writeResults(options.output, options, results);
+    std::cout << "\nResults written to " << options.output << "\n";
+    int regressions = options.baseline.empty() ? 0 : compareWithBaseline(options.baseline, options, results);
+    return regressions > 0 ? 1 : 0;
+}
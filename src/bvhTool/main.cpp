@@ -0,0 +1,434 @@
+#include "../pathTracer/myPT.hpp"
+#include "../pathTracer/scenes.hpp"
+
+#include <filesystem>
+#include <iomanip>
+#include <map>
+#include <random>
+
+// BVH QUALITY ANALYSIS
+// Loads models, builds their BVH with every builder the path tracer offers
+// (`BvhNode`, `FlatBvh` and `CompressedBvh`), and reports for each one its
+// shape (node count, leaf depths and sizes), its SAH cost, the overlap between
+// sibling boxes and its memory footprint. Then traces a sample of random rays
+// through it, counting the boxes and primitives tested.
+
+using Clock = std::chrono::steady_clock;
+
+struct Options {
+    // Rays traced through each BVH
+    int rays = 100000;
+    unsigned int seed = 1;
+    std::vector<std::string> models;
+};
+
+// A BVH of any builder, in a common form: each node has a box, and child nodes
+// and/or primitives (a node of a wide BVH has up to 8 children)
+struct Tree {
+    struct Node {
+        Aabb box;
+        std::vector<uint32_t> children;
+        std::vector<const Hittable*> primitives;
+    };
+
+    std::string builder;
+    std::vector<Node> nodes;
+    double buildMs = 0;
+    size_t nodeBytes = 0;
+    size_t primitiveBytes = 0;
+    // The BVH itself, to time closest-hit queries with its own traversal
+    const Hittable* bvh = nullptr;
+
+    uint32_t add(const Aabb& box) {
+        nodes.push_back({box, {}, {}});
+        return nodes.size() - 1;
+    }
+};
+
+// Keeps the timed queries from being optimized away
+volatile float sink;
+
+double milliseconds(Clock::duration d) {
+    return std::chrono::duration<double, std::milli>(d).count();
+}
+
+float surfaceArea(const Aabb& box) {
+    float x = box.x.size(), y = box.y.size(), z = box.z.size();
+    return 2 * (x * y + y * z + z * x);
+}
+
+// Surface area of the intersection of two boxes (0 if they don't intersect)
+float overlapArea(const Aabb& a, const Aabb& b) {
+    Interval extents[3];
+    for (int axis = 0; axis < 3; axis++) {
+        const Interval& ia = a.axisInterval(axis);
+        const Interval& ib = b.axisInterval(axis);
+        extents[axis] = Interval(std::max(ia.min, ib.min), std::min(ia.max, ib.max));
+        if (extents[axis].min >= extents[axis].max) return 0;
+    }
+    return surfaceArea(Aabb(extents[0], extents[1], extents[2]));
+}
+
+// CONVERSIONS OF EACH BUILDER'S HIERARCHY
+
+void addFlatNode(const FlatBvh<Triangle>& bvh, uint32_t index, uint32_t treeIndex, Tree& tree) {
+    const auto& node = bvh.getNodes()[index];
+    if (node.count > 0) {
+        for (uint32_t i = node.index; i < node.index + node.count; i++) {
+            tree.nodes[treeIndex].primitives.push_back(&bvh.getPrimitives()[i]);
+        }
+        return;
+    }
+    for (uint32_t child : {index + 1, node.index}) {
+        uint32_t treeChild = tree.add(bvh.getNodes()[child].bbox);
+        tree.nodes[treeIndex].children.push_back(treeChild);
+        addFlatNode(bvh, child, treeChild, tree);
+    }
+}
+
+void addCompressedNode(const CompressedBvh<Triangle>& bvh, uint32_t index, uint32_t treeIndex, Tree& tree) {
+    const auto& node = bvh.getNodes()[index];
+    for (int i = 0; i < node.numberOfChildren; i++) {
+        uint32_t treeChild = tree.add(CompressedBvh<Triangle>::childBox(node, i));
+        tree.nodes[treeIndex].children.push_back(treeChild);
+        if (node.isLeaf(i)) {
+            uint32_t start = node.primitiveBase + node.primitiveOffset(i);
+            for (uint32_t p = start; p < start + node.primitiveCount(i); p++) {
+                tree.nodes[treeChild].primitives.push_back(&bvh.getPrimitives()[p]);
+            }
+        } else {
+            addCompressedNode(bvh, node.childBase + node.childOffset(i), treeChild, tree);
+        }
+    }
+}
+
+void addPointerNode(const BvhNode& node, uint32_t treeIndex, Tree& tree) {
+    const Hittable* children[2] = {node.leftChild(), node.rightChild()};
+    for (int i = 0; i < 2; i++) {
+        if (i == 1 && children[1] == children[0]) break;
+        if (auto child = dynamic_cast<const BvhNode*>(children[i])) {
+            uint32_t treeChild = tree.add(child->boundingBox());
+            tree.nodes[treeIndex].children.push_back(treeChild);
+            addPointerNode(*child, treeChild, tree);
+        } else {
+            tree.nodes[treeIndex].primitives.push_back(children[i]);
+        }
+    }
+}
+
+// Builds the BVH of `triangles` with each builder. The BVHs live in `keepAlive`.
+std::vector<Tree> buildTrees(const std::vector<Triangle>& triangles,
+                             std::vector<std::shared_ptr<void>>& keepAlive) {
+    std::vector<Tree> trees;
+
+    {
+        Tree tree;
+        tree.builder = "BvhNode";
+        auto start = Clock::now();
+        HittableList list;
+        for (const Triangle& triangle : triangles) list.add(std::make_shared<Triangle>(triangle));
+        auto bvh = std::make_shared<BvhNode>(list);
+        tree.buildMs = milliseconds(Clock::now() - start);
+        tree.add(bvh->boundingBox());
+        addPointerNode(*bvh, 0, tree);
+        // Nodes and primitives are allocated with their shared_ptr control block
+        const size_t controlBlock = 16;
+        tree.nodeBytes = tree.nodes.size() * (sizeof(BvhNode) + controlBlock);
+        tree.primitiveBytes = triangles.size() * (sizeof(Triangle) + controlBlock);
+        tree.bvh = bvh.get();
+        keepAlive.push_back(bvh);
+        trees.push_back(std::move(tree));
+    }
+
+    auto start = Clock::now();
+    auto flat = std::make_shared<FlatBvh<Triangle>>(triangles);
+    double flatMs = milliseconds(Clock::now() - start);
+    {
+        Tree tree;
+        tree.builder = "FlatBvh";
+        tree.buildMs = flatMs;
+        tree.add(flat->boundingBox());
+        addFlatNode(*flat, 0, 0, tree);
+        tree.nodeBytes = flat->getNodes().size() * sizeof(FlatBvh<Triangle>::Node);
+        tree.primitiveBytes = flat->getPrimitives().size() * sizeof(Triangle);
+        tree.bvh = flat.get();
+        keepAlive.push_back(flat);
+        trees.push_back(std::move(tree));
+    }
+
+    {
+        Tree tree;
+        tree.builder = "CompressedBvh";
+        auto start = Clock::now();
+        auto compressed = std::make_shared<CompressedBvh<Triangle>>(*flat);
+        // Collapsing the flat BVH, which has to be built first
+        tree.buildMs = flatMs + milliseconds(Clock::now() - start);
+        tree.add(compressed->boundingBox());
+        addCompressedNode(*compressed, 0, 0, tree);
+        tree.nodeBytes = compressed->nodeMemory();
+        tree.primitiveBytes = compressed->getPrimitives().size() * sizeof(Triangle);
+        tree.bvh = compressed.get();
+        keepAlive.push_back(compressed);
+        trees.push_back(std::move(tree));
+    }
+    return trees;
+}
+
+// STATISTICS
+
+struct TreeStats {
+    size_t interiorNodes = 0;
+    size_t leaves = 0;
+    // Number of leaves at each depth (the root is at depth 0)
+    std::map<int, size_t> leafDepths;
+    // Number of leaves with each number of primitives
+    std::map<size_t, size_t> leafSizes;
+    // Expected number of box and primitive tests of a ray through the root box
+    // (surface area heuristic, with the same cost for both)
+    double sahCost = 0;
+    // Sum over all nodes of the surface area shared by each pair of child boxes,
+    // relative to the root's
+    double siblingOverlap = 0;
+    // Averages over the sample of rays
+    double boxTestsPerRay = 0;
+    double nodesVisitedPerRay = 0;
+    double primitiveTestsPerRay = 0;
+    double nsPerRay = 0;
+};
+
+void collectStats(const Tree& tree, uint32_t index, int depth, float rootArea, TreeStats& stats) {
+    const Tree::Node& node = tree.nodes[index];
+    double relativeArea = surfaceArea(node.box) / rootArea;
+    if (node.children.empty()) {
+        stats.leaves++;
+        stats.leafDepths[depth]++;
+        stats.leafSizes[node.primitives.size()]++;
+    } else {
+        stats.interiorNodes++;
+    }
+    // Each visit tests the boxes of the children and the primitives of the node
+    stats.sahCost += relativeArea * (node.children.size() + node.primitives.size());
+    for (size_t i = 0; i < node.children.size(); i++) {
+        for (size_t j = i + 1; j < node.children.size(); j++) {
+            stats.siblingOverlap += overlapArea(tree.nodes[node.children[i]].box,
+                                                tree.nodes[node.children[j]].box) / rootArea;
+        }
+        collectStats(tree, node.children[i], depth + 1, rootArea, stats);
+    }
+}
+
+// Distance at which the ray enters `box` within `rayT` (false if it misses it)
+bool entryDistance(const Aabb& box, const Point3& origin, const Vec3& invDir,
+                   const Interval& rayT, float& t) {
+    float tMin = rayT.min, tMax = rayT.max;
+    for (int axis = 0; axis < 3; axis++) {
+        const Interval& extent = box.axisInterval(axis);
+        float t0 = (extent.min - origin[axis]) * invDir[axis];
+        float t1 = (extent.max - origin[axis]) * invDir[axis];
+        if (t0 > t1) std::swap(t0, t1);
+        tMin = std::max(tMin, t0);
+        tMax = std::min(tMax, t1);
+    }
+    t = tMin;
+    return tMin <= tMax;
+}
+
+// Closest-hit traversal of the common form, nearest child first, skipping nodes
+// entered beyond the closest hit so far (like the renderer's traversals)
+void traceRay(const Tree& tree, const Ray& r, uint64_t& boxTests, uint64_t& nodesVisited,
+              uint64_t& primitiveTests) {
+    Vec3 invDir = 1.0f / r.direction();
+    Interval rayT(0.001f, infinity);
+    float t;
+    boxTests++;
+    if (!entryDistance(tree.nodes[0].box, r.origin(), invDir, rayT, t)) return;
+
+    struct Entry {
+        uint32_t node;
+        float t;
+    };
+    std::vector<Entry> stack = {{0, t}};
+    std::vector<Entry> children;
+    while (!stack.empty()) {
+        Entry entry = stack.back();
+        stack.pop_back();
+        if (entry.t > rayT.max) continue;
+        const Tree::Node& node = tree.nodes[entry.node];
+        nodesVisited++;
+        for (const Hittable* primitive : node.primitives) {
+            primitiveTests++;
+            HitRecord rec;
+            if (primitive->hit(r, rayT, rec)) rayT.max = rec.t;
+        }
+        children.clear();
+        for (uint32_t child : node.children) {
+            boxTests++;
+            if (entryDistance(tree.nodes[child].box, r.origin(), invDir, rayT, t)) children.push_back({child, t});
+        }
+        // Farthest first on the stack, so that the nearest is popped first
+        std::sort(children.begin(), children.end(), [](const Entry& a, const Entry& b) { return a.t > b.t; });
+        stack.insert(stack.end(), children.begin(), children.end());
+    }
+}
+
+// Rays from random points of `box`, in uniformly distributed directions
+std::vector<Ray> makeRays(const Aabb& box, int n, unsigned int seed) {
+    std::mt19937 generator(seed);
+    std::uniform_real_distribution<float> uniform(0.0f, 1.0f);
+    std::normal_distribution<float> normal;
+    std::vector<Ray> rays;
+    rays.reserve(n);
+    for (int i = 0; i < n; i++) {
+        Point3 origin(box.x.min + uniform(generator) * box.x.size(),
+                      box.y.min + uniform(generator) * box.y.size(),
+                      box.z.min + uniform(generator) * box.z.size());
+        Vec3 direction;
+        do {
+            direction = Vec3(normal(generator), normal(generator), normal(generator));
+        } while (glm::dot(direction, direction) == 0);
+        rays.push_back(Ray(origin, glm::normalize(direction)));
+    }
+    return rays;
+}
+
+TreeStats analyze(const Tree& tree, const std::vector<Ray>& rays) {
+    TreeStats stats;
+    collectStats(tree, 0, 0, surfaceArea(tree.nodes[0].box), stats);
+    // The root box is tested for every ray
+    stats.sahCost += 1;
+
+    uint64_t boxTests = 0, nodesVisited = 0, primitiveTests = 0;
+    for (const Ray& r : rays) traceRay(tree, r, boxTests, nodesVisited, primitiveTests);
+    stats.boxTestsPerRay = double(boxTests) / rays.size();
+    stats.nodesVisitedPerRay = double(nodesVisited) / rays.size();
+    stats.primitiveTestsPerRay = double(primitiveTests) / rays.size();
+
+    auto start = Clock::now();
+    float checksum = 0;
+    for (const Ray& r : rays) {
+        HitRecord rec;
+        if (tree.bvh->hit(r, Interval(0.001f, infinity), rec)) checksum += rec.t;
+    }
+    stats.nsPerRay = std::chrono::duration<double, std::nano>(Clock::now() - start).count() / rays.size();
+    sink = checksum;
+    return stats;
+}
+
+// REPORT
+
+void printRow(const std::string& label, const std::vector<std::string>& values) {
+    std::cout << "  " << std::left << std::setw(30) << label << std::right;
+    for (const std::string& value : values) std::cout << std::setw(16) << value;
+    std::cout << "\n";
+}
+
+std::string format(double value, int precision = 2) {
+    std::ostringstream out;
+    out << std::fixed << std::setprecision(precision) << value;
+    return out.str();
+}
+
+template <typename Key>
+void printHistogram(const std::string& label, const std::map<Key, size_t>& histogram, size_t total) {
+    std::cout << "    " << label << ":";
+    for (const auto& [key, count] : histogram) {
+        std::cout << " " << key << ":" << format(100.0 * count / total, 1) << "%";
+    }
+    std::cout << "\n";
+}
+
+void analyzeModel(const std::string& objFilePath, const Options& options) {
+    SceneArena arena;
+    Model model(objFilePath, arena);
+    model.bypassCaches();
+    // Loading logs aren't part of the report
+    std::streambuf* log = std::clog.rdbuf(nullptr);
+    model.initialize();
+    std::clog.rdbuf(log);
+    std::vector<Triangle> triangles;
+    for (unsigned int i = 0; i < model.numberOfMeshes(); i++) model.getMesh(i).appendTriangles(triangles);
+    if (triangles.empty()) {
+        std::cout << objFilePath << ": no triangles\n";
+        return;
+    }
+
+    std::vector<std::shared_ptr<void>> keepAlive;
+    std::vector<Tree> trees = buildTrees(triangles, keepAlive);
+    std::vector<Ray> rays = makeRays(trees[0].nodes[0].box, options.rays, options.seed);
+    std::vector<TreeStats> stats;
+    for (const Tree& tree : trees) stats.push_back(analyze(tree, rays));
+
+    std::cout << "\n" << objFilePath << ": " << triangles.size() << " triangles, "
+              << rays.size() << " random rays\n";
+    auto row = [&](const std::string& label, const std::function<std::string(size_t)>& value) {
+        std::vector<std::string> values;
+        for (size_t i = 0; i < trees.size(); i++) values.push_back(value(i));
+        printRow(label, values);
+    };
+    row("", [&](size_t i) { return trees[i].builder; });
+    row("build (ms)", [&](size_t i) { return format(trees[i].buildMs, 1); });
+    row("interior nodes", [&](size_t i) { return std::to_string(stats[i].interiorNodes); });
+    row("leaves", [&](size_t i) { return std::to_string(stats[i].leaves); });
+    row("leaf depth (mean)", [&](size_t i) {
+        double sum = 0;
+        for (const auto& [depth, count] : stats[i].leafDepths) sum += double(depth) * count;
+        return format(sum / stats[i].leaves);
+    });
+    row("leaf depth (max)", [&](size_t i) { return std::to_string(stats[i].leafDepths.rbegin()->first); });
+    row("primitives per leaf (mean)", [&](size_t i) { return format(double(triangles.size()) / stats[i].leaves); });
+    row("SAH cost", [&](size_t i) { return format(stats[i].sahCost); });
+    row("sibling overlap", [&](size_t i) { return format(stats[i].siblingOverlap); });
+    row("node memory (MB)", [&](size_t i) { return format(trees[i].nodeBytes / 1048576.0); });
+    row("primitive memory (MB)", [&](size_t i) { return format(trees[i].primitiveBytes / 1048576.0); });
+    row("boxes tested per ray", [&](size_t i) { return format(stats[i].boxTestsPerRay); });
+    row("nodes visited per ray", [&](size_t i) { return format(stats[i].nodesVisitedPerRay); });
+    row("primitives tested per ray", [&](size_t i) { return format(stats[i].primitiveTestsPerRay); });
+    row("closest hit (ns per ray)", [&](size_t i) { return format(stats[i].nsPerRay, 0); });
+    for (size_t i = 0; i < trees.size(); i++) {
+        std::cout << "  " << trees[i].builder << "\n";
+        printHistogram("leaf depths", stats[i].leafDepths, stats[i].leaves);
+        printHistogram("leaf sizes", stats[i].leafSizes, stats[i].leaves);
+    }
+}
+
+void usage() {
+    std::cerr << "Usage: myBvhTool [--rays N] [--seed S] [MODEL...]\n"
+                 "  MODEL is the name of a model in the models directory, or the path of a .obj file\n"
+                 "  (default: every model in the models directory)\n";
+    std::exit(1);
+}
+
+int main(int argc, char* argv[]) {
+    Options options;
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        bool hasValue = i + 1 < argc;
+        if (arg == "--rays" && hasValue) options.rays = std::max(1, std::atoi(argv[++i]));
+        else if (arg == "--seed" && hasValue) options.seed = std::strtoul(argv[++i], nullptr, 10);
+        else if (arg.rfind("--", 0) == 0) usage();
+        else options.models.push_back(arg);
+    }
+    if (options.models.empty()) {
+        std::vector<std::string> names;
+        for (const auto& entry : std::filesystem::directory_iterator("models")) {
+            if (entry.is_directory()) names.push_back(entry.path().filename().string());
+        }
+        std::sort(names.begin(), names.end());
+        options.models = names;
+    }
+
+    std::cout << "SAH cost: expected box and primitive tests of a ray through the root box.\n"
+              << "Sibling overlap: surface area shared by sibling boxes, relative to the root box.\n";
+    for (const std::string& model : options.models) {
+        std::string path = model;
+        if (path.size() < 4 || path.compare(path.size() - 4, 4, ".obj") != 0) {
+            path = "models/" + model + "/" + model + ".obj";
+        }
+        if (!std::filesystem::exists(path)) {
+            std::cout << path << " not found, skipping\n";
+            continue;
+        }
+        analyzeModel(path, options);
+    }
+    return 0;
+}
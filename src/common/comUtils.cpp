@@ -121,6 +121,20 @@ matType determineMatType(aiMaterial *material, illModel model){
     }
 }
 
+matType determineMatType(const MaterialInfo& material){
+    bool isEmissive = material.emissive != glm::vec3(0.0f);
+    if (material.model == BASE_SHADING && isEmissive) { return DIFFUSE_LIGHT; }
+    switch (material.model) {
+        case BASE_SHADING:
+        default:
+            return LAMBERTIAN;
+        case REFLECTION_ON:
+            return METAL;
+        case REFRACTION_ON:
+            return DIELECTRIC; 
+    }
+}
+
 bool isDiffuseLight(aiMaterial *material, illModel model){
     bool isEmissive = false;
     aiColor3D color;
@@ -131,24 +145,57 @@ bool isDiffuseLight(aiMaterial *material, illModel model){
     return isEmissive;
 }
 
-illModel readIllModel(const string& materialName, const string& mtlFilePath){
+MaterialLibrary readMaterialLibrary(const string& mtlFilePath){
     ifstream mtlFile;
     mtlFile.open(mtlFilePath);
     if (mtlFile.fail()) fatalError("Error: failed opening file " + mtlFilePath);
 
-    // find material description
+    MaterialLibrary library;
     string line;
-    do {
-        getline(mtlFile, line);
-    } while (line != "newmtl " + materialName);
-    // read illumination model
-    string s;
-    do {
-        mtlFile >> s;
-    } while (s != "illum");
-    int n;
-    mtlFile >> n;
-    return static_cast<illModel>(n); 
+    // material whose description is being read
+    MaterialInfo* material = nullptr;
+    auto readColor = [](istringstream& iss) {
+        glm::vec3 c(0.0f);
+        iss >> c.x >> c.y >> c.z;
+        return c;
+    };
+    while (getline(mtlFile, line)) {
+        if (!line.empty() && line.back() == '\r') line.pop_back();
+        istringstream iss(line);
+        string keyword;
+        iss >> keyword;
+        if (keyword == "newmtl") {
+            // the name is the rest of the line
+            string materialName;
+            getline(iss >> std::ws, materialName);
+            material = &library[materialName];
+        } else if (material == nullptr) {
+            continue;
+        } else if (keyword == "illum") {
+            int n;
+            if (iss >> n) material->model = static_cast<illModel>(n);
+        } else if (keyword == "Kd") {
+            material->diffuse = readColor(iss);
+        } else if (keyword == "Ks") {
+            material->specular = readColor(iss);
+        } else if (keyword == "Ke") {
+            material->emissive = readColor(iss);
+        } else if (keyword == "Ns") {
+            iss >> material->shininess;
+        } else if (keyword == "Ni") {
+            iss >> material->refractionIndex;
+        } else if (keyword == "map_Kd") {
+            // the file name is the last token (options may come before it)
+            string token;
+            while (iss >> token) material->diffuseMap = token;
+        }
+    }
+    return library;
+}
+
+illModel readIllModel(const string& materialName, const MaterialLibrary& library){
+    auto it = library.find(materialName);
+    return (it == library.end()) ? BASE_SHADING : it->second.model;
 }
 
 } // namespace materials
@@ -2,6 +2,7 @@
 
 #include <iostream>
 #include <fstream>
+#include <unordered_map>
 
 #include <glm/glm.hpp>
 #include <assimp/scene.h>
@@ -71,12 +72,36 @@ namespace materials {
         DIFFUSE_LIGHT
     };
 
+    // Material description, as found in a .mtl file
+    struct MaterialInfo {
+        illModel model = BASE_SHADING;
+        // Kd, Ks and Ke colors
+        glm::vec3 diffuse = glm::vec3(0.0f);
+        glm::vec3 specular = glm::vec3(0.0f);
+        glm::vec3 emissive = glm::vec3(0.0f);
+        // Ns
+        float shininess = 0.0f;
+        // Ni
+        float refractionIndex = 1.0f;
+        // map_Kd: diffuse texture file name (empty if there isn't one)
+        std::string diffuseMap;
+    };
+
     matType determineMatType(aiMaterial *material, illModel model);
 
+    matType determineMatType(const MaterialInfo& material);
+
     bool isDiffuseLight(aiMaterial *material, illModel model);
 
-    // Reads illumination model for the specified material in .mtl file
-    illModel readIllModel(const std::string& materialName, const std::string& mtlFilePath);
+    // Materials of a .mtl file, by material name
+    using MaterialLibrary = std::unordered_map<std::string, MaterialInfo>;
+
+    // Reads all materials in .mtl file, in a single pass
+    MaterialLibrary readMaterialLibrary(const std::string& mtlFilePath);
+
+    // Returns illumination model for the specified material of the library
+    // (BASE_SHADING if the material doesn't specify one)
+    illModel readIllModel(const std::string& materialName, const MaterialLibrary& library);
 }
 
 }
@@ -0,0 +1,194 @@
+#pragma once
+
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstring>
+#include <iomanip>
+#include <iostream>
+#include <string>
+#include <vector>
+
+// Timing harness of the kernel micro-benchmarks: each kernel is run a few
+// times untimed (warm-up), then timed over several runs, and reported in
+// ns/op and ops/s, optionally with hardware counters per operation
+namespace microBench {
+    struct Options {
+        // Untimed runs before the timed ones (caches, branch predictors, clock frequency)
+        int warmUpRuns = 2;
+        int runs = 10;
+        // Whether to sample hardware counters (see `PerfCounters`)
+        bool counters = false;
+        // Only kernels whose name, or the title of whose group, contains this are run
+        std::string filter;
+    };
+
+    // Hardware counters of the calling thread, read with perf_event_open
+    // (user space only, so that it works with the default perf_event_paranoid).
+    // Unavailable counters (e.g. in virtual machines) read as 0.
+    class PerfCounters {
+        public:
+            enum Event { Cycles, Instructions, CacheMisses, BranchMisses, numberOfEvents };
+
+            PerfCounters() {
+                const uint64_t configs[numberOfEvents] = {
+                    PERF_COUNT_HW_CPU_CYCLES, PERF_COUNT_HW_INSTRUCTIONS,
+                    PERF_COUNT_HW_CACHE_MISSES, PERF_COUNT_HW_BRANCH_MISSES};
+                for (int e = 0; e < numberOfEvents; e++) {
+                    perf_event_attr attr;
+                    std::memset(&attr, 0, sizeof(attr));
+                    attr.size = sizeof(attr);
+                    attr.type = PERF_TYPE_HARDWARE;
+                    attr.config = configs[e];
+                    attr.disabled = 1;
+                    attr.exclude_kernel = 1;
+                    attr.exclude_hv = 1;
+                    fds[e] = int(syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0));
+                }
+            }
+
+            ~PerfCounters() {
+                for (int fd : fds) {
+                    if (fd >= 0) close(fd);
+                }
+            }
+
+            PerfCounters(const PerfCounters&) = delete;
+            PerfCounters& operator=(const PerfCounters&) = delete;
+
+            bool available() const {
+                return std::any_of(std::begin(fds), std::end(fds), [](int fd) { return fd >= 0; });
+            }
+
+            static const char* name(int event) {
+                static const char* names[numberOfEvents] = {"cycles", "instr", "cache-miss", "br-miss"};
+                return names[event];
+            }
+
+            void start() {
+                for (int fd : fds) {
+                    if (fd < 0) continue;
+                    ioctl(fd, PERF_EVENT_IOC_RESET, 0);
+                    ioctl(fd, PERF_EVENT_IOC_ENABLE, 0);
+                }
+            }
+
+            // Stops counting, and adds the counts since `start` to `counts`
+            void stop(uint64_t counts[numberOfEvents]) {
+                for (int e = 0; e < numberOfEvents; e++) {
+                    if (fds[e] < 0) continue;
+                    ioctl(fds[e], PERF_EVENT_IOC_DISABLE, 0);
+                    uint64_t count = 0;
+                    if (read(fds[e], &count, sizeof(count)) == sizeof(count)) counts[e] += count;
+                }
+            }
+
+        private:
+            int fds[numberOfEvents];
+    };
+
+    struct Result {
+        std::string name;
+        // Per operation, over the timed runs
+        double medianNs = 0;
+        double bestNs = 0;
+        // Hardware counts per operation (if sampled)
+        bool hasCounters = false;
+        double counts[PerfCounters::numberOfEvents] = {};
+    };
+
+    // Results are written here, so that kernels aren't optimized away
+    inline volatile float sink;
+
+    // Times `kernel`, which performs `ops` operations per call and returns
+    // a checksum of their results
+    template <typename Kernel>
+    Result measure(const std::string& name, size_t ops, Kernel&& kernel,
+                   const Options& options, PerfCounters* counters = nullptr) {
+        using Clock = std::chrono::steady_clock;
+        for (int i = 0; i < options.warmUpRuns; i++) sink = kernel();
+
+        std::vector<double> times;
+        uint64_t counts[PerfCounters::numberOfEvents] = {};
+        for (int i = 0; i < options.runs; i++) {
+            if (counters) counters->start();
+            auto start = Clock::now();
+            float checksum = kernel();
+            auto time = Clock::now() - start;
+            if (counters) counters->stop(counts);
+            sink = checksum;
+            times.push_back(std::chrono::duration<double, std::nano>(time).count() / ops);
+        }
+        std::sort(times.begin(), times.end());
+
+        Result result;
+        result.name = name;
+        result.medianNs = times[times.size() / 2];
+        result.bestNs = times[0];
+        if (counters) {
+            result.hasCounters = true;
+            for (int e = 0; e < PerfCounters::numberOfEvents; e++) {
+                result.counts[e] = double(counts[e]) / (double(ops) * options.runs);
+            }
+        }
+        return result;
+    }
+
+    // Kernel variants measured side by side: each is reported relative to the
+    // first one of the group
+    class Group {
+        public:
+            Group(const std::string& title, const Options& options, PerfCounters* counters)
+                : title(title), options(options), counters(counters) {}
+
+            // Measures and reports `kernel` (see `measure`), unless neither its name
+            // nor the title of the group contain the filter
+            template <typename Kernel>
+            void run(const std::string& name, size_t ops, Kernel&& kernel) {
+                if (name.find(options.filter) == std::string::npos &&
+                    title.find(options.filter) == std::string::npos) return;
+                if (reference == 0) printHeader();
+                Result result = measure(name, ops, kernel, options, counters);
+                if (reference == 0) reference = result.medianNs;
+                std::cout << "  " << std::left << std::setw(nameWidth) << name << std::right
+                          << std::fixed << std::setprecision(2)
+                          << std::setw(10) << result.medianNs
+                          << std::setw(10) << result.bestNs
+                          << std::setw(12) << 1e3 / result.medianNs
+                          << std::setw(9) << reference / result.medianNs << "x";
+                if (result.hasCounters) {
+                    for (double count : result.counts) std::cout << std::setw(12) << count;
+                }
+                std::cout << std::defaultfloat << std::setprecision(6) << "\n";
+            }
+
+        private:
+            static const int nameWidth = 36;
+
+            std::string title;
+            const Options& options;
+            PerfCounters* counters;
+            double reference = 0;
+
+            void printHeader() const {
+                std::cout << "\n" << title << "\n"
+                          << "  " << std::left << std::setw(nameWidth) << "kernel" << std::right
+                          << std::setw(10) << "ns/op" << std::setw(10) << "best"
+                          << std::setw(12) << "Mops/s" << std::setw(10) << "relative";
+                if (counters) {
+                    for (int e = 0; e < PerfCounters::numberOfEvents; e++) {
+                        std::cout << std::setw(12) << PerfCounters::name(e);
+                    }
+                }
+                std::cout << "\n";
+            }
+    };
+
+    // Intersection, sampling and scattering kernels, and BVH traversal (kernels.cpp)
+    void benchKernels(const Options& options);
+}
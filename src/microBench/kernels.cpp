@@ -0,0 +1,317 @@
+#include "harness.hpp"
+
+#include "../pathTracer/myPT.hpp"
+#include "../pathTracer/scenes.hpp"
+
+// KERNEL MICRO-BENCHMARKS
+// Each kernel runs over a fixed pseudo-random dataset (regenerated from the same
+// seed for every group, so that results don't depend on which groups are run),
+// and the variants the renderer offers for it are measured side by side
+
+namespace {
+    // Size of the datasets of the per-primitive kernels (one ray per primitive)
+    const int nPrimitives = 1 << 16;
+    // Triangles and rays of the traversal benchmarks
+    const int nSceneTriangles = 1 << 17;
+    const int nTraversalRays = 1 << 14;
+
+    void reseed() { srand(42); }
+
+    // Whether the filter selects any of `names` (to skip building unused datasets)
+    bool selected(const microBench::Options& options, std::initializer_list<const char*> names) {
+        return std::any_of(names.begin(), names.end(), [&](const char* name) {
+            return std::string(name).find(options.filter) != std::string::npos;
+        });
+    }
+
+    // Rays from the cube [-3,3]^3 towards random points of [-1,1]^3,
+    // where the primitives are
+    std::vector<Ray> makeRays(int n) {
+        std::vector<Ray> rays;
+        rays.reserve(n);
+        for (int i = 0; i < n; i++) {
+            Point3 origin = randomVec3(-3, 3);
+            Point3 target = randomVec3(-1, 1);
+            rays.push_back(Ray(origin, glm::normalize(target - origin)));
+        }
+        return rays;
+    }
+
+    std::vector<Aabb> makeBoxes(int n) {
+        std::vector<Aabb> boxes;
+        boxes.reserve(n);
+        for (int i = 0; i < n; i++) {
+            Point3 center = randomVec3(-1, 1);
+            Vec3 halfSize = randomVec3(0.05f, 0.5f);
+            boxes.push_back(Aabb(center - halfSize, center + halfSize));
+        }
+        return boxes;
+    }
+
+    // Triangles with a vertex in [-1,1]^3 and edges up to `size` along each axis
+    std::vector<Triangle> makeTriangles(int n, float size, const Material* mat) {
+        std::vector<Triangle> triangles;
+        triangles.reserve(n);
+        for (int i = 0; i < n; i++) {
+            Vertex v0, v1, v2;
+            v0.position = randomVec3(-1, 1);
+            v1.position = v0.position + randomVec3(-size, size);
+            v2.position = v0.position + randomVec3(-size, size);
+            Vec3 normal = glm::normalize(glm::cross(v1.position - v0.position, v2.position - v0.position));
+            v0.normal = v1.normal = v2.normal = normal;
+            triangles.emplace_back(v0, v1, v2, mat);
+        }
+        return triangles;
+    }
+
+    std::vector<Sphere> makeSpheres(int n, const Material* mat) {
+        std::vector<Sphere> spheres;
+        spheres.reserve(n);
+        for (int i = 0; i < n; i++) spheres.emplace_back(randomVec3(-1, 1), randomFloat(0.05f, 0.5f), mat);
+        return spheres;
+    }
+
+    // Surface points with incoming rays, as seen by `Material::scatter`
+    struct ScatterQuery {
+        Ray in;
+        HitRecord rec;
+    };
+
+    std::vector<ScatterQuery> makeScatterQueries(int n) {
+        std::vector<ScatterQuery> queries;
+        queries.reserve(n);
+        for (int i = 0; i < n; i++) {
+            ScatterQuery q;
+            q.rec.p = randomVec3(-1, 1);
+            q.rec.normal = randomUnitVector();
+            q.rec.frontFace = randomFloat() < 0.5f;
+            q.rec.u = randomFloat();
+            q.rec.v = randomFloat();
+            q.in = Ray(q.rec.p - q.rec.normal, randomOnHemisphere(-q.rec.normal));
+            queries.push_back(q);
+        }
+        return queries;
+    }
+
+    void benchBoxes(const microBench::Options& options, microBench::PerfCounters* counters) {
+        reseed();
+        std::vector<Aabb> boxes = makeBoxes(nPrimitives);
+        std::vector<Ray> rays = makeRays(nPrimitives);
+        std::vector<Vec3> invDirs;
+        invDirs.reserve(rays.size());
+        for (const Ray& r : rays) invDirs.push_back(1.0f / r.direction());
+        const Interval rayT(0.001f, infinity);
+
+        microBench::Group group("Aabb::hit (ray/box)", options, counters);
+        group.run("Aabb::hit(ray)", nPrimitives, [&]() {
+            int hits = 0;
+            for (int i = 0; i < nPrimitives; i++) hits += boxes[i].hit(rays[i], rayT);
+            return float(hits);
+        });
+        // As in BVH traversal: the inverse direction is computed once per ray
+        group.run("Aabb::hit(origin, invDir)", nPrimitives, [&]() {
+            int hits = 0;
+            for (int i = 0; i < nPrimitives; i++) hits += boxes[i].hit(rays[i].origin(), invDirs[i], rayT);
+            return float(hits);
+        });
+    }
+
+    void benchTriangles(const microBench::Options& options, microBench::PerfCounters* counters) {
+        reseed();
+        Lambertian mat(Color(0.5f, 0.5f, 0.5f));
+        std::vector<Triangle> triangles = makeTriangles(nPrimitives, 1.0f, &mat);
+        std::vector<Ray> rays = makeRays(nPrimitives);
+        const Interval rayT(0.001f, infinity);
+
+        microBench::Group group("Triangle (ray/triangle)", options, counters);
+        group.run("Triangle::hit", nPrimitives, [&]() {
+            float sum = 0;
+            for (int i = 0; i < nPrimitives; i++) {
+                HitRecord rec;
+                if (triangles[i].hit(rays[i], rayT, rec)) sum += rec.t;
+            }
+            return sum;
+        });
+        group.run("Triangle::occluded", nPrimitives, [&]() {
+            int hits = 0;
+            for (int i = 0; i < nPrimitives; i++) hits += triangles[i].occluded(rays[i], rayT);
+            return float(hits);
+        });
+        // Closest hit followed by shading, as for the hit found by a camera ray
+        group.run("Triangle::hit + surface interaction", nPrimitives, [&]() {
+            float sum = 0;
+            for (int i = 0; i < nPrimitives; i++) {
+                HitRecord rec;
+                if (triangles[i].hit(rays[i], rayT, rec)) {
+                    triangles[i].computeSurfaceInteraction(rays[i], rec);
+                    sum += rec.normal.x + rec.u;
+                }
+            }
+            return sum;
+        });
+    }
+
+    void benchSpheres(const microBench::Options& options, microBench::PerfCounters* counters) {
+        reseed();
+        Lambertian mat(Color(0.5f, 0.5f, 0.5f));
+        std::vector<Sphere> spheres = makeSpheres(nPrimitives, &mat);
+        std::vector<Ray> rays = makeRays(nPrimitives);
+        const Interval rayT(0.001f, infinity);
+
+        microBench::Group group("Sphere (ray/sphere)", options, counters);
+        group.run("Sphere::hit", nPrimitives, [&]() {
+            float sum = 0;
+            for (int i = 0; i < nPrimitives; i++) {
+                HitRecord rec;
+                if (spheres[i].hit(rays[i], rayT, rec)) sum += rec.t;
+            }
+            return sum;
+        });
+        group.run("Sphere::occluded", nPrimitives, [&]() {
+            int hits = 0;
+            for (int i = 0; i < nPrimitives; i++) hits += spheres[i].occluded(rays[i], rayT);
+            return float(hits);
+        });
+        group.run("Sphere::hit + surface interaction", nPrimitives, [&]() {
+            float sum = 0;
+            for (int i = 0; i < nPrimitives; i++) {
+                HitRecord rec;
+                if (spheres[i].hit(rays[i], rayT, rec)) {
+                    spheres[i].computeSurfaceInteraction(rays[i], rec);
+                    sum += rec.normal.x + rec.u;
+                }
+            }
+            return sum;
+        });
+    }
+
+    void benchSampling(const microBench::Options& options, microBench::PerfCounters* counters) {
+        reseed();
+        const Vec3 normal(0, 1, 0);
+
+        microBench::Group group("Direction sampling", options, counters);
+        group.run("randomUnitVector", nPrimitives, [&]() {
+            float sum = 0;
+            for (int i = 0; i < nPrimitives; i++) sum += randomUnitVector().x;
+            return sum;
+        });
+        group.run("randomInUnitSphere", nPrimitives, [&]() {
+            float sum = 0;
+            for (int i = 0; i < nPrimitives; i++) sum += randomInUnitSphere().x;
+            return sum;
+        });
+        group.run("randomOnHemisphere", nPrimitives, [&]() {
+            float sum = 0;
+            for (int i = 0; i < nPrimitives; i++) sum += randomOnHemisphere(normal).x;
+            return sum;
+        });
+        group.run("randomInUnitDisk", nPrimitives, [&]() {
+            float sum = 0;
+            for (int i = 0; i < nPrimitives; i++) sum += randomInUnitDisk().x;
+            return sum;
+        });
+        group.run("randomFloat", nPrimitives, [&]() {
+            float sum = 0;
+            for (int i = 0; i < nPrimitives; i++) sum += randomFloat();
+            return sum;
+        });
+    }
+
+    void benchScattering(const microBench::Options& options, microBench::PerfCounters* counters) {
+        reseed();
+        std::vector<ScatterQuery> queries = makeScatterQueries(nPrimitives);
+        Lambertian lambertian(Color(0.5f, 0.5f, 0.5f));
+        Metal metal(Color(0.8f, 0.8f, 0.8f), 0.1f);
+        Dielectric dielectric(1.5f);
+
+        microBench::Group group("Material::scatter", options, counters);
+        auto scatter = [&](const Material& mat) {
+            return [&]() {
+                float sum = 0;
+                for (const ScatterQuery& q : queries) {
+                    Color attenuation;
+                    Ray scattered;
+                    if (mat.scatter(q.in, q.rec, attenuation, scattered)) sum += scattered.direction().x;
+                }
+                return sum;
+            };
+        };
+        group.run("Dielectric::scatter", nPrimitives, scatter(dielectric));
+        group.run("Lambertian::scatter", nPrimitives, scatter(lambertian));
+        group.run("Metal::scatter", nPrimitives, scatter(metal));
+    }
+
+    // Closest-hit and any-hit queries through the acceleration structures
+    // the renderer can use, over the same triangles
+    void benchTraversal(const microBench::Options& options, microBench::PerfCounters* counters) {
+        if (!selected(options, {"BVH traversal, closest hit", "BVH traversal, any hit",
+                                "BvhNode::hit", "FlatBvh::hit", "CompressedBvh::hit",
+                                "BvhNode::occluded", "FlatBvh::occluded", "CompressedBvh::occluded"})) return;
+        reseed();
+        Lambertian mat(Color(0.5f, 0.5f, 0.5f));
+        std::vector<Triangle> triangles = makeTriangles(nSceneTriangles, 0.05f, &mat);
+        std::vector<Ray> rays = makeRays(nTraversalRays);
+        const Interval rayT(0.001f, infinity);
+
+        HittableList list;
+        for (const Triangle& triangle : triangles) list.add(std::make_shared<Triangle>(triangle));
+        BvhNode pointerBvh(list);
+        FlatBvh<Triangle> flatBvh(triangles);
+        CompressedBvh<Triangle> compressedBvh(flatBvh);
+
+        std::cout << "\nBVH over " << nSceneTriangles << " triangles (" << sizeof(Triangle)
+                  << " bytes each): FlatBvh " << flatBvh.getNodes().size() * sizeof(FlatBvh<Triangle>::Node) / 1024
+                  << " kB of nodes, CompressedBvh " << compressedBvh.nodeMemory() / 1024 << " kB\n";
+
+        auto closestHit = [&](const Hittable& bvh) {
+            return [&]() {
+                float sum = 0;
+                for (const Ray& r : rays) {
+                    HitRecord rec;
+                    if (bvh.hit(r, rayT, rec)) sum += rec.t;
+                }
+                return sum;
+            };
+        };
+        auto anyHit = [&](const Hittable& bvh) {
+            return [&]() {
+                int hits = 0;
+                for (const Ray& r : rays) hits += bvh.occluded(r, rayT);
+                return float(hits);
+            };
+        };
+
+        microBench::Group hitGroup("BVH traversal, closest hit", options, counters);
+        hitGroup.run("BvhNode::hit", nTraversalRays, closestHit(pointerBvh));
+        hitGroup.run("FlatBvh::hit", nTraversalRays, closestHit(flatBvh));
+        hitGroup.run("CompressedBvh::hit", nTraversalRays, closestHit(compressedBvh));
+
+        microBench::Group occludedGroup("BVH traversal, any hit", options, counters);
+        occludedGroup.run("BvhNode::occluded", nTraversalRays, anyHit(pointerBvh));
+        occludedGroup.run("FlatBvh::occluded", nTraversalRays, anyHit(flatBvh));
+        occludedGroup.run("CompressedBvh::occluded", nTraversalRays, anyHit(compressedBvh));
+    }
+}
+
+void microBench::benchKernels(const Options& options) {
+    std::unique_ptr<PerfCounters> counters;
+    if (options.counters) {
+        counters = std::make_unique<PerfCounters>();
+        if (!counters->available()) {
+            std::cout << "Hardware counters unavailable (see /proc/sys/kernel/perf_event_paranoid)\n";
+            counters.reset();
+        }
+    }
+
+    std::cout << "Kernels: " << options.warmUpRuns << " warm-up runs, " << options.runs << " timed runs"
+#ifdef COMPACT_VERTICES
+              << ", compact vertices"
+#endif
+              << "\n";
+    benchBoxes(options, counters.get());
+    benchTriangles(options, counters.get());
+    benchSpheres(options, counters.get());
+    benchSampling(options, counters.get());
+    benchScattering(options, counters.get());
+    benchTraversal(options, counters.get());
+}
@@ -0,0 +1,295 @@
+#include "harness.hpp"
+
+#include "../pathTracer/myPT.hpp"
+#include "../pathTracer/scenes.hpp"
+#include "../pathTracer/image.hpp"
+#include "../pathTracer/textureCache.hpp"
+#include "../pathTracer/objLoader.hpp"
+
+#include <assimp/Importer.hpp>
+#include <assimp/postprocess.h>
+
+#include <atomic>
+#include <filesystem>
+#include <fstream>
+#include <new>
+
+// MICRO-BENCHMARKS
+// Times the path tracer's kernels in isolation, on fixed pseudo-random datasets
+
+using Clock = std::chrono::steady_clock;
+
+// Heap allocations made through operator new, counted to compare allocation strategies
+std::atomic<size_t> heapAllocations{0};
+
+void* operator new(size_t size) {
+    heapAllocations.fetch_add(1, std::memory_order_relaxed);
+    if (void* p = std::malloc(size ? size : 1)) return p;
+    throw std::bad_alloc();
+}
+
+void operator delete(void* p) noexcept { std::free(p); }
+
+void operator delete(void* p, size_t) noexcept { std::free(p); }
+
+// Peak resident set size of the process, in kB (0 if unknown)
+size_t peakResidentKb() {
+    std::ifstream status("/proc/self/status");
+    std::string line;
+    while (std::getline(status, line)) {
+        if (line.rfind("VmHWM:", 0) == 0) return std::stoul(line.substr(6));
+    }
+    return 0;
+}
+
+// A visibility query: is the segment between two points blocked?
+struct VisibilityQuery {
+    Ray ray;
+    // The segment ends at ray.at(1)
+    Interval rayT;
+};
+
+// Builds `n` visibility queries between random points inside the scene's bounding box
+std::vector<VisibilityQuery> makeVisibilityQueries(const Hittable& world, int n) {
+    Aabb box = world.boundingBox();
+    std::vector<VisibilityQuery> queries;
+    queries.reserve(n);
+    for (int i = 0; i < n; i++) {
+        Point3 from(randomFloat(box.x.min, box.x.max),
+                    randomFloat(box.y.min, box.y.max),
+                    randomFloat(box.z.min, box.z.max));
+        Point3 to(randomFloat(box.x.min, box.x.max),
+                  randomFloat(box.y.min, box.y.max),
+                  randomFloat(box.z.min, box.z.max));
+        queries.push_back({Ray(from, to - from), Interval(0.001f, 0.999f)});
+    }
+    return queries;
+}
+
+// Compares closest-hit (`hit`) and any-hit (`occluded`) queries on random segments
+void benchVisibility(const std::string& sceneName, const Hittable& world, int n) {
+    std::vector<VisibilityQuery> queries = makeVisibilityQueries(world, n);
+
+    int hits = 0;
+    auto start = Clock::now();
+    for (const VisibilityQuery& q : queries) {
+        HitRecord rec;
+        if (world.hit(q.ray, q.rayT, rec)) hits++;
+    }
+    auto hitTime = Clock::now() - start;
+
+    int occlusions = 0;
+    start = Clock::now();
+    for (const VisibilityQuery& q : queries) {
+        if (world.occluded(q.ray, q.rayT)) occlusions++;
+    }
+    auto occludedTime = Clock::now() - start;
+
+    double hitNs = std::chrono::duration<double, std::nano>(hitTime).count() / n;
+    double occludedNs = std::chrono::duration<double, std::nano>(occludedTime).count() / n;
+
+    std::cout << sceneName << " (" << n << " visibility queries, "
+              << float(hits)/n*100 << "% blocked)\n"
+              << "  hit():      " << hitNs << " ns/query\n"
+              << "  occluded(): " << occludedNs << " ns/query"
+              << " (speed-up x" << hitNs / occludedNs << ")\n";
+    if (hits != occlusions) {
+        std::cout << "  WARNING: hit() and occluded() disagree ("
+                  << hits << " vs " << occlusions << ")\n";
+    }
+}
+
+// Texture lookups at random (incoherent) texture coordinates, like those of
+// secondary rays: nearest pixel, bilinear, and trilinear at random levels of detail
+void benchTextureLookups(const std::string& filePath, int n) {
+    if (!std::filesystem::exists(filePath)) {
+        std::cout << filePath << " not found, skipping texture lookups\n";
+        return;
+    }
+    Image image(filePath);
+    int w = image.width(), h = image.height();
+
+    std::vector<glm::vec2> uvs;
+    std::vector<float> lods;
+    uvs.reserve(n);
+    lods.reserve(n);
+    for (int i = 0; i < n; i++) {
+        uvs.push_back(glm::vec2(randomFloat(), randomFloat()));
+        lods.push_back(randomFloat(0.0f, image.numberOfLevels() - 1));
+    }
+
+    // Sum of the results, so that lookups aren't optimized away
+    float checksum = 0;
+    auto start = Clock::now();
+    for (const glm::vec2& uv : uvs) {
+        checksum += image.pixelData(int(uv.x * w), int(uv.y * h))[0];
+    }
+    auto nearestTime = Clock::now() - start;
+
+    start = Clock::now();
+    for (const glm::vec2& uv : uvs) {
+        checksum += image.bilinear(uv.x, uv.y, 0).r;
+    }
+    auto bilinearTime = Clock::now() - start;
+
+    start = Clock::now();
+    for (int i = 0; i < n; i++) {
+        checksum += image.trilinear(uvs[i].x, uvs[i].y, lods[i]).r;
+    }
+    auto trilinearTime = Clock::now() - start;
+
+    auto mLookupsPerSecond = [n](Clock::duration time) {
+        return n / std::chrono::duration<double, std::micro>(time).count();
+    };
+    // Previous layout: a float copy and a byte copy of the full resolution image
+    double previousMB = double(w) * h * 3 * (sizeof(float) + 1) / (1 << 20);
+    std::cout << filePath << " (" << w << "x" << h << ", " << image.numberOfLevels()
+              << " mip levels, " << n << " lookups)\n"
+              << "  memory:    " << double(image.memoryUsage()) / (1 << 20) << " MB"
+              << " (float + byte copies: " << previousMB << " MB)\n"
+              << "  nearest:   " << mLookupsPerSecond(nearestTime) << " Mlookups/s\n"
+              << "  bilinear:  " << mLookupsPerSecond(bilinearTime) << " Mlookups/s\n"
+              << "  trilinear: " << mLookupsPerSecond(trilinearTime) << " Mlookups/s"
+              << " (checksum " << checksum << ")\n";
+
+    TextureCache& cache = TextureCache::instance();
+    if (cache.enabled()) {
+        TextureCache::Stats stats = cache.stats();
+        std::cout << "  cache (" << (cache.getBudget() >> 20) << " MB budget): "
+                  << stats.hits << " hits, " << stats.misses << " misses, "
+                  << stats.evictions << " evictions, "
+                  << double(stats.residentBytes) / (1 << 20) << " MB resident\n";
+    }
+}
+
+// Parsing of a .obj file by the native loader and by assimp (best of `repetitions` runs)
+void benchModelLoading(const std::string& objFilePath, int repetitions) {
+    auto bestOf = [repetitions](const std::function<bool()>& load) {
+        double best = infinity;
+        for (int i = 0; i < repetitions; i++) {
+            auto start = Clock::now();
+            if (!load()) return -1.0;
+            best = std::min(best, std::chrono::duration<double, std::milli>(Clock::now() - start).count());
+        }
+        return best;
+    };
+
+    size_t triangles = 0;
+    double nativeMs = bestOf([&]() {
+        std::vector<objLoader::ObjMesh> meshes;
+        if (!objLoader::load(objFilePath, meshes)) return false;
+        triangles = 0;
+        for (const objLoader::ObjMesh& mesh : meshes) triangles += mesh.indices.size() / 3;
+        return true;
+    });
+    double assimpMs = bestOf([&]() {
+        Assimp::Importer importer;
+        return importer.ReadFile(objFilePath, aiProcess_Triangulate) != nullptr;
+    });
+
+    std::cout << objFilePath << " (" << triangles << " triangles)\n";
+    auto report = [](const char* name, double ms) {
+        std::cout << "  " << name;
+        if (ms < 0) std::cout << "failed\n";
+        else std::cout << ms << " ms\n";
+    };
+    report("native loader: ", nativeMs);
+    report("assimp:        ", assimpMs);
+}
+
+// Construction of a scene in its arena: heap allocations, time taken,
+// arena usage, and time taken to free everything
+void benchSceneConstruction(const std::string& sceneName,
+                            const std::function<const Hittable*(SceneArena&)>& makeScene) {
+    auto arena = std::make_unique<SceneArena>();
+    // Logging of model loading isn't part of the benchmark
+    std::streambuf* log = std::clog.rdbuf(nullptr);
+    size_t allocations = heapAllocations;
+    auto start = Clock::now();
+    makeScene(*arena);
+    auto buildTime = Clock::now() - start;
+    allocations = heapAllocations - allocations;
+    std::clog.rdbuf(log);
+    SceneArena::Stats stats = arena->stats();
+
+    start = Clock::now();
+    arena.reset();
+    auto teardownTime = Clock::now() - start;
+
+    auto ms = [](Clock::duration time) { return std::chrono::duration<double, std::milli>(time).count(); };
+    std::cout << sceneName << " construction\n"
+              << "  build:    " << ms(buildTime) << " ms, " << allocations << " heap allocations\n"
+              << "  arena:    " << double(stats.bytes) / (1 << 20) << " MB in " << stats.blocks
+              << " blocks, " << stats.objects << " objects\n"
+              << "  teardown: " << ms(teardownTime) << " ms\n"
+              << "  peak RSS so far: " << peakResidentKb() << " kB\n";
+}
+
+void usage() {
+    std::cerr << "Usage: myMicroBench [--runs N] [--warm-up N] [--counters] [--filter TEXT] [GROUP...]\n"
+                 "  GROUP is one of kernels, visibility, construction, loading, textures (default: all)\n"
+                 "  --counters samples hardware counters of the kernels with perf_event_open\n"
+                 "  --filter only runs the kernels whose name (or group title) contains TEXT\n";
+    std::exit(1);
+}
+
+int main(int argc, char* argv[]) {
+    microBench::Options options;
+    std::vector<std::string> groups;
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        bool hasValue = i + 1 < argc;
+        if (arg == "--runs" && hasValue) options.runs = std::max(1, std::atoi(argv[++i]));
+        else if (arg == "--warm-up" && hasValue) options.warmUpRuns = std::max(0, std::atoi(argv[++i]));
+        else if (arg == "--counters") options.counters = true;
+        else if (arg == "--filter" && hasValue) options.filter = argv[++i];
+        else if (arg.rfind("--", 0) == 0) usage();
+        else groups.push_back(arg);
+    }
+    auto selected = [&groups](const char* group) {
+        return groups.empty() || std::find(groups.begin(), groups.end(), group) != groups.end();
+    };
+
+    if (selected("kernels")) microBench::benchKernels(options);
+
+    // Fixed seed, so that datasets are the same on every run
+    srand(42);
+    const int nQueries = 1000000;
+
+    if (selected("visibility")) {
+        SceneArena arena;
+        benchVisibility("oneWeekendSpheres", *ptScenes::oneWeekendSpheres(arena), nQueries);
+        benchVisibility("cornellBox", *ptScenes::cornellBox(arena), nQueries);
+        benchVisibility("mirrorRoom", *ptScenes::mirrorRoom(arena), nQueries);
+    }
+
+    if (selected("construction")) {
+        benchSceneConstruction("oneWeekendSpheres", ptScenes::oneWeekendSpheres);
+        benchSceneConstruction("cornellBox", ptScenes::cornellBox);
+        // Twice: the first run may write the scene cache, the second one reads it
+        for (const char* model : {"globe", "globe", "bunny", "bunny"}) {
+            std::string path = std::string("models/") + model + "/" + model + ".obj";
+            benchSceneConstruction(path, [&path](SceneArena& arena) {
+                return ptScenes::externalModel(path, arena);
+            });
+        }
+    }
+
+    if (selected("loading")) {
+        benchModelLoading("models/globe/globe.obj", 10);
+        benchModelLoading("models/bunny/bunny.obj", 10);
+    }
+
+    if (selected("textures")) {
+        const int nLookups = 4000000;
+        benchTextureLookups("models/globe/Globe.jpg", nLookups);
+        benchTextureLookups("models/forest/color_g.png", nLookups);
+        benchTextureLookups("images/textures/pexels.jpg", nLookups);
+
+        // Same lookups, paged in from a tiled file under a memory budget
+        // (the first run converts the texture)
+        TextureCache::instance().setBudget(size_t(64) << 20);
+        benchTextureLookups("images/textures/pexels.jpg", nLookups);
+    }
+    return 0;
+}
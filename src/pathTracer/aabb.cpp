@@ -61,8 +61,13 @@ int Aabb::longestAxis() const {
     }
 }
 
-const Aabb Aabb::empty = Aabb(Interval::empty, Interval::empty, Interval::empty);
-const Aabb Aabb::universe = Aabb(Interval::universe, Interval::universe, Interval::universe);
+// Not made from `Interval::empty` and `Interval::universe`: they are defined in another
+// file, so they may not be initialized yet (e.g. `empty` would be a small box around the
+// origin, which all BVH node boxes would then include)
+const Aabb Aabb::empty = Aabb(Interval(+infinity, -infinity), Interval(+infinity, -infinity),
+                              Interval(+infinity, -infinity));
+const Aabb Aabb::universe = Aabb(Interval(-infinity, +infinity), Interval(-infinity, +infinity),
+                                 Interval(-infinity, +infinity));
 
 void Aabb::padToMinimums() {
     float delta = 0.0001;
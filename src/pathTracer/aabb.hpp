@@ -21,6 +21,14 @@ class Aabb {
 
         bool hit(const Ray& r, Interval rayT) const;
 
+        // Same as above, with the inverse of the ray direction precomputed by the caller.
+        // Defined in the header so that it can be inlined in traversal loops.
+        bool hit(const Point3& rayOrig, const Vec3& invDir, Interval rayT) const {
+            return slab(x, rayOrig.x, invDir.x, rayT)
+                && slab(y, rayOrig.y, invDir.y, rayT)
+                && slab(z, rayOrig.z, invDir.z, rayT);
+        }
+
         const Interval& axisInterval(int n) const;
 
         // Returns the index of the longest axis of the bounding box
@@ -31,4 +39,15 @@ class Aabb {
         // Adjusts the AABB so that no side is narrower than some delta,
         // padding if necessary
         void padToMinimums();
+
+        // Intersects `rayT` with the ray's parameter interval inside the slab `ax`.
+        // Returns false if the result is empty.
+        static bool slab(const Interval& ax, float orig, float dinv, Interval& rayT) {
+            float t0 = (ax.min - orig) * dinv;
+            float t1 = (ax.max - orig) * dinv;
+            if (t0 > t1) std::swap(t0, t1);
+            if (t0 > rayT.min) rayT.min = t0;
+            if (t1 < rayT.max) rayT.max = t1;
+            return rayT.min < rayT.max;
+        }
 };
\ No newline at end of file
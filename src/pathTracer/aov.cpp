@@ -0,0 +1,157 @@
+#include "aov.hpp"
+#include "imageFiles.hpp"
+
+#include <algorithm>
+#include <mutex>
+#include <sstream>
+
+namespace {
+    std::mutex registryMutex;
+
+    // Registered channels, built-in ones first (in the order of `aov::Builtin`)
+    std::vector<aov::ChannelInfo>& registry() {
+        static std::vector<aov::ChannelInfo> channels = {
+            {"depth", 1, aov::OverHits}, {"normal", 3, aov::OverHits}, {"albedo", 3, aov::OverSamples},
+            {"materialId", 1, aov::LastSample}, {"emission", 3, aov::OverSamples},
+            {"direct", 3, aov::OverSamples}, {"indirect", 3, aov::OverSamples}};
+        return channels;
+    }
+}
+
+int aov::registerChannel(const std::string& name, int components, Averaging averaging) {
+    std::lock_guard<std::mutex> lock(registryMutex);
+    std::vector<ChannelInfo>& channels = registry();
+    for (size_t i = 0; i < channels.size(); i++) {
+        if (channels[i].name == name) return i;
+    }
+    if (components != 1 && components != 3) fatalError("Error: AOV channel " + name + " must have 1 or 3 components");
+    channels.push_back({name, components, averaging});
+    return channels.size() - 1;
+}
+
+int aov::findChannel(const std::string& name) {
+    std::lock_guard<std::mutex> lock(registryMutex);
+    const std::vector<ChannelInfo>& channels = registry();
+    for (size_t i = 0; i < channels.size(); i++) {
+        if (channels[i].name == name) return i;
+    }
+    return -1;
+}
+
+const aov::ChannelInfo& aov::channelInfo(int channel) {
+    std::lock_guard<std::mutex> lock(registryMutex);
+    return registry()[channel];
+}
+
+aov::Layout::Layout(const std::vector<int>& channels) {
+    for (int channel : channels) {
+        if (has(channel)) continue;
+        if (channel >= int(offsets.size())) offsets.resize(channel + 1, -1);
+        offsets[channel] = averagings.size();
+        const ChannelInfo& info = channelInfo(channel);
+        averagings.insert(averagings.end(), info.components, info.averaging);
+        this->channels.push_back(channel);
+    }
+}
+
+aov::Layout aov::Layout::parse(const std::string& names) {
+    std::vector<int> channels;
+    if (names == "none") return Layout(channels);
+    std::istringstream list(names);
+    std::string name;
+    while (std::getline(list, name, ',')) {
+        int channel = findChannel(name);
+        if (channel < 0) fatalError("Error: unknown AOV " + name);
+        channels.push_back(channel);
+    }
+    return Layout(channels);
+}
+
+aov::Layout aov::Layout::with(int channel) const {
+    std::vector<int> withChannel = channels;
+    withChannel.push_back(channel);
+    return Layout(withChannel);
+}
+
+aov::Framebuffer::Framebuffer(int width, int height, const Layout& layout)
+    : width(width), height(height), layout(layout),
+      sums(size_t(width) * height * pixelSize(), 0.0f) {}
+
+void aov::Framebuffer::add(int i, int j, const Sample& sample, const Color& color) {
+    float* pixel = &sums[(size_t(j) * width + i) * pixelSize()];
+    pixel[0] += color.x;
+    pixel[1] += color.y;
+    pixel[2] += color.z;
+    float l = 0.2126f * color.x + 0.7152f * color.y + 0.0722f * color.z;
+    pixel[3] += l * l;
+    // (counts are exact in a float up to 2^24 samples)
+    if (sample.hit) pixel[4] += 1.0f;
+    const std::vector<float>& values = sample.data();
+    for (size_t k = 0; k < values.size(); k++) {
+        switch (layout.averaging(k)) {
+            case OverSamples: pixel[5 + k] += values[k]; break;
+            case OverHits: if (sample.hit) pixel[5 + k] += values[k]; break;
+            case LastSample: pixel[5 + k] = values[k]; break;
+        }
+    }
+}
+
+Color aov::Framebuffer::color(size_t pixel, int samplesPerPixel) const {
+    const float* p = &sums[pixel * pixelSize()];
+    return Color(p[0], p[1], p[2]) / float(samplesPerPixel);
+}
+
+float aov::Framebuffer::luminanceVariance(size_t pixel, int samplesPerPixel) const {
+    const float* p = &sums[pixel * pixelSize()];
+    float mean = (0.2126f * p[0] + 0.7152f * p[1] + 0.0722f * p[2]) / samplesPerPixel;
+    return std::max(0.0f, p[3] / samplesPerPixel - mean * mean) / samplesPerPixel;
+}
+
+Vec3 aov::Framebuffer::mean(int channel, size_t pixel, int samplesPerPixel) const {
+    int offset = layout.offset(channel);
+    const float* p = &sums[pixel * pixelSize() + 5 + offset];
+    float s = scale(pixel, offset, samplesPerPixel);
+    if (channelInfo(channel).components == 1) return Vec3(p[0] * s);
+    return Vec3(p[0], p[1], p[2]) * s;
+}
+
+float aov::Framebuffer::scale(size_t pixel, int offset, int samplesPerPixel) const {
+    switch (layout.averaging(offset)) {
+        case OverSamples: return 1.0f / samplesPerPixel;
+        case OverHits: {
+            float hits = sums[pixel * pixelSize() + 4];
+            return hits > 0 ? 1.0f / hits : 0.0f;
+        }
+        case LastSample: break;
+    }
+    return 1.0f;
+}
+
+void aov::Framebuffer::write(const std::string& filePath, int samplesPerPixel,
+                             const std::vector<int>& channels) const {
+    size_t pixels = size_t(width) * height;
+    // One plane per component: R, G, B, then the channels (e.g. normal.X, depth)
+    std::vector<imageFiles::ExrChannel> planes;
+    const char* rgb[3] = {"R", "G", "B"};
+    for (int c = 0; c < 3; c++) {
+        planes.push_back({rgb[c], std::vector<float>(pixels)});
+        for (size_t p = 0; p < pixels; p++) planes.back().data[p] = color(p, samplesPerPixel)[c];
+    }
+    for (int channel : channels) {
+        const ChannelInfo& info = channelInfo(channel);
+        // Colors have R, G, B components, and vectors X, Y, Z
+        bool isVector = channel == Normal;
+        for (int c = 0; c < info.components; c++) {
+            std::string name = info.components == 1 ? info.name
+                             : info.name + "." + (isVector ? "XYZ"[c] : "RGB"[c]);
+            planes.push_back({name, std::vector<float>(pixels)});
+            int offset = layout.offset(channel) + c;
+            for (size_t p = 0; p < pixels; p++) {
+                planes.back().data[p] = sums[p * pixelSize() + 5 + offset] * scale(p, offset, samplesPerPixel);
+            }
+        }
+    }
+    if (!imageFiles::writeExr(filePath, width, height, planes)) {
+        fatalError("Error: failed writing AOV file " + filePath);
+    }
+}
@@ -0,0 +1,176 @@
+#pragma once
+
+#include "myPT.hpp"
+
+#include <algorithm>
+
+// ARBITRARY OUTPUT VARIABLES (AOVs)
+// Per-pixel channels other than the image itself (depth, normals, albedo, ...),
+// written by `Camera::rayColor` and the materials during the main render pass,
+// averaged over each pixel's samples, and written with the image (as R, G, B)
+// to a single multi-channel OpenEXR file.
+// Channels are identified by the index returned by `registerChannel`: the
+// built-in ones below are registered first, and others must be registered
+// before rendering. Only the channels enabled for a render are stored: the
+// others aren't computed at all (writers check `Sample::wants` first).
+namespace aov {
+    enum Builtin {
+        // Distance from the camera to the first hit (0 if the camera ray missed)
+        Depth,
+        // Shading normal at the first hit
+        Normal,
+        // Reflectance of the material at the first hit
+        Albedo,
+        // Number of the material at the first hit (0 if the camera ray missed)
+        MaterialId,
+        // Light emitted at the first hit, or coming from the background
+        Emission,
+        // Light reaching the camera after a single bounce (light sampling, or
+        // hitting an emitter or the background with the scattered ray)...
+        Direct,
+        // ...and after more than one: the image is emission + direct + indirect
+        Indirect,
+        numberOfBuiltins
+    };
+
+    // How the value of a pixel is made from the values of its samples
+    enum Averaging {
+        // Mean over all the samples
+        OverSamples,
+        // Mean over the samples whose camera ray hit the scene (0 if none did),
+        // for values that only exist at a hit (e.g. depth, or a normal)
+        OverHits,
+        // Value of the pixel's last sample (for identifiers, which can't be averaged)
+        LastSample
+    };
+
+    struct ChannelInfo {
+        std::string name;
+        // Floats per pixel: 1 or 3
+        int components;
+        Averaging averaging;
+    };
+
+    // Registers a channel of `components` (1 or 3) floats, and returns its index
+    // (the existing one if `name` is already registered)
+    int registerChannel(const std::string& name, int components, Averaging averaging = OverSamples);
+
+    // Index of the channel called `name` (-1 if there isn't one)
+    int findChannel(const std::string& name);
+
+    const ChannelInfo& channelInfo(int channel);
+
+    // The channels enabled for a render, and where each one is stored among the
+    // floats of a pixel
+    class Layout {
+        public:
+            Layout() = default;
+            explicit Layout(const std::vector<int>& channels);
+
+            // Layout with the channels named in `names` (comma-separated, e.g.
+            // "depth,normal"; "none" for no channel)
+            static Layout parse(const std::string& names);
+
+            bool has(int channel) const {
+                return channel < int(offsets.size()) && offsets[channel] >= 0;
+            }
+            // Layout with `channel` too
+            Layout with(int channel) const;
+
+            bool empty() const { return channels.empty(); }
+            const std::vector<int>& enabledChannels() const { return channels; }
+            int offset(int channel) const { return offsets[channel]; }
+            // Floats per pixel
+            int size() const { return averagings.size(); }
+            // Averaging of the float at `offset`
+            Averaging averaging(int offset) const { return averagings[offset]; }
+
+        private:
+            std::vector<int> channels;
+            // Offset of each registered channel (-1 if it isn't enabled)
+            std::vector<int> offsets;
+            // For each float of a pixel
+            std::vector<Averaging> averagings;
+    };
+
+    // Values of the enabled channels for one camera sample
+    class Sample {
+        public:
+            explicit Sample(const Layout& layout) : layout(layout), values(layout.size()) {}
+
+            bool wants(int channel) const { return layout.has(channel); }
+
+            // Writers of a channel's value (nothing happens if the channel isn't enabled)
+            void set(int channel, float value) {
+                if (wants(channel)) values[layout.offset(channel)] = value;
+            }
+            void set(int channel, const Vec3& value) {
+                if (!wants(channel)) return;
+                float* v = &values[layout.offset(channel)];
+                v[0] = value.x;
+                v[1] = value.y;
+                v[2] = value.z;
+            }
+
+            float get(int channel) const { return values[layout.offset(channel)]; }
+            Vec3 get3(int channel) const {
+                const float* v = &values[layout.offset(channel)];
+                return Vec3(v[0], v[1], v[2]);
+            }
+
+            // Resets every channel to 0, before a new sample
+            void clear() {
+                std::fill(values.begin(), values.end(), 0.0f);
+                hit = false;
+                nextVertexLight = Vec3(0.0f, 0.0f, 0.0f);
+            }
+
+            const std::vector<float>& data() const { return values; }
+
+            // Whether the camera ray hit the scene
+            bool hit = false;
+            // Light found at the second vertex of the path (emitted there, or coming
+            // from the background), for the direct/indirect split
+            Vec3 nextVertexLight;
+
+        private:
+            const Layout& layout;
+            std::vector<float> values;
+    };
+
+    // Sums of the samples' colors and channels over each pixel
+    class Framebuffer {
+        public:
+            Framebuffer(int width, int height, const Layout& layout);
+
+            // Adds `sample` and its color to pixel (i,j) (each pixel is only
+            // written by the thread rendering it)
+            void add(int i, int j, const Sample& sample, const Color& color);
+
+            // Means of pixel `pixel` (index in the image, row by row) over
+            // `samplesPerPixel` samples: color, variance of the color's
+            // luminance (of the mean), and channel (averaged as registered;
+            // 1-component channels are returned in the 3 components)
+            Color color(size_t pixel, int samplesPerPixel) const;
+            float luminanceVariance(size_t pixel, int samplesPerPixel) const;
+            Vec3 mean(int channel, size_t pixel, int samplesPerPixel) const;
+
+            // Writes the color and `channels` (enabled in the layout) to an
+            // OpenEXR file
+            void write(const std::string& filePath, int samplesPerPixel,
+                       const std::vector<int>& channels) const;
+
+        private:
+            int width;
+            int height;
+            const Layout& layout;
+            // Color, squared luminance, number of samples that hit the scene, then
+            // the enabled channels, of each pixel (row by row)
+            std::vector<float> sums;
+
+            size_t pixelSize() const { return 5 + layout.size(); }
+            // Factor turning the sum of the float at `offset` in the channels of
+            // pixel `pixel` into its value
+            float scale(size_t pixel, int offset, int samplesPerPixel) const;
+    };
+}
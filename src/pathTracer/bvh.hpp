@@ -25,7 +25,7 @@ class BvhNode : public Hittable {
             bbox = Aabb(bbox, objects[objectIndex]->boundingBox());
         }
 
-        int axis = bbox.longestAxis();
+        axis = bbox.longestAxis();
 
         auto comparator = (axis == 0) ? boxXCompare
                         : (axis == 1) ? boxYCompare
@@ -56,12 +56,36 @@ class BvhNode : public Hittable {
         return hitLeft || hitRight;
     }
 
+    bool occluded(const Ray& r, Interval rayT) const override {
+        if (!bbox.hit(r, rayT)) return false;
+
+        // Visit first the child that comes first along the ray direction
+        // (children are sorted by their lower bound on the split axis)
+        bool leftFirst = r.direction()[axis] >= 0;
+        const Hittable& first = leftFirst ? *left : *right;
+        const Hittable& second = leftFirst ? *right : *left;
+
+        if (first.occluded(r, rayT)) return true;
+        return left != right && second.occluded(r, rayT);
+    }
+
     Aabb boundingBox() const override { return bbox; }
 
+    // Children: `BvhNode`s, or primitives (the same one on both sides for a single primitive)
+    const Hittable* leftChild() const { return left.get(); }
+    const Hittable* rightChild() const { return right.get(); }
+
+    void collectEmitters(std::vector<const Hittable*>& emitters) const override {
+        left->collectEmitters(emitters);
+        if (right != left) right->collectEmitters(emitters);
+    }
+
   private:
     std::shared_ptr<Hittable> left;
     std::shared_ptr<Hittable> right;
     Aabb bbox;
+    // Axis along which the objects were sorted
+    int axis;
 
     static bool boxCompare(const std::shared_ptr<Hittable> a,
                            const std::shared_ptr<Hittable> b, int axisIndex) {
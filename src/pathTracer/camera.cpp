@@ -1,8 +1,14 @@
 #include "camera.hpp"
+#include "imageFiles.hpp"
 
 using std::unique_lock;
 using std::mutex;
 
+namespace {
+    // Rays traced by the current thread since it last reported them
+    thread_local uint64_t threadRays = 0;
+}
+
 Camera::Camera (float aspectRatio, int imageWidth, float vfov, 
                 const Point3 &lookFrom, const Point3 &lookAt, const Vec3 &up)
                 : aspectRatio(aspectRatio), imageWidth(imageWidth), vfov(vfov),
@@ -11,6 +17,11 @@ Camera::Camera (float aspectRatio, int imageWidth, float vfov,
     imageHeight = int(imageWidth / aspectRatio);
     imageHeight = (imageHeight < 1) ? 1 : imageHeight;
     numSubImages = ptInput::readNumSubImages(INPUT_FILE);
+    numThreads = ptInput::readNumThreads(INPUT_FILE);
+    denoise = ptInput::readDenoise(INPUT_FILE);
+    aovs = aov::Layout::parse(ptInput::readAovs(INPUT_FILE));
+    guidingPasses = ptInput::readGuidingPasses(INPUT_FILE);
+    radianceCacheBounces = ptInput::readRadianceCacheBounces(INPUT_FILE);
     // Set default values for other camera parameters
     setSamplesPerPixel(10);
     setDefocusAngle(0.0f);
@@ -20,6 +31,11 @@ Camera::Camera (float aspectRatio, int imageWidth, float vfov,
     setImageName("helloPT");
 }
 
+void Camera::setImageWidth(int width) {
+    imageWidth = width;
+    imageHeight = std::max(int(imageWidth / aspectRatio), 1);
+}
+
 void Camera::initialize() {
     // Determine viewport dimensions
     float theta = glm::radians(vfov); // from degrees to radians
@@ -39,6 +55,8 @@ void Camera::initialize() {
     // Calculate the horizontal and vertical delta vectors from pixel to pixel
     pixelDeltaU = viewportU / float(imageWidth);
     pixelDeltaV = viewportV / float(imageHeight);
+    // Angle subtended by a pixel, for ray footprints
+    pixelSpreadAngle = 2 * h / imageHeight;
 
     // Calculate the location of the upper left pixel
     Point3 viewportUpperLeft = cameraCenter - (focusDist * w) - viewportU/2.0f - viewportV/2.0f;
@@ -52,6 +70,20 @@ void Camera::initialize() {
 
 void Camera::render(const Hittable& world) {
     initialize();
+    // Collect emitters for light sampling
+    std::vector<const Hittable*> emitters;
+    {
+        trace::Scope scope("light BVH build", "bvh");
+        world.collectEmitters(emitters);
+        lights = std::make_shared<LightBvh>(emitters);
+    }
+    std::clog << "Number of emitters in scene: " << lights->numberOfEmitters() << "\n";
+    if (!environment) {
+        environmentProbability = 0.0f;
+    } else {
+        environmentProbability = lights->empty() ? 1.0f : 0.5f;
+    }
+
     // Each thread renders a randomly chosen sub-image
     // that hasn't been rendered yet
     std::vector<std::thread> threads;
@@ -60,11 +92,39 @@ void Camera::render(const Hittable& world) {
     // sub-images that have already been rendered by a thread
     SubImageList rendered;    
     setUpSubImages(notRendered);
+    // Per-pixel traversal costs (only with COST_HEATMAP)
+    costHeatmap::Heatmap heatmap(imageWidth, imageHeight);
+    // Linear colors of the pixels (only if they're written)
+    std::vector<Color> linearPixels(linearImage ? size_t(imageWidth) * imageHeight : 0);
+    // Output variables, and the features of the denoiser (only if either
+    // is written)
+    renderedAovs = aovs;
+    if (denoise) {
+        renderedAovs = renderedAovs.with(aov::Albedo).with(aov::Normal).with(aov::Depth);
+    }
+    std::unique_ptr<aov::Framebuffer> framebuffer;
+    if (!renderedAovs.empty()) {
+        framebuffer = std::make_unique<aov::Framebuffer>(imageWidth, imageHeight, renderedAovs);
+    }
+
+    if (radianceCacheBounces > 0) {
+        cache = std::make_shared<radianceCache::HashGrid>(cameraCenter, pixelSpreadAngle);
+    } else {
+        cache.reset();
+    }
+
+    uint64_t trainingRays = 0;
+    if (guidingPasses > 0) {
+        trainingRays = trainGuide(world);
+    } else {
+        guide.reset();
+    }
 
     std::clog << "Rendering sub-images in " << subImagesDir << "\n";
+    renderStats::begin();
 
     // Set up threads
-    int nThreads = ptInput::readNumThreads(INPUT_FILE);
+    int nThreads = numThreads;
     bool first = true;
     for (int i = 0; i < nThreads; i++) {
         threads.push_back(
@@ -73,6 +133,9 @@ void Camera::render(const Hittable& world) {
                         std::ref(world),
                         std::ref(notRendered),
                         std::ref(rendered),
+                        std::ref(heatmap),
+                        linearImage ? linearPixels.data() : nullptr,
+                        framebuffer.get(),
                         first));
         first = false;
     }
@@ -80,15 +143,39 @@ void Camera::render(const Hittable& world) {
     for (int i = 0; i < nThreads; i++){
         threads[i].join();
     }
+    renderedRays = rendered.rays + trainingRays;
+    if (cache) {
+        std::clog << "Radiance cache: " << cache->numberOfCells() << " cells ("
+                  << cache->memoryUsage() / (1 << 20) << " MB)\n";
+    }
+    renderStats::report(std::string(OUTPUT_DIR) + "/" + imageName + "_stats.json");
+    heatmap.write(std::string(OUTPUT_DIR) + "/" + imageName);
     putTogetherImage(rendered);
+    if (linearImage) {
+        std::string linearImagePath = std::string(OUTPUT_DIR) + "/" + imageName + ".pfm";
+        if (!imageFiles::writePfm(linearImagePath, imageWidth, imageHeight, &linearPixels[0].x)) {
+            fatalError("Error: failed writing " + linearImagePath);
+        }
+    }
+    if (!aovs.empty()) {
+        std::string aovPath = std::string(OUTPUT_DIR) + "/" + imageName + "_aovs.exr";
+        std::clog << "Writing output variables to " << aovPath << "\n";
+        framebuffer->write(aovPath, samplesPerPixel, aovs.enabledChannels());
+    }
+    if (denoise) writeDenoisedImage(*framebuffer);
     std::cout << "Done!\n\n";
 }
 
 void Camera::renderTask(const Hittable& world, SubImageList& notRendered,
-                        SubImageList& rendered, bool first) const {
+                        SubImageList& rendered, costHeatmap::Heatmap& heatmap,
+                        Color* linearPixels, aov::Framebuffer* framebuffer, bool first) const {
     
     std::ofstream outFile; // output .ppm file
     SubImage subImage; // sub-image that's being currently rendered
+    // output variables of the current sample (none if there's no framebuffer)
+    std::unique_ptr<aov::Sample> aovSample;
+    if (framebuffer) aovSample = std::make_unique<aov::Sample>(renderedAovs);
+    trace::setThreadName("render thread");
 
     if (first) {std::clog << "0 sub-images out of " << numSubImages << " have been rendered\n";}
 
@@ -98,6 +185,7 @@ void Camera::renderTask(const Hittable& world, SubImageList& notRendered,
         subImage = notRendered.data.back();
         notRendered.data.pop_back();            
         lock1.unlock();
+        trace::Scope scope("sub-image", "render", subImage.path.c_str());
 
         outFile.open(subImage.path);
         if (outFile.fail()) fatalError("Error: failed opening output file " + subImage.path);
@@ -115,24 +203,38 @@ void Camera::renderTask(const Hittable& world, SubImageList& notRendered,
             }
             for (int i = 0; i < imageWidth; i++) {
                 Color pixelColor(0.0f,0.0f,0.0f);
+                heatmap.beginPixel();
                 for (int sample = 0; sample < samplesPerPixel; sample++) {
                     Ray r = getRay(i, j);
-                    pixelColor += rayColor(r, maxDepth, world); 
+                    if (!aovSample) {
+                        pixelColor += rayColor(r, maxDepth, world, cameraRayCone()); 
+                    } else {
+                        aovSample->clear();
+                        Color sampleColor = rayColor(r, maxDepth, world, cameraRayCone(), 0.0f, aovSample.get());
+                        framebuffer->add(i, j, *aovSample, sampleColor);
+                        pixelColor += sampleColor;
+                    }
                 }
+                heatmap.endPixel(i, j);
+                if (linearPixels) linearPixels[size_t(j) * imageWidth + i] = pixelColor * (1.0f/samplesPerPixel);
                 writeColor(outFile, pixelColor * (1.0f/samplesPerPixel));
             }
+            renderStats::countSamples(uint64_t(imageWidth) * samplesPerPixel);
         }
         outFile.close();
         if (first) {std::clog << "\rThread #1 has rendered sub-image " << subImage.path << "\n";}
 
         unique_lock<mutex> lock2{rendered.mtx};
         rendered.data.push_back(subImage);
+        rendered.rays += threadRays;
+        threadRays = 0;
         if (first) { 
             std::clog << rendered.data.size() << " sub-images out of "
                       << numSubImages <<  " have been rendered\n";
         }
         lock2.unlock();
     }
+    renderStats::finishThread();
 }
 
 Ray Camera::getRay(int i, int j) const{
@@ -145,25 +247,218 @@ Ray Camera::getRay(int i, int j) const{
     return Ray(rayOrigin, rayDirection);  
 }
 
-Color Camera::rayColor(const Ray& r, int depth, const Hittable& world) const {
+Color Camera::rayColor(const Ray& r, int depth, const Hittable& world, const RayCone& cone,
+                       float scatterPdf, aov::Sample* aovSample, int diffuseVertices) const {
     if (depth <= 0){
         // ray bounce limit exceeded
+        renderStats::countPath(renderStats::DepthLimit, maxDepth);
         return Color(0.0f, 0.0f, 0.0f);
     }
     HitRecord rec;
+    threadRays++;
+    renderStats::countRay(depth == maxDepth ? renderStats::Primary : renderStats::Secondary);
     // If the ray hits nothing, return the background color
+    // (or the light coming from the environment)
     if (!world.hit(r, Interval(0.001, infinity), rec)){
-        return background;
+        renderStats::countPath(renderStats::Miss, maxDepth - depth + 1);
+        Color colorFromEnvironment = background;
+        if (environment) {
+            colorFromEnvironment = environment->radiance(r.direction());
+            if (scatterPdf > 0) {
+                float lightPdf = environmentProbability * environment->pdf(r.direction());
+                colorFromEnvironment *= powerHeuristic(scatterPdf, lightPdf);
+            }
+        }
+        if (aovSample) recordLight(*aovSample, depth, colorFromEnvironment);
+        return colorFromEnvironment;
+    }
+    // Surface attributes are only computed for the closest hit
+    rec.footprint = cone.widthAt(rec.t * glm::length(r.direction()));
+    rec.object->computeSurfaceInteraction(r, rec);
+    bool firstHit = aovSample && depth == maxDepth;
+    if (firstHit) {
+        aovSample->hit = true;
+        aovSample->set(aov::Depth, rec.t * glm::length(r.direction()));
+        aovSample->set(aov::Normal, rec.normal);
+        rec.material->writeAovs(rec, *aovSample);
     }
 
     Ray scattered;
     Color attenuation;
     Color colorFromEmission = rec.material->emitted(rec.u, rec.v, rec.p);
+    if (scatterPdf > 0 && rec.material->isEmissive()) {
+        // The previous vertex could also have sampled this point on the emitter
+        float lightPdf = (1.0f - environmentProbability) * lights->pdf(r.origin(), rec.object, rec.p);
+        colorFromEmission *= powerHeuristic(scatterPdf, lightPdf);
+    }
+    if (aovSample) recordLight(*aovSample, depth, colorFromEmission);
+    // With the radiance cache, paths end at a diffuse surface after enough
+    // diffuse bounces, or once they've spread over more than a cell anyway,
+    // taking the light recorded there. Never at the first diffuse vertex, where
+    // cells would show in the image (directly, or through mirrors and glass).
+    if (cache && rec.material->sampleLights() && diffuseVertices > 0
+        && (diffuseVertices >= radianceCacheBounces || rec.footprint >= cache->cellSize(rec.p))) {
+        Color cached;
+        if (cache->lookup(rec.p, rec.normal, cached)) {
+            renderStats::countPath(renderStats::Cached, maxDepth - depth + 1);
+            return colorFromEmission + cached;
+        }
+    }
     if (!rec.material->scatter(r, rec, attenuation, scattered)){
+        renderStats::countPath(renderStats::Absorbed, maxDepth - depth + 1);
         return colorFromEmission;
     }
-    Color colorFromScatter = attenuation * rayColor(scattered, depth-1, world);
-    return colorFromEmission + colorFromScatter;
+
+    // Light sampling. Not done at the last vertex, since the scattered ray
+    // can't reach an emitter from there either (it's beyond the bounce limit).
+    bool sampleLights = rec.material->sampleLights() && depth > 1
+                        && (!lights->empty() || environment);
+    // Path guiding, at the same vertices: the region's distribution is mixed
+    // with the material's, once something has been learned there
+    guiding::Region* region = nullptr;
+    const guiding::DirectionTree* guideTree = nullptr;
+    if (guide && rec.material->sampleLights() && depth > 1) {
+        region = &guide->region(rec.p);
+        if (region->samplingTree().total() > 0) guideTree = &region->samplingTree();
+    }
+    // Scattered direction, and the density it was sampled with (only needed
+    // for light sampling and path guiding)
+    Vec3 wi;
+    float pdf = 0.0f;
+    if (guideTree) {
+        if (randomFloat() >= guiding::bsdfSamplingFraction) scattered = Ray(rec.p, guideTree->sample());
+        wi = glm::normalize(scattered.direction());
+        pdf = guidedScatterPdf(rec, guideTree, wi);
+        attenuation = pdf > 0 ? rec.material->evalScatter(rec, wi) / pdf : Color(0.0f, 0.0f, 0.0f);
+    } else if (sampleLights || region) {
+        wi = glm::normalize(scattered.direction());
+        pdf = rec.material->scatterPdf(rec, wi);
+    }
+
+    Color colorFromLights(0.0f, 0.0f, 0.0f);
+    float nextScatterPdf = 0.0f;
+    if (sampleLights) {
+        colorFromLights = sampleDirectLight(r, rec, world, guideTree);
+        nextScatterPdf = pdf;
+    }
+
+    // Light arriving along the scattered ray (not traced if nothing would be
+    // reflected, e.g. if guiding picked a direction below the surface)
+    Color incoming(0.0f, 0.0f, 0.0f);
+    if (attenuation != Color(0.0f, 0.0f, 0.0f)) {
+        // The cone keeps its spread through perfect mirrors and glass, and
+        // doubles it at rough surfaces
+        RayCone nextCone{rec.footprint, rec.material->isSpecular() ? cone.spread : 2 * cone.spread};
+        incoming = rayColor(scattered, depth-1, world, nextCone, nextScatterPdf,
+                            firstHit ? aovSample : nullptr,
+                            diffuseVertices + !rec.material->isSpecular());
+    } else {
+        renderStats::countPath(renderStats::Absorbed, maxDepth - depth + 1);
+    }
+    // Training records that light times the cosine term, so that what's learned
+    // is closer to the light reflected. Light sampling isn't recorded: emission
+    // found here is weighted against it (MIS), so what's learned is mostly the
+    // light that light sampling misses.
+    if (trainingGuide && region && pdf > 0) {
+        region->record(wi, luminance(incoming) * glm::dot(wi, rec.normal) / pdf);
+    }
+    Color colorFromScatter = attenuation * incoming;
+    if (cache && rec.material->sampleLights() && depth > 1) {
+        cache->record(rec.p, rec.normal, colorFromLights + colorFromScatter);
+    }
+    if (firstHit) {
+        // Light found by the scattered ray at the next vertex is direct light too
+        Color directFromScatter = attenuation * aovSample->nextVertexLight;
+        aovSample->set(aov::Direct, colorFromLights + directFromScatter);
+        aovSample->set(aov::Indirect, colorFromScatter - directFromScatter);
+    }
+    return colorFromEmission + colorFromLights + colorFromScatter;
+}
+
+void Camera::recordLight(aov::Sample& aovSample, int depth, const Color& light) const {
+    if (depth == maxDepth) {
+        aovSample.set(aov::Emission, light);
+    } else if (depth == maxDepth - 1) {
+        aovSample.nextVertexLight = light;
+    }
+}
+
+Color Camera::sampleDirectLight(const Ray& r, const HitRecord& rec, const Hittable& world,
+                                const guiding::DirectionTree* guideTree) const {
+    Vec3 wi;
+    Color emitted;
+    float lightPdf;
+    // Maximum distance of the shadow ray
+    float maxDist;
+    if (randomFloat() < environmentProbability) {
+        emitted = environment->sample(wi, lightPdf);
+        lightPdf *= environmentProbability;
+        maxDist = infinity;
+    } else {
+        LightSample ls;
+        if (!lights->sample(rec.p, ls)) return Color(0.0f, 0.0f, 0.0f);
+        Vec3 toLight = ls.p - rec.p;
+        float dist = glm::length(toLight);
+        wi = toLight / dist;
+        emitted = ls.emitted;
+        lightPdf = (1.0f - environmentProbability) * ls.pdf;
+        // Stop short of the emitter, so that it doesn't occlude itself
+        maxDist = dist * (1.0f - 1e-4f);
+    }
+    if (lightPdf <= 0) return Color(0.0f, 0.0f, 0.0f);
+
+    Color f = rec.material->evalScatter(rec, wi);
+    if (f == Color(0.0f, 0.0f, 0.0f)) return f;
+
+    // Shadow ray
+    threadRays++;
+    renderStats::countRay(renderStats::Shadow);
+    if (world.occluded(Ray(rec.p, wi), Interval(0.001f, maxDist))) {
+        return Color(0.0f, 0.0f, 0.0f);
+    }
+    float weight = powerHeuristic(lightPdf, guidedScatterPdf(rec, guideTree, wi));
+    return f * emitted * (weight / lightPdf);
+}
+
+float Camera::guidedScatterPdf(const HitRecord& rec, const guiding::DirectionTree* guideTree,
+                               const Vec3& wi) const {
+    float materialPdf = rec.material->scatterPdf(rec, wi);
+    if (!guideTree) return materialPdf;
+    return guiding::bsdfSamplingFraction * materialPdf
+         + (1.0f - guiding::bsdfSamplingFraction) * guideTree->pdf(wi);
+}
+
+uint64_t Camera::trainGuide(const Hittable& world) {
+    trace::Scope scope("path guiding training", "render");
+    guide = std::make_shared<guiding::SdTree>(world.boundingBox());
+    trainingGuide = true;
+    std::atomic<uint64_t> rays{0};
+    for (int pass = 0; pass < guidingPasses; pass++) {
+        int samples = 1 << std::min(pass, 16);
+        std::clog << "Path guiding training pass " << pass + 1 << " of " << guidingPasses
+                  << " (" << samples << " samples per pixel)\n";
+        // Threads take the next row that nobody has rendered yet
+        std::atomic<int> nextRow{0};
+        std::vector<std::thread> threads;
+        for (int t = 0; t < numThreads; t++) {
+            threads.emplace_back([&]() {
+                trace::setThreadName("training thread");
+                for (int j = nextRow++; j < imageHeight; j = nextRow++) {
+                    for (int i = 0; i < imageWidth; i++) {
+                        for (int sample = 0; sample < samples; sample++) rayColor(getRay(i, j), maxDepth, world, cameraRayCone());
+                    }
+                }
+                rays += threadRays;
+                threadRays = 0;
+            });
+        }
+        for (std::thread& thread : threads) thread.join();
+        guide->update(pass);
+    }
+    trainingGuide = false;
+    std::clog << "Path guiding learned " << guide->numberOfRegions() << " regions ("
+              << guide->memoryUsage() / (1 << 20) << " MB)\n";
+    return rays;
 }
 
 Vec3 Camera::sampleUnitSquare() const {
@@ -199,13 +494,14 @@ void Camera::setUpSubImages(SubImageList& notRendered){
             lastRow += rowsLeft;
         }
     }
-    // Shuffle the vector of sub-images
-    std::random_device rd;
-    std::mt19937 generator{rd()};
+    // Shuffle the vector of sub-images (seeded from `rand`, so that a render
+    // with a fixed seed and a single thread is reproducible)
+    std::mt19937 generator{unsigned(rand())};
     std::shuffle(notRendered.data.begin(), notRendered.data.end(), generator);
 }
 
 void Camera::putTogetherImage(SubImageList& rendered) {
+    trace::Scope scope("image write", "output");
     std::ofstream finalImageFile; 
     std::string finalImagePath = std::string(OUTPUT_DIR) + "/" + imageName + ".ppm"; 
     finalImageFile.open(finalImagePath);
@@ -240,4 +536,26 @@ void Camera::putTogetherImage(SubImageList& rendered) {
     
     // Remove sub-images directory (now empty)
     std::filesystem::remove(subImagesDir);
+}
+
+void Camera::writeDenoisedImage(const aov::Framebuffer& framebuffer) const {
+    denoiser::Buffers buffers(imageWidth, imageHeight);
+    for (size_t p = 0; p < buffers.color.size(); p++) {
+        buffers.color[p] = framebuffer.color(p, samplesPerPixel);
+        buffers.variance[p] = framebuffer.luminanceVariance(p, samplesPerPixel);
+        // Averaged normals are shorter than 1 where they vary over the pixel
+        Vec3 normal = framebuffer.mean(aov::Normal, p, samplesPerPixel);
+        float length = glm::length(normal);
+        if (length > 0) normal /= length;
+        buffers.features[p] = {framebuffer.mean(aov::Albedo, p, samplesPerPixel), normal,
+                               framebuffer.mean(aov::Depth, p, samplesPerPixel).x};
+    }
+    std::vector<Color> denoised = denoiser::denoise(buffers, numThreads);
+    trace::Scope scope("image write", "output");
+    std::string denoisedImagePath = std::string(OUTPUT_DIR) + "/" + imageName + "_denoised.ppm";
+    std::ofstream denoisedImageFile(denoisedImagePath);
+    if (denoisedImageFile.fail()) fatalError("Error: failed opening output file " + denoisedImagePath);
+    std::clog << "Writing denoised image to " << denoisedImagePath << "\n";
+    denoisedImageFile << "P3\n" << imageWidth << ' ' << imageHeight << "\n255\n";
+    for (const Color& pixelColor : denoised) writeColor(denoisedImageFile, pixelColor);
 }
\ No newline at end of file
@@ -5,6 +5,15 @@
 #include "ray.hpp"
 #include "material.hpp"
 #include "utilities.hpp"
+#include "lightBvh.hpp"
+#include "environment.hpp"
+#include "renderStats.hpp"
+#include "trace.hpp"
+#include "costHeatmap.hpp"
+#include "denoiser.hpp"
+#include "aov.hpp"
+#include "guiding.hpp"
+#include "radianceCache.hpp"
 
 #include <filesystem>
 #include <mutex>
@@ -27,11 +36,36 @@ class Camera {
             imageName = name;
             subImagesDir = std::string(OUTPUT_DIR) + "/" + imageName;
         }
+        // Keeps the aspect ratio
+        void setImageWidth(int width);
         void setSamplesPerPixel(int n){samplesPerPixel = n;}
         void setDefocusAngle(float angle){defocusAngle = angle;}
         void setFocusDist(float d){focusDist = d;}
         void setMaxDepth(int n){maxDepth = n;}
         void setBackground(Color color){background = color;}
+        // Lights the scene with an environment map, replacing the background color
+        void setEnvironment(std::shared_ptr<EnvironmentLight> env){environment = env;}
+        // Number of rendering threads (by default, the one in the input file)
+        void setNumThreads(int n){numThreads = n;}
+        // Whether the image is also written in linear colors, as floats (a .pfm
+        // file next to the image, without the gamma and clamping of the 8-bit
+        // one; off by default)
+        void setLinearImage(bool l){linearImage = l;}
+        // Whether a denoised image is also written (by default, as in the input file)
+        void setDenoise(bool d){denoise = d;}
+        // Output variables written next to the image (comma-separated names, or
+        // "none"; by default, as in the input file)
+        void setAovs(const std::string& names){aovs = aov::Layout::parse(names);}
+        // Number of path guiding training passes before the render (0 disables
+        // path guiding; by default, as in the input file)
+        void setGuidingPasses(int n){guidingPasses = n;}
+        // Number of bounces after which paths end in the radiance cache (0
+        // disables the cache, for unbiased rendering; by default, as in the
+        // input file)
+        void setRadianceCacheBounces(int n){radianceCacheBounces = n;}
+
+        // Rays traced by the last render (camera, scattered and shadow rays)
+        uint64_t raysTraced() const {return renderedRays;}
     
     private:    
         // Width over height
@@ -75,9 +109,60 @@ class Camera {
         Vec3 pixelDeltaU;  
         // Offset to pixel below
         Vec3 pixelDeltaV;  
+        // Angle between the rays through two neighbouring pixels
+        float pixelSpreadAngle;
         
-        Color rayColor(const Ray& r, int depth, const Hittable& world) const;
+        // Environment light (null if the background color is used instead)
+        std::shared_ptr<EnvironmentLight> environment;
+
+        // Emitters of the scene being rendered, for light sampling
+        std::shared_ptr<LightBvh> lights;
+        // Probability of sampling the environment rather than an emitter
+        // when sampling lights
+        float environmentProbability;
+
+        // Cone around the rays of a path, whose width at a hit is the ray's
+        // footprint there (for texture filtering)
+        struct RayCone {
+            // Width at the origin of the ray
+            float width;
+            // Angle by which the width grows per unit of distance
+            float spread;
+
+            float widthAt(float distance) const {return width + spread * distance;}
+        };
+
+        // `cone` is the cone of the path at `r`, starting from a point for camera
+        // rays, with the pixel spread angle.
+        // `scatterPdf` is the density with which the previous path vertex sampled the
+        // direction of `r`, if that vertex also sampled lights directly (0 otherwise).
+        // It's used to weight emission found by `r` against light sampling (MIS).
+        // If `aovSample` isn't null, the output variables of the path are written
+        // to it (it's only passed along to the second vertex).
+        // `diffuseVertices` is the number of vertices before the hit of `r` that
+        // weren't perfect mirrors or glass (for the radiance cache).
+        Color rayColor(const Ray& r, int depth, const Hittable& world, const RayCone& cone,
+                       float scatterPdf = 0.0f, aov::Sample* aovSample = nullptr,
+                       int diffuseVertices = 0) const;
+        // Records `light` found at the vertex of a path at `depth`: as emission
+        // at the first vertex, or for the direct/indirect split at the second
+        void recordLight(aov::Sample& aovSample, int depth, const Color& light) const;
+
+        // Light arriving at `rec` directly from a sampled point on an emitter
+        // (or direction of the environment), weighted against scattering
+        // with the power heuristic (MIS).
+        // With path guiding, `guideTree` is the distribution mixed with the material's
+        // to scatter rays (if it isn't null).
+        Color sampleDirectLight(const Ray& r, const HitRecord& rec, const Hittable& world,
+                                const guiding::DirectionTree* guideTree) const;
+        // Density (solid angle) with which direction `wi` is scattered at `rec`:
+        // by the material, or by its mix with `guideTree` (if it isn't null)
+        float guidedScatterPdf(const HitRecord& rec, const guiding::DirectionTree* guideTree,
+                               const Vec3& wi) const;
         void initialize();
+
+        // Cone of camera rays, which spread over one pixel
+        RayCone cameraRayCone() const {return RayCone{0.0f, pixelSpreadAngle};}
         
         // Constructs a ray originating from the camera and directed at a randomly
         // sampled point around the pixel location (i,j)
@@ -94,13 +179,40 @@ class Camera {
         };
         // number of sub-images
         int numSubImages;
+        // number of rendering threads
+        int numThreads;
+        // whether the image is also written in linear colors
+        bool linearImage = false;
+        // whether a denoised image is also written
+        bool denoise;
+        // output variables written next to the image
+        aov::Layout aovs;
+        // output variables computed by the last render: `aovs`, and the
+        // features used by the denoiser
+        aov::Layout renderedAovs;
+        // rays traced by the last render
+        uint64_t renderedRays = 0;
+        // number of path guiding training passes (0 if path guiding is off)
+        int guidingPasses;
+        // light learned by the training passes (null without path guiding)
+        std::shared_ptr<guiding::SdTree> guide;
+        // whether paths record the light they find into `guide`
+        bool trainingGuide = false;
+        // number of diffuse bounces after which paths end in the radiance cache
+        // (0 if the cache is off)
+        int radianceCacheBounces;
+        // light reflected at the diffuse vertices of the paths traced so far
+        // (null without the cache)
+        std::shared_ptr<radianceCache::HashGrid> cache;
         // directory where sub-images are kept
         std::string subImagesDir; 
 
         struct SubImageList {
             // elements of list
             std::vector<SubImage> data;
-            // this mutex controls the access to `data`
+            // rays traced to render the sub-images in `data`
+            uint64_t rays = 0;
+            // this mutex controls the access to `data` and `rays`
             std::mutex mtx; 
         };
 
@@ -109,11 +221,22 @@ class Camera {
         // Ends when there are no longer sub-images that need rendering.
         // If `first` is set to true (first thread), the thread also logs
         // information about the program's progress
+        // The cost of each pixel is recorded in `heatmap`, its linear color in
+        // `linearPixels`, and its output variables in `framebuffer` (each if it
+        // isn't null).
         void renderTask(const Hittable& world, SubImageList& notRendered,
-                        SubImageList& rendered, bool first) const;
+                        SubImageList& rendered, costHeatmap::Heatmap& heatmap,
+                        Color* linearPixels, aov::Framebuffer* framebuffer, bool first) const;
+        
+        // Learns `guide` over the training passes, each one rendering the image
+        // with twice as many samples per pixel as the previous one (the images
+        // are discarded). Returns the number of rays traced.
+        uint64_t trainGuide(const Hittable& world);
         
         // Set up information for sub-images that need to be rendered
         void setUpSubImages(SubImageList& notRendered);
         // Put together final image
         void putTogetherImage(SubImageList& rendered);
+        // Denoise the image, and write it next to the final image
+        void writeDenoisedImage(const aov::Framebuffer& framebuffer) const;
 };
\ No newline at end of file
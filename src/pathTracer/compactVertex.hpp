@@ -0,0 +1,91 @@
+#pragma once
+
+#include "myPT.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+
+// Compact encodings of vertex attributes, used by triangles when
+// COMPACT_VERTICES is defined (see myPT.hpp)
+namespace compactVertex {
+    // Unit vector in octahedral encoding: the vector is projected onto the
+    // octahedron |x| + |y| + |z| = 1, whose lower half is folded over the upper
+    // one, and the resulting square is stored as two 16-bit signed normalized values
+    struct OctNormal {
+        int16_t x;
+        int16_t y;
+    };
+
+    inline float signNotZero(float x) { return (x >= 0.0f) ? 1.0f : -1.0f; }
+
+    inline int16_t toSnorm16(float x) {
+        return int16_t(std::lround(std::clamp(x, -1.0f, 1.0f) * 32767.0f));
+    }
+
+    inline OctNormal encodeNormal(const Vec3& n) {
+        float l1 = std::fabs(n.x) + std::fabs(n.y) + std::fabs(n.z);
+        if (l1 == 0.0f) return {0, 0};
+        float x = n.x / l1;
+        float y = n.y / l1;
+        if (n.z < 0.0f) {
+            float foldedX = (1.0f - std::fabs(y)) * signNotZero(x);
+            y = (1.0f - std::fabs(x)) * signNotZero(y);
+            x = foldedX;
+        }
+        return {toSnorm16(x), toSnorm16(y)};
+    }
+
+    inline Vec3 decodeNormal(OctNormal e) {
+        float x = e.x / 32767.0f;
+        float y = e.y / 32767.0f;
+        float z = 1.0f - std::fabs(x) - std::fabs(y);
+        if (z < 0.0f) {
+            float unfoldedX = (1.0f - std::fabs(y)) * signNotZero(x);
+            y = (1.0f - std::fabs(x)) * signNotZero(y);
+            x = unfoldedX;
+        }
+        return glm::normalize(Vec3(x, y, z));
+    }
+
+    // Texture coordinates of a triangle's 3 vertices, as 16-bit unsigned normalized
+    // values relative to the integer coordinates below their minimum (so that
+    // repeating textures keep full precision), over a range of 2^`exponent` units:
+    // the smallest power of two (at least 2) covering the triangle's coordinates.
+    // Triangles tiling a texture many times (e.g. a floor spanning 0..10) get a
+    // wider range, with coarser steps (range/65535 units).
+    class TexCoords {
+        public:
+            TexCoords() {}
+
+            TexCoords(const glm::vec2& t0, const glm::vec2& t1, const glm::vec2& t2) {
+                glm::vec2 low = glm::floor(glm::min(t0, glm::min(t1, t2)));
+                glm::vec2 high = glm::max(t0, glm::max(t1, t2));
+                tile[0] = int16_t(std::clamp(low.x, -32768.0f, 32767.0f));
+                tile[1] = int16_t(std::clamp(low.y, -32768.0f, 32767.0f));
+                float span = std::max(high.x - tile[0], high.y - tile[1]);
+                exponent = int8_t(std::clamp(int(std::ceil(std::log2(std::max(span, 2.0f)))), 1, maxExponent));
+                float range = std::ldexp(1.0f, exponent);
+                const glm::vec2* t[3] = {&t0, &t1, &t2};
+                for (int i = 0; i < 3; i++) {
+                    for (int j = 0; j < 2; j++) {
+                        float relative = ((*t[i])[j] - tile[j]) / range;
+                        uv[i][j] = uint16_t(std::lround(std::clamp(relative, 0.0f, 1.0f) * 65535.0f));
+                    }
+                }
+            }
+
+            glm::vec2 operator[](int i) const {
+                float step = std::ldexp(1.0f, exponent) / 65535.0f;
+                return glm::vec2(tile[0] + uv[i][0] * step, tile[1] + uv[i][1] * step);
+            }
+
+        private:
+            // Ranges wider than the tile coordinates can address would be useless
+            static constexpr int maxExponent = 16;
+
+            uint16_t uv[3][2] = {};
+            int16_t tile[2] = {};
+            int8_t exponent = 1;
+    };
+}
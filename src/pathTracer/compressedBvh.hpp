@@ -0,0 +1,318 @@
+#pragma once
+
+#include "myPT.hpp"
+#include "flatBvh.hpp"
+#include "renderStats.hpp"
+#include "trace.hpp"
+
+#include <cmath>
+#include <cstring>
+
+// Bounding Volume Hierarchy with 8-wide nodes whose child boxes are quantized
+// to 8 bits per coordinate, relative to the box of the node (in the style of
+// compressed wide BVHs, CWBVH): a node takes 80 bytes for up to 8 children,
+// where `FlatBvh` takes 32 bytes per binary node.
+// It's made by collapsing a `FlatBvh`, and it stores its own copy of the
+// primitives, in an order where the primitives of the leaf children of each node
+// are contiguous. Nodes and primitives are stored in memory from `resource`.
+template <typename Prim>
+class CompressedBvh final : public Hittable {
+    public:
+        struct Node {
+            // The box of child i on axis a is
+            // [origin[a] + low[a][i] * 2^exponent[a], origin[a] + high[a][i] * 2^exponent[a]]
+            float origin[3];
+            int8_t exponent[3];
+            uint8_t numberOfChildren;
+            // Interior children are stored contiguously from `childBase`
+            uint32_t childBase;
+            // Primitives of the leaf children are stored contiguously from `primitiveBase`
+            uint32_t primitiveBase;
+            // For each child: 0 in the top 3 bits for an interior node, and its offset
+            // from `childBase` in the others; for a leaf, its number of primitives
+            // in the top 3 bits, and their offset from `primitiveBase` in the others
+            uint8_t meta[8];
+            uint8_t low[3][8];
+            uint8_t high[3][8];
+
+            bool isLeaf(int i) const { return (meta[i] >> 5) != 0; }
+            uint32_t childOffset(int i) const { return meta[i] & 31; }
+            uint32_t primitiveOffset(int i) const { return meta[i] & 31; }
+            uint32_t primitiveCount(int i) const { return meta[i] >> 5; }
+        };
+
+        CompressedBvh(const FlatBvh<Prim>& bvh,
+                      std::pmr::memory_resource* resource = std::pmr::get_default_resource())
+            : nodes(resource), primitives(resource) {
+            const auto& binaryNodes = bvh.getNodes();
+            if (binaryNodes.empty()) return;
+            trace::Scope scope("BVH compression", "bvh");
+            bbox = binaryNodes[0].bbox;
+            primitives.reserve(bvh.getPrimitives().size());
+            nodes.emplace_back();
+            buildNode(bvh, 0, 0);
+        }
+
+        bool hit(const Ray& r, Interval rayT, HitRecord& rec) const override {
+            if (nodes.empty()) return false;
+            Vec3 invDir = 1.0f / r.direction();
+
+            bool hitAnything = false;
+            // Interior children still to visit, with the distance at which the ray enters them
+            struct Entry {
+                uint32_t node;
+                float t;
+            };
+            Entry stack[stackSize];
+            int size = 0;
+            stack[size++] = {0, rayT.min};
+            // For render statistics (optimized away without them)
+            uint32_t visited = 0, tests = 0;
+            while (size > 0) {
+                Entry entry = stack[--size];
+                // Skip children entered beyond the closest hit found since they were pushed
+                if (entry.t > rayT.max) continue;
+                const Node& node = nodes[entry.node];
+                visited++;
+                float tEntry[8];
+                uint8_t hits = intersectChildren(node, r.origin(), invDir, rayT, tEntry);
+
+                // Leaf children first, shrinking the interval at each hit
+                int first = size;
+                for (int i = 0; i < node.numberOfChildren; i++) {
+                    if (!(hits & (1 << i))) continue;
+                    if (node.isLeaf(i)) {
+                        uint32_t start = node.primitiveBase + node.primitiveOffset(i);
+                        tests += node.primitiveCount(i);
+                        for (uint32_t p = start; p < start + node.primitiveCount(i); p++) {
+                            if (primitives::hit(primitives[p], r, rayT, rec)) {
+                                hitAnything = true;
+                                rayT.max = rec.t;
+                            }
+                        }
+                    } else {
+                        // Pushed so that the nearest child is on top of the stack
+                        int j = size++;
+                        while (j > first && stack[j - 1].t < tEntry[i]) {
+                            stack[j] = stack[j - 1];
+                            j--;
+                        }
+                        stack[j] = {node.childBase + node.childOffset(i), tEntry[i]};
+                    }
+                }
+            }
+            renderStats::countTraversal(visited, tests);
+            return hitAnything;
+        }
+
+        bool occluded(const Ray& r, Interval rayT) const override {
+            if (nodes.empty()) return false;
+            Vec3 invDir = 1.0f / r.direction();
+
+            uint32_t stack[stackSize];
+            int size = 0;
+            stack[size++] = 0;
+            uint32_t visited = 0, tests = 0;
+            while (size > 0) {
+                const Node& node = nodes[stack[--size]];
+                visited++;
+                float tEntry[8];
+                uint8_t hits = intersectChildren(node, r.origin(), invDir, rayT, tEntry);
+                for (int i = 0; i < node.numberOfChildren; i++) {
+                    if (!(hits & (1 << i))) continue;
+                    if (node.isLeaf(i)) {
+                        uint32_t start = node.primitiveBase + node.primitiveOffset(i);
+                        for (uint32_t p = start; p < start + node.primitiveCount(i); p++) {
+                            tests++;
+                            if (primitives::occluded(primitives[p], r, rayT)) {
+                                renderStats::countTraversal(visited, tests);
+                                return true;
+                            }
+                        }
+                    } else {
+                        stack[size++] = node.childBase + node.childOffset(i);
+                    }
+                }
+            }
+            renderStats::countTraversal(visited, tests);
+            return false;
+        }
+
+        Aabb boundingBox() const override { return bbox; }
+
+        void collectEmitters(std::vector<const Hittable*>& emitters) const override {
+            for (const Prim& prim : primitives) primitives::collectEmitters(prim, emitters);
+        }
+
+        size_t numberOfPrimitives() const { return primitives.size(); }
+
+        size_t numberOfNodes() const { return nodes.size(); }
+
+        // Memory taken by the nodes, in bytes
+        size_t nodeMemory() const { return nodes.size() * sizeof(Node); }
+
+        const std::pmr::vector<Node>& getNodes() const { return nodes; }
+
+        const std::pmr::vector<Prim>& getPrimitives() const { return primitives; }
+
+        // Box of child `i` of `node`, as quantized (it contains the original one)
+        static Aabb childBox(const Node& node, int i) {
+            Interval extents[3];
+            for (int axis = 0; axis < 3; axis++) {
+                float scale = powerOfTwo(node.exponent[axis]);
+                extents[axis] = Interval(node.origin[axis] + node.low[axis][i] * scale,
+                                         node.origin[axis] + node.high[axis][i] * scale);
+            }
+            return Aabb(extents[0], extents[1], extents[2]);
+        }
+
+    private:
+        static_assert(sizeof(Node) == 80, "CompressedBvh nodes should be 80 bytes");
+
+        using BinaryNode = typename FlatBvh<Prim>::Node;
+
+        // Largest number of primitives in a leaf: counts take 3 bits in `Node::meta`,
+        // and offsets (up to 7 * 4) the 5 others
+        static constexpr int maxLeafSize = 4;
+        // Each node visited pushes at most 7 entries, and the tree is no deeper
+        // than the binary one
+        static constexpr int stackSize = 64 * 7 + 1;
+
+        std::pmr::vector<Node> nodes;
+        std::pmr::vector<Prim> primitives;
+        Aabb bbox;
+
+        // Intersects the ray with the children boxes of `node`. Returns a mask
+        // of the children hit, and sets `tEntry` to the distance at which the
+        // ray enters each of them.
+        static uint8_t intersectChildren(const Node& node, const Point3& origin, const Vec3& invDir,
+                                         const Interval& rayT, float tEntry[8]) {
+            // Boxes are decoded straight into ray distances:
+            // t = (origin + q * scale - rayOrigin) * invDir = q * a + b
+            float a[3], b[3];
+            bool negative[3];
+            for (int axis = 0; axis < 3; axis++) {
+                a[axis] = powerOfTwo(node.exponent[axis]) * invDir[axis];
+                b[axis] = (node.origin[axis] - origin[axis]) * invDir[axis];
+                negative[axis] = invDir[axis] < 0;
+            }
+            uint8_t hits = 0;
+            for (int i = 0; i < node.numberOfChildren; i++) {
+                float tMin = rayT.min;
+                float tMax = rayT.max;
+                for (int axis = 0; axis < 3; axis++) {
+                    float t0 = node.low[axis][i] * a[axis] + b[axis];
+                    float t1 = node.high[axis][i] * a[axis] + b[axis];
+                    if (negative[axis]) std::swap(t0, t1);
+                    tMin = std::max(tMin, t0);
+                    tMax = std::min(tMax, t1);
+                }
+                if (tMin <= tMax) {
+                    hits |= 1 << i;
+                    tEntry[i] = tMin;
+                }
+            }
+            return hits;
+        }
+
+        // Fills node `nodeIndex` with the (up to 8) descendants of binary node
+        // `binaryIndex` closest to it, then builds the nodes of its interior children
+        void buildNode(const FlatBvh<Prim>& bvh, uint32_t binaryIndex, uint32_t nodeIndex) {
+            const auto& binaryNodes = bvh.getNodes();
+            uint32_t children[8];
+            int numberOfChildren = 0;
+            if (binaryNodes[binaryIndex].count > 0) {
+                children[numberOfChildren++] = binaryIndex;
+            } else {
+                children[numberOfChildren++] = binaryIndex + 1;
+                children[numberOfChildren++] = binaryNodes[binaryIndex].index;
+                // Open the interior child with the largest box until there are 8 children
+                while (numberOfChildren < 8) {
+                    int largest = -1;
+                    float largestArea = -1;
+                    for (int i = 0; i < numberOfChildren; i++) {
+                        const BinaryNode& child = binaryNodes[children[i]];
+                        if (child.count > 0) continue;
+                        float area = halfArea(child.bbox);
+                        if (area > largestArea) {
+                            largest = i;
+                            largestArea = area;
+                        }
+                    }
+                    if (largest < 0) break;
+                    uint32_t opened = children[largest];
+                    children[largest] = opened + 1;
+                    children[numberOfChildren++] = binaryNodes[opened].index;
+                }
+            }
+
+            Node node = {};
+            node.numberOfChildren = numberOfChildren;
+            quantize(binaryNodes, children, node);
+            node.childBase = nodes.size();
+            node.primitiveBase = primitives.size();
+            int numberOfInteriorChildren = 0;
+            for (int i = 0; i < numberOfChildren; i++) {
+                const BinaryNode& child = binaryNodes[children[i]];
+                if (child.count > 0) {
+                    if (child.count > maxLeafSize) fatalError("Error: BVH leaf too large to compress");
+                    node.meta[i] = (child.count << 5) | (primitives.size() - node.primitiveBase);
+                    const auto& source = bvh.getPrimitives();
+                    primitives.insert(primitives.end(), source.begin() + child.index,
+                                      source.begin() + child.index + child.count);
+                } else {
+                    node.meta[i] = numberOfInteriorChildren++;
+                }
+            }
+            nodes[nodeIndex] = node;
+
+            // Interior children are contiguous: allocate them all before building any
+            nodes.resize(nodes.size() + numberOfInteriorChildren);
+            for (int i = 0; i < numberOfChildren; i++) {
+                if (!node.isLeaf(i)) buildNode(bvh, children[i], node.childBase + node.childOffset(i));
+            }
+        }
+
+        // Sets the origin, exponents and quantized boxes of the children of `node`,
+        // which are `children[0..node.numberOfChildren)`
+        static void quantize(const std::pmr::vector<BinaryNode>& binaryNodes,
+                             const uint32_t children[8], Node& node) {
+            Aabb box = Aabb::empty;
+            for (int i = 0; i < node.numberOfChildren; i++) box = Aabb(box, binaryNodes[children[i]].bbox);
+            for (int axis = 0; axis < 3; axis++) {
+                const Interval& extent = box.axisInterval(axis);
+                node.origin[axis] = extent.min;
+                // Smallest power of 2 such that 255 cells cover the box
+                int exponent;
+                std::frexp((extent.max - extent.min) / 255.0f, &exponent);
+                exponent = std::clamp(exponent, -100, 127);
+                node.exponent[axis] = exponent;
+                float scale = powerOfTwo(exponent);
+                for (int i = 0; i < node.numberOfChildren; i++) {
+                    const Interval& childExtent = binaryNodes[children[i]].bbox.axisInterval(axis);
+                    // Rounded outwards, so that quantized boxes contain the original ones
+                    int low = int(std::floor((childExtent.min - extent.min) / scale));
+                    int high = int(std::ceil((childExtent.max - extent.min) / scale));
+                    low = std::clamp(low, 0, 255);
+                    high = std::clamp(high, 0, 255);
+                    while (low > 0 && extent.min + low * scale > childExtent.min) low--;
+                    while (high < 255 && extent.min + high * scale < childExtent.max) high++;
+                    node.low[axis][i] = low;
+                    node.high[axis][i] = high;
+                }
+            }
+        }
+
+        // 2^exponent, for exponents of normal floats (faster than std::ldexp)
+        static float powerOfTwo(int exponent) {
+            uint32_t bits = uint32_t(exponent + 127) << 23;
+            float result;
+            std::memcpy(&result, &bits, sizeof(result));
+            return result;
+        }
+
+        static float halfArea(const Aabb& box) {
+            float x = box.x.size(), y = box.y.size(), z = box.z.size();
+            return x * y + y * z + z * x;
+        }
+};
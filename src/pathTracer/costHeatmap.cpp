@@ -0,0 +1,62 @@
+#include "costHeatmap.hpp"
+#include "imageFiles.hpp"
+
+#ifdef COST_HEATMAP
+
+#include <algorithm>
+#include <cmath>
+
+namespace {
+    // Colour map from black (no cost) through purple, red and orange to pale yellow
+    // (highest cost), close to matplotlib's "inferno"
+    void falseColour(float x, uint8_t rgb[3]) {
+        static const float stops[5][3] = {
+            {0.00f, 0.00f, 0.02f}, {0.34f, 0.06f, 0.43f}, {0.73f, 0.21f, 0.33f},
+            {0.98f, 0.55f, 0.04f}, {0.99f, 1.00f, 0.64f}};
+        x = std::clamp(x, 0.0f, 1.0f) * 4;
+        int i = std::min(int(x), 3);
+        float f = x - i;
+        for (int c = 0; c < 3; c++) {
+            rgb[c] = uint8_t(std::lround(255 * (stops[i][c] * (1 - f) + stops[i + 1][c] * f)));
+        }
+    }
+}
+
+void costHeatmap::Heatmap::write(const std::string& basePath) const {
+    std::string pfmPath = basePath + "_cost.pfm";
+    if (!imageFiles::writePfm(pfmPath, width, height, costs.data())) {
+        std::clog << "Failed writing cost heatmap " << pfmPath << "\n";
+        return;
+    }
+    const char* names[3] = {"nodes", "tests", "time"};
+    const char* units[3] = {"nodes visited", "primitives tested", "us"};
+    size_t pixels = size_t(width) * height;
+    std::clog << "Cost heatmap written to " << pfmPath << " (per pixel:";
+    for (int m = 0; m < 3; m++) {
+        std::vector<float> values(pixels);
+        for (size_t p = 0; p < pixels; p++) values[p] = costs[p * 3 + m];
+        // Scaled to the 99th percentile, so that a few outliers don't leave
+        // the rest of the image dark
+        std::vector<float> sorted = values;
+        size_t k = std::min(pixels - 1, size_t(pixels * 0.99));
+        std::nth_element(sorted.begin(), sorted.begin() + k, sorted.end());
+        float scale = sorted[k] > 0 ? 1.0f / sorted[k] : 0.0f;
+        std::vector<uint8_t> rgb(pixels * 3);
+        for (size_t p = 0; p < pixels; p++) falseColour(values[p] * scale, &rgb[p * 3]);
+        std::string pngPath = basePath + "_cost_" + names[m] + ".png";
+        if (!imageFiles::writePng(pngPath, width, height, rgb.data())) {
+            std::clog << "\nFailed writing cost heatmap " << pngPath << "\n";
+            return;
+        }
+        double mean = 0;
+        for (float v : values) mean += v;
+        mean /= pixels;
+        // Time is stored in nanoseconds, and reported in microseconds
+        float unit = m == 2 ? 1e-3f : 1.0f;
+        std::clog << (m ? "," : "") << " " << mean * unit << " " << units[m] << " on average, "
+                  << sorted[k] * unit << " at the top of the colour scale";
+    }
+    std::clog << ")\n";
+}
+
+#endif
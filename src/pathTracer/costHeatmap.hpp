@@ -0,0 +1,73 @@
+#pragma once
+
+#include "myPT.hpp"
+
+#include <cstdint>
+
+// TRAVERSAL COST HEATMAP
+// Per-pixel cost of a render, measured in the same pass as the image: BVH nodes
+// visited and primitives tested by all the rays of the pixel's samples (camera,
+// scattered and shadow rays), and the time taken by them. Written next to the
+// image as false-colour PNGs (one per measure) and as raw floats (a .pfm file
+// whose red, green and blue channels are nodes, tests and nanoseconds).
+// Only compiled in with COST_HEATMAP (see myPT.hpp): otherwise the functions
+// below are empty, and calls to them compile to nothing.
+namespace costHeatmap {
+#ifdef COST_HEATMAP
+    namespace details {
+        struct Counts {
+            uint64_t nodes = 0;
+            uint64_t tests = 0;
+            std::chrono::steady_clock::time_point start;
+        };
+        // Counts of the pixel being rendered by each thread
+        inline thread_local Counts counts;
+    }
+
+    // A BVH query that visited `nodes` nodes and tested `tests` primitives
+    inline void countTraversal(uint32_t nodes, uint32_t tests) {
+        details::counts.nodes += nodes;
+        details::counts.tests += tests;
+    }
+
+    class Heatmap {
+        public:
+            Heatmap(int width, int height) : width(width), height(height), costs(size_t(width) * height * 3, 0.0f) {}
+
+            // Starts measuring a pixel, on the calling thread
+            void beginPixel() {
+                details::counts = details::Counts();
+                details::counts.start = std::chrono::steady_clock::now();
+            }
+
+            // Records what was measured since `beginPixel` as the cost of pixel (i,j)
+            // (each pixel is only written by the thread rendering it)
+            void endPixel(int i, int j) {
+                float* cost = &costs[(size_t(j) * width + i) * 3];
+                cost[0] = details::counts.nodes;
+                cost[1] = details::counts.tests;
+                cost[2] = std::chrono::duration<float, std::nano>(
+                              std::chrono::steady_clock::now() - details::counts.start).count();
+            }
+
+            // Writes `basePath`_cost.pfm and `basePath`_cost_{nodes,tests,time}.png
+            void write(const std::string& basePath) const;
+
+        private:
+            int width;
+            int height;
+            // Nodes, tests and nanoseconds of each pixel, row by row
+            std::vector<float> costs;
+    };
+#else
+    inline void countTraversal(uint32_t, uint32_t) {}
+
+    class Heatmap {
+        public:
+            Heatmap(int, int) {}
+            void beginPixel() {}
+            void endPixel(int, int) {}
+            void write(const std::string&) const {}
+    };
+#endif
+}
@@ -0,0 +1,228 @@
+#include "denoiser.hpp"
+#include "utilities.hpp"
+#include "trace.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+namespace {
+    // B3-spline kernel weights at offsets 0, ±1 and ±2
+    const float kernel[3] = {3.0f / 8, 1.0f / 4, 1.0f / 16};
+    const int numberOfPasses = 5;
+    // Edge-stopping parameters of SVGF: depth, normal and luminance
+    const float phiDepth = 1.0f;
+    const float phiNormal = 128.0f;
+    const float phiLuminance = 4.0f;
+    // Albedo channels below this aren't divided out (noise would be amplified)
+    const float minAlbedo = 0.01f;
+
+    // Illumination being filtered, in one array per channel (so that each pass
+    // reads contiguous floats), with the variance of its luminance
+    struct Planes {
+        explicit Planes(size_t n) : r(n), g(n), b(n), variance(n) {}
+        std::vector<float> r, g, b, variance;
+    };
+
+    // Runs `task(firstRow, endRow)` on rows of the image split among `numThreads`
+    // threads, and waits for all of them
+    void parallelRows(int height, int numThreads, const std::function<void(int, int)>& task) {
+        numThreads = std::clamp(numThreads, 1, height);
+        std::vector<std::thread> threads;
+        for (int t = 0; t < numThreads; t++) {
+            threads.emplace_back(task, height * t / numThreads, height * (t + 1) / numThreads);
+        }
+        for (std::thread& thread : threads) thread.join();
+    }
+
+    // max(a, b) without a comparison, which the compiler would turn into
+    // a branch (since one of the results is a constant), keeping loops from
+    // being vectorized
+    inline float branchlessMax(float a, float b) {
+        return 0.5f * (a + b + std::abs(a - b));
+    }
+
+    // x^phiNormal, by repeated squaring (phiNormal = 2^7)
+    inline float normalWeight(float cosine) {
+        float w = branchlessMax(0.0f, cosine);
+        for (int i = 0; i < 7; i++) w *= w;
+        return w;
+    }
+
+    // e^x for x <= 0, to about 1e-4 relative: without branches or calls, so that
+    // the filter's loops can be vectorized
+    inline float negativeExp(float x) {
+        // e^x = 2^t = 2^i * 2^f, with i = trunc(t) and f in (-1,0]
+        float t = branchlessMax(x * 1.44269504f, -126.0f);
+        int i = int(t);
+        float f = t - float(i);
+        // Taylor series of 2^f = e^(f ln 2)
+        float p = 1.0f + f * (0.693147f + f * (0.240227f + f * (0.0555041f + f * (0.00961813f + f * 0.00133336f))));
+        int32_t bits = (i + 127) << 23;
+        float scale;
+        std::memcpy(&scale, &bits, sizeof(scale));
+        return p * scale;
+    }
+
+    // Edge-stopping inputs of each pixel, which don't change between passes
+    // (normals in one array per coordinate, like the planes)
+    struct Guide {
+        std::vector<float> normalX, normalY, normalZ;
+        std::vector<float> depth;
+        // Screen-space gradient of the depth (distance change per pixel)
+        std::vector<float> depthGradient;
+    };
+
+    Guide makeGuide(const denoiser::Buffers& buffers) {
+        int width = buffers.width, height = buffers.height;
+        Guide guide;
+        guide.normalX.resize(buffers.features.size());
+        guide.normalY.resize(buffers.features.size());
+        guide.normalZ.resize(buffers.features.size());
+        guide.depth.resize(buffers.features.size());
+        guide.depthGradient.assign(buffers.features.size(), 0.0f);
+        for (size_t i = 0; i < buffers.features.size(); i++) {
+            // Pixels that missed the scene all get the same normal (and depth 0), so
+            // that between them the depth and normal weights are 1
+            Vec3 normal = buffers.features[i].depth == 0 ? Vec3(0.0f, 0.0f, 1.0f) : buffers.features[i].normal;
+            guide.normalX[i] = normal.x;
+            guide.normalY[i] = normal.y;
+            guide.normalZ[i] = normal.z;
+            guide.depth[i] = buffers.features[i].depth;
+        }
+        auto depthAt = [&](int x, int y) {
+            return guide.depth[size_t(std::clamp(y, 0, height - 1)) * width + std::clamp(x, 0, width - 1)];
+        };
+        for (int y = 0; y < height; y++) {
+            for (int x = 0; x < width; x++) {
+                float z = depthAt(x, y);
+                if (z == 0) continue;
+                // Largest one-sided difference with a neighbour on the same surface
+                float gradient = 0;
+                for (float neighbour : {depthAt(x - 1, y), depthAt(x + 1, y), depthAt(x, y - 1), depthAt(x, y + 1)}) {
+                    if (neighbour != 0) gradient = std::max(gradient, std::abs(neighbour - z));
+                }
+                guide.depthGradient[size_t(y) * width + x] = gradient;
+            }
+        }
+        return guide;
+    }
+
+    // One à-trous pass, with taps `step` pixels apart, over rows [firstRow,endRow).
+    // `luminance` is that of `in`.
+    // Each row is filtered tap by tap, over all the pixels for which the tap is
+    // inside the image: the loop over the pixels reads contiguous arrays and has
+    // no branches, so that it's vectorized.
+    void filterRows(const Planes& in, const std::vector<float>& luminance, Planes& out,
+                    const Guide& guide, int width, int height, int step, int firstRow, int endRow) {
+        // Scales of the edge-stopping functions of the row's pixels, and their sums
+        std::vector<float> luminanceScale(width), depthScale(width);
+        std::vector<float> sumWeights(width), r(width), g(width), b(width), sumVariance(width);
+        for (int y = firstRow; y < endRow; y++) {
+            size_t row = size_t(y) * width;
+            for (int x = 0; x < width; x++) {
+                size_t i = row + x;
+                // Variance blurred by a 3x3 Gaussian, since the per-pixel estimate is noisy
+                float variance = 0;
+                for (int dy = -1; dy <= 1; dy++) {
+                    for (int dx = -1; dx <= 1; dx++) {
+                        int xx = std::clamp(x + dx, 0, width - 1), yy = std::clamp(y + dy, 0, height - 1);
+                        variance += (dx ? 0.25f : 0.5f) * (dy ? 0.25f : 0.5f) * in.variance[size_t(yy) * width + xx];
+                    }
+                }
+                luminanceScale[x] = 1.0f / (phiLuminance * std::sqrt(std::max(0.0f, variance)) + 1e-4f);
+                depthScale[x] = 1.0f / (phiDepth * guide.depthGradient[i] * step + 1e-4f * guide.depth[i] + 1e-6f);
+
+                float centerWeight = kernel[0] * kernel[0];
+                sumWeights[x] = centerWeight;
+                r[x] = centerWeight * in.r[i];
+                g[x] = centerWeight * in.g[i];
+                b[x] = centerWeight * in.b[i];
+                sumVariance[x] = centerWeight * centerWeight * in.variance[i];
+            }
+
+            for (int dy = -2; dy <= 2; dy++) {
+                int yy = y + dy * step;
+                if (yy < 0 || yy >= height) continue;
+                for (int dx = -2; dx <= 2; dx++) {
+                    if (dx == 0 && dy == 0) continue;
+                    int offset = dx * step;
+                    // Pixels of the row whose tap is inside the image
+                    int firstX = std::max(0, -offset), endX = std::min(width, width - offset);
+                    // Arrays of the tap start at the tap of pixel 0
+                    size_t tap = size_t(yy) * width + offset;
+                    float kernelWeight = kernel[std::abs(dx)] * kernel[std::abs(dy)];
+                    float depthFalloff = 1.0f / std::sqrt(float(dx * dx + dy * dy));
+                    // The sums are only written at `x`, and the inputs never are
+                    // (without this, more alias checks would be needed than the
+                    // compiler makes)
+                    #pragma GCC ivdep
+                    for (int x = firstX; x < endX; x++) {
+                        float depth = guide.depth[row + x];
+                        float depthJ = guide.depth[tap + x];
+                        float cosine = guide.normalX[row + x] * guide.normalX[tap + x]
+                                     + guide.normalY[row + x] * guide.normalY[tap + x]
+                                     + guide.normalZ[row + x] * guide.normalZ[tap + x];
+                        // Pixels that missed the scene are only mixed with each other
+                        float w = ((depth == 0) == (depthJ == 0)) ? kernelWeight : 0.0f;
+                        w *= negativeExp(-std::abs(depth - depthJ) * depthScale[x] * depthFalloff)
+                           * normalWeight(cosine);
+                        w *= negativeExp(-std::abs(luminance[row + x] - luminance[tap + x]) * luminanceScale[x]);
+                        sumWeights[x] += w;
+                        r[x] += w * in.r[tap + x];
+                        g[x] += w * in.g[tap + x];
+                        b[x] += w * in.b[tap + x];
+                        sumVariance[x] += w * w * in.variance[tap + x];
+                    }
+                }
+            }
+
+            for (int x = 0; x < width; x++) {
+                out.r[row + x] = r[x] / sumWeights[x];
+                out.g[row + x] = g[x] / sumWeights[x];
+                out.b[row + x] = b[x] / sumWeights[x];
+                out.variance[row + x] = sumVariance[x] / (sumWeights[x] * sumWeights[x]);
+            }
+        }
+    }
+}
+
+std::vector<Color> denoiser::denoise(const Buffers& buffers, int numThreads) {
+    trace::Scope scope("denoise", "output");
+    int width = buffers.width, height = buffers.height;
+    size_t n = size_t(width) * height;
+
+    // Divide the albedo out of the image, and the variance accordingly
+    std::vector<Color> divisor(n);
+    Planes planes(n);
+    for (size_t i = 0; i < n; i++) {
+        const Color& albedo = buffers.features[i].albedo;
+        for (int c = 0; c < 3; c++) divisor[i][c] = albedo[c] < minAlbedo ? 1.0f : albedo[c];
+        Color illumination = buffers.color[i] / divisor[i];
+        planes.r[i] = illumination.x;
+        planes.g[i] = illumination.y;
+        planes.b[i] = illumination.z;
+        float scale = luminance(divisor[i]);
+        planes.variance[i] = buffers.variance[i] / (scale * scale);
+    }
+
+    Guide guide = makeGuide(buffers);
+    Planes filtered(n);
+    std::vector<float> luminance(n);
+    for (int pass = 0; pass < numberOfPasses; pass++) {
+        int step = 1 << pass;
+        for (size_t i = 0; i < n; i++) {
+            luminance[i] = 0.2126f * planes.r[i] + 0.7152f * planes.g[i] + 0.0722f * planes.b[i];
+        }
+        parallelRows(height, numThreads, [&](int firstRow, int endRow) {
+            filterRows(planes, luminance, filtered, guide, width, height, step, firstRow, endRow);
+        });
+        std::swap(planes, filtered);
+    }
+
+    std::vector<Color> result(n);
+    for (size_t i = 0; i < n; i++) {
+        result[i] = Color(planes.r[i], planes.g[i], planes.b[i]) * divisor[i];
+    }
+    return result;
+}
@@ -0,0 +1,40 @@
+#pragma once
+
+#include "myPT.hpp"
+
+// EDGE-AVOIDING À-TROUS DENOISER
+// Spatial filter of SVGF (Schied et al. 2017): the illumination (the image
+// divided by the albedo at the first hit, so that textures aren't blurred) is
+// filtered by 5 passes of a 5x5 B3-spline kernel, with taps 1, 2, 4, 8 and 16
+// pixels apart. Each tap is weighted by how close its depth, normal and
+// luminance are to the pixel's, so that edges are kept; the luminance weight
+// allows differences up to a few standard deviations of the pixel's noise.
+namespace denoiser {
+    // Means of the first-hit features of a pixel's camera samples (see aov.hpp):
+    // the albedo over all of them, the normal and depth over those that hit the scene
+    struct Features {
+        Color albedo;
+        // Unit vector (renormalized after averaging)
+        Vec3 normal;
+        // Distance from the camera (0 if every sample missed the scene)
+        float depth;
+    };
+
+    // Per-pixel inputs, row by row from the top row
+    struct Buffers {
+        Buffers(int width, int height)
+            : width(width), height(height), color(size_t(width) * height),
+              variance(size_t(width) * height), features(size_t(width) * height) {}
+
+        int width;
+        int height;
+        // Mean of the samples
+        std::vector<Color> color;
+        // Variance of the mean luminance
+        std::vector<float> variance;
+        std::vector<Features> features;
+    };
+
+    // Returns the denoised image, filtered by `numThreads` threads
+    std::vector<Color> denoise(const Buffers& buffers, int numThreads);
+}
@@ -0,0 +1,72 @@
+#include "distribution.hpp"
+
+#include <algorithm>
+
+Distribution1D::Distribution1D(const float* f, int n) : func(f, f + n), cdf(n + 1) {
+    // Integrate the step function
+    cdf[0] = 0;
+    for (int i = 1; i <= n; i++) {
+        cdf[i] = cdf[i-1] + func[i-1] / n;
+    }
+    funcInt = cdf[n];
+    // Normalize. If the function is zero everywhere, fall back to a uniform distribution
+    if (funcInt == 0) {
+        for (int i = 1; i <= n; i++) cdf[i] = float(i) / n;
+    } else {
+        for (int i = 1; i <= n; i++) cdf[i] /= funcInt;
+    }
+}
+
+float Distribution1D::sampleContinuous(float u, float& pdf, int& offset) const {
+    // Find the last cdf entry that is <= u
+    auto it = std::upper_bound(cdf.begin(), cdf.end(), u);
+    offset = std::clamp(int(it - cdf.begin()) - 1, 0, count() - 1);
+
+    // Position of `u` inside the interval
+    float du = u - cdf[offset];
+    float width = cdf[offset+1] - cdf[offset];
+    if (width > 0) du /= width;
+
+    pdf = (funcInt > 0) ? func[offset] / funcInt : 1.0f;
+    return (offset + du) / count();
+}
+
+Distribution2D::Distribution2D(const float* f, int nu, int nv)
+        : conditional(makeConditional(f, nu, nv)), marginal(rowIntegrals(conditional)) {}
+
+std::vector<Distribution1D> Distribution2D::makeConditional(const float* f, int nu, int nv) {
+    std::vector<Distribution1D> rows;
+    rows.reserve(nv);
+    for (int v = 0; v < nv; v++) {
+        rows.emplace_back(&f[v * nu], nu);
+    }
+    return rows;
+}
+
+std::vector<float> Distribution2D::rowIntegrals(const std::vector<Distribution1D>& rows) {
+    std::vector<float> integrals;
+    integrals.reserve(rows.size());
+    for (const Distribution1D& row : rows) {
+        integrals.push_back(row.integral());
+    }
+    return integrals;
+}
+
+glm::vec2 Distribution2D::sampleContinuous(float u1, float u2, float& pdf) const {
+    float pdfRow, pdfColumn;
+    int v, u;
+    float d1 = marginal.sampleContinuous(u2, pdfRow, v);
+    float d0 = conditional[v].sampleContinuous(u1, pdfColumn, u);
+    pdf = pdfRow * pdfColumn;
+    return glm::vec2(d0, d1);
+}
+
+float Distribution2D::pdf(const glm::vec2& p) const {
+    int nu = conditional[0].count();
+    int nv = marginal.count();
+    int iu = std::clamp(int(p.x * nu), 0, nu - 1);
+    int iv = std::clamp(int(p.y * nv), 0, nv - 1);
+    // Uniform fallback if the function is zero everywhere
+    if (marginal.integral() == 0) return 1.0f;
+    return conditional[iv].value(iu) / marginal.integral();
+}
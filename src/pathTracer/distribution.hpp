@@ -0,0 +1,56 @@
+#pragma once
+
+#include "myPT.hpp"
+
+// Piecewise-constant 1D distribution over [0,1], defined by `n` non-negative
+// function values (one per interval of width 1/n)
+class Distribution1D {
+    public:
+        Distribution1D(const float* f, int n);
+
+        Distribution1D(const std::vector<float>& f) : Distribution1D(f.data(), f.size()) {}
+
+        int count() const { return func.size(); }
+
+        // Function value on interval `i`
+        float value(int i) const { return func[i]; }
+
+        // Integral of the function over [0,1]
+        float integral() const { return funcInt; }
+
+        // Maps `u` in [0,1) to a value in [0,1) distributed proportionally to the function.
+        // Sets `pdf` to the density of the result and `offset` to the index of its interval.
+        float sampleContinuous(float u, float& pdf, int& offset) const;
+
+    private:
+        std::vector<float> func;
+        // Cumulative distribution, with count()+1 entries (cdf[0] = 0, cdf[n] = 1)
+        std::vector<float> cdf;
+        float funcInt;
+};
+
+// Piecewise-constant 2D distribution over [0,1]^2, defined by `nu` x `nv`
+// non-negative function values (row-major, `nu` values per row).
+// Samples pick a row with the marginal distribution, then a column with
+// the conditional distribution of that row.
+class Distribution2D {
+    public:
+        Distribution2D(const float* f, int nu, int nv);
+
+        // Maps `u1`,`u2` in [0,1) to a point distributed proportionally to the function,
+        // and sets `pdf` to its density
+        glm::vec2 sampleContinuous(float u1, float u2, float& pdf) const;
+
+        // Density of point `p` in [0,1]^2
+        float pdf(const glm::vec2& p) const;
+
+    private:
+        // One distribution per row
+        std::vector<Distribution1D> conditional;
+        // Distribution of the rows' integrals
+        Distribution1D marginal;
+
+        static std::vector<Distribution1D> makeConditional(const float* f, int nu, int nv);
+
+        static std::vector<float> rowIntegrals(const std::vector<Distribution1D>& rows);
+};
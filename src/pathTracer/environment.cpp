@@ -0,0 +1,62 @@
+#include "environment.hpp"
+#include "utilities.hpp"
+
+EnvironmentLight::EnvironmentLight(std::shared_ptr<Image> image, float intensity)
+        : image(image), intensity(intensity) {
+    int width = std::max(image->width(), 1);
+    int height = std::max(image->height(), 1);
+
+    // Sampling weights: luminance of each pixel, times sin(theta) to account for
+    // rows near the poles covering a smaller solid angle
+    std::vector<float> weights(width * height);
+    for (int y = 0; y < height; y++) {
+        float sinTheta = std::sin(pi * (y + 0.5f) / height);
+        for (int x = 0; x < width; x++) {
+            weights[y * width + x] = luminance(image->linearColor(x, y)) * sinTheta;
+        }
+    }
+    distribution = std::make_unique<Distribution2D>(weights.data(), width, height);
+}
+
+Color EnvironmentLight::radiance(const Vec3& direction) const {
+    glm::vec2 uv = directionToUV(glm::normalize(direction));
+    int x = int(uv.x * image->width());
+    int y = int(uv.y * image->height());
+    return intensity * image->linearColor(x, y);
+}
+
+Color EnvironmentLight::sample(Vec3& direction, float& pdf) const {
+    float uvPdf;
+    glm::vec2 uv = distribution->sampleContinuous(randomFloat(), randomFloat(), uvPdf);
+    float sinTheta = std::sin(pi * uv.y);
+    if (uvPdf == 0 || sinTheta == 0) {
+        pdf = 0;
+        return Color(0.0f, 0.0f, 0.0f);
+    }
+    direction = uvToDirection(uv);
+    // Change of variables from image coordinates to solid angle:
+    // (u,v) -> (phi,theta) has jacobian 2*pi*pi, and dw = sin(theta) dtheta dphi
+    pdf = uvPdf / (2 * pi * pi * sinTheta);
+    return radiance(direction);
+}
+
+float EnvironmentLight::pdf(const Vec3& direction) const {
+    glm::vec2 uv = directionToUV(glm::normalize(direction));
+    float sinTheta = std::sin(pi * uv.y);
+    if (sinTheta == 0) return 0.0f;
+    return distribution->pdf(uv) / (2 * pi * pi * sinTheta);
+}
+
+glm::vec2 EnvironmentLight::directionToUV(const Vec3& d) {
+    float theta = std::acos(glm::clamp(d.y, -1.0f, 1.0f));
+    float phi = std::atan2(d.z, d.x);
+    if (phi < 0) phi += 2 * pi;
+    return glm::vec2(phi / (2 * pi), theta / pi);
+}
+
+Vec3 EnvironmentLight::uvToDirection(const glm::vec2& uv) {
+    float phi = uv.x * 2 * pi;
+    float theta = uv.y * pi;
+    float sinTheta = std::sin(theta);
+    return Vec3(sinTheta * std::cos(phi), std::cos(theta), sinTheta * std::sin(phi));
+}
@@ -0,0 +1,39 @@
+#pragma once
+
+#include "myPT.hpp"
+#include "image.hpp"
+#include "distribution.hpp"
+
+// Light coming from infinitely far away in every direction, described by
+// an equirectangular (latitude-longitude) high dynamic range image.
+// Directions are sampled proportionally to the image's luminance.
+class EnvironmentLight {
+    public:
+        // `intensity` scales the radiance read from the image
+        EnvironmentLight(std::shared_ptr<Image> image, float intensity = 1.0f);
+
+        // Radiance arriving from direction `direction` (doesn't need to be unit length)
+        Color radiance(const Vec3& direction) const;
+
+        // Samples a unit direction with probability proportional to the radiance
+        // coming from it. Returns that radiance and sets `pdf` to the density of
+        // the direction (solid angle). Returns black with `pdf` = 0 if the sample
+        // is degenerate.
+        Color sample(Vec3& direction, float& pdf) const;
+
+        // Density (solid angle) with which `sample` picks `direction`
+        float pdf(const Vec3& direction) const;
+
+    private:
+        std::shared_ptr<Image> image;
+        float intensity;
+        // Piecewise-constant distribution over the image, weighted by
+        // luminance and by the solid angle of each row of pixels
+        std::unique_ptr<Distribution2D> distribution;
+
+        // Maps a unit direction to image coordinates in [0,1]^2
+        // (u: longitude, v: latitude, from the +Y pole down)
+        static glm::vec2 directionToUV(const Vec3& direction);
+
+        static Vec3 uvToDirection(const glm::vec2& uv);
+};
@@ -0,0 +1,276 @@
+#pragma once
+
+#include "myPT.hpp"
+
+#include "aabb.hpp"
+#include "hittable.hpp"
+#include "ray.hpp"
+#include "interval.hpp"
+#include "triangle.hpp"
+#include "sphere.hpp"
+#include "renderStats.hpp"
+#include "trace.hpp"
+
+#include <algorithm>
+#include <cstdint>
+#include <memory_resource>
+#include <numeric>
+#include <variant>
+
+// Closed set of primitive types, for scenes that mix them
+using Primitive = std::variant<Triangle, Sphere>;
+
+// Static dispatch of primitive queries: concrete primitive types get direct
+// (inlinable) calls, `Primitive` gets a switch on the active alternative
+namespace primitives {
+    template <typename P>
+    inline bool hit(const P& prim, const Ray& r, Interval rayT, HitRecord& rec) {
+        return prim.P::hit(r, rayT, rec);
+    }
+
+    template <typename P>
+    inline bool occluded(const P& prim, const Ray& r, Interval rayT) {
+        return prim.P::occluded(r, rayT);
+    }
+
+    template <typename P>
+    inline Aabb boundingBox(const P& prim) {
+        return prim.P::boundingBox();
+    }
+
+    template <typename P>
+    inline void collectEmitters(const P& prim, std::vector<const Hittable*>& emitters) {
+        prim.P::collectEmitters(emitters);
+    }
+
+    template <typename... Ps>
+    inline bool hit(const std::variant<Ps...>& prim, const Ray& r, Interval rayT, HitRecord& rec) {
+        return std::visit([&](const auto& p) { return hit(p, r, rayT, rec); }, prim);
+    }
+
+    template <typename... Ps>
+    inline bool occluded(const std::variant<Ps...>& prim, const Ray& r, Interval rayT) {
+        return std::visit([&](const auto& p) { return occluded(p, r, rayT); }, prim);
+    }
+
+    template <typename... Ps>
+    inline Aabb boundingBox(const std::variant<Ps...>& prim) {
+        return std::visit([](const auto& p) { return boundingBox(p); }, prim);
+    }
+
+    template <typename... Ps>
+    inline void collectEmitters(const std::variant<Ps...>& prim, std::vector<const Hittable*>& emitters) {
+        std::visit([&](const auto& p) { collectEmitters(p, emitters); }, prim);
+    }
+}
+
+// Bounding Volume Hierarchy stored as a flat array of nodes (depth-first order),
+// over primitives of type `Prim` stored by value.
+// `Prim` is either a concrete primitive (`Triangle`, `Sphere`), for scenes made of
+// a single type of primitive, or `Primitive`, for scenes that mix them.
+// Since the primitive type is known at compile time, the whole traversal loop,
+// intersection routines included, can be inlined.
+// Nodes and primitives are stored in memory from `resource` (e.g. a `SceneArena`).
+template <typename Prim>
+class FlatBvh : public Hittable {
+    public:
+        struct Node {
+            Aabb bbox;
+            // Interior node: index of the right child (the left child follows the node).
+            // Leaf: index of the first primitive.
+            uint32_t index;
+            // Number of primitives in the leaf (0 for interior nodes)
+            uint16_t count;
+            // Axis along which the primitives were sorted
+            uint16_t axis;
+        };
+
+        // Builds the hierarchy over `prims`. If `leafOrder` isn't null, it receives
+        // the index in `prims` of each primitive, in the order leaves reference them.
+        FlatBvh(std::vector<Prim> prims, std::vector<uint32_t>* leafOrder = nullptr,
+                std::pmr::memory_resource* resource = std::pmr::get_default_resource())
+            : nodes(resource), primitives(resource) {
+            if (prims.empty()) return;
+            trace::Scope scope("BVH build", "bvh");
+            std::vector<Aabb> boxes;
+            boxes.reserve(prims.size());
+            for (const Prim& prim : prims) {
+                boxes.push_back(primitives::boundingBox(prim));
+            }
+            std::vector<uint32_t> order(prims.size());
+            std::iota(order.begin(), order.end(), 0);
+            // Nodes are built in a temporary array, so that only the final,
+            // exactly sized arrays come from `resource`
+            std::vector<Node> builtNodes;
+            builtNodes.reserve(2 * prims.size());
+            buildNode(builtNodes, boxes, order, 0, order.size());
+            nodes.assign(builtNodes.begin(), builtNodes.end());
+
+            // Store primitives in the order in which leaves reference them
+            primitives.reserve(prims.size());
+            for (uint32_t index : order) primitives.push_back(std::move(prims[index]));
+            if (leafOrder) *leafOrder = std::move(order);
+        }
+
+        // Uses a hierarchy built beforehand (e.g. read from a scene cache):
+        // `prims` must be in the order leaves reference them. Nodes are stored
+        // in the same memory resource as `prims`.
+        FlatBvh(const Node* prebuiltNodes, size_t numberOfNodes, std::pmr::vector<Prim> prims)
+            : nodes(prebuiltNodes, prebuiltNodes + numberOfNodes, prims.get_allocator()),
+              primitives(std::move(prims)) {}
+
+        bool hit(const Ray& r, Interval rayT, HitRecord& rec) const override {
+            if (nodes.empty()) return false;
+            Vec3 invDir = 1.0f / r.direction();
+
+            bool hitAnything = false;
+            uint32_t stack[maxDepth];
+            int stackSize = 0;
+            uint32_t current = 0;
+            // For render statistics (optimized away without them)
+            uint32_t visited = 0, tests = 0;
+            while (true) {
+                const Node& node = nodes[current];
+                visited++;
+                if (node.bbox.hit(r.origin(), invDir, rayT)) {
+                    if (node.count > 0) {
+                        // Leaf: test primitives, shrinking the interval at each hit
+                        tests += node.count;
+                        for (uint32_t i = node.index; i < node.index + node.count; i++) {
+                            if (primitives::hit(primitives[i], r, rayT, rec)) {
+                                hitAnything = true;
+                                rayT.max = rec.t;
+                            }
+                        }
+                    } else {
+                        // Visit first the child that comes first along the ray direction
+                        // (children are sorted by their lower bound on the split axis)
+                        if (invDir[node.axis] < 0) {
+                            stack[stackSize++] = current + 1;
+                            current = node.index;
+                        } else {
+                            stack[stackSize++] = node.index;
+                            current = current + 1;
+                        }
+                        continue;
+                    }
+                }
+                if (stackSize == 0) break;
+                current = stack[--stackSize];
+            }
+            renderStats::countTraversal(visited, tests);
+            return hitAnything;
+        }
+
+        bool occluded(const Ray& r, Interval rayT) const override {
+            if (nodes.empty()) return false;
+            Vec3 invDir = 1.0f / r.direction();
+
+            uint32_t stack[maxDepth];
+            int stackSize = 0;
+            uint32_t current = 0;
+            uint32_t visited = 0, tests = 0;
+            while (true) {
+                const Node& node = nodes[current];
+                visited++;
+                if (node.bbox.hit(r.origin(), invDir, rayT)) {
+                    if (node.count > 0) {
+                        for (uint32_t i = node.index; i < node.index + node.count; i++) {
+                            tests++;
+                            if (primitives::occluded(primitives[i], r, rayT)) {
+                                renderStats::countTraversal(visited, tests);
+                                return true;
+                            }
+                        }
+                    } else {
+                        if (invDir[node.axis] < 0) {
+                            stack[stackSize++] = current + 1;
+                            current = node.index;
+                        } else {
+                            stack[stackSize++] = node.index;
+                            current = current + 1;
+                        }
+                        continue;
+                    }
+                }
+                if (stackSize == 0) break;
+                current = stack[--stackSize];
+            }
+            renderStats::countTraversal(visited, tests);
+            return false;
+        }
+
+        Aabb boundingBox() const override { return nodes.empty() ? Aabb::empty : nodes[0].bbox; }
+
+        void collectEmitters(std::vector<const Hittable*>& emitters) const override {
+            for (const Prim& prim : primitives) primitives::collectEmitters(prim, emitters);
+        }
+
+        size_t numberOfPrimitives() const { return primitives.size(); }
+
+        const std::pmr::vector<Node>& getNodes() const { return nodes; }
+
+        const std::pmr::vector<Prim>& getPrimitives() const { return primitives; }
+
+        // Whether prebuilt nodes are shallow enough for the traversal stack.
+        // Their children must already be known to be in range, and after them.
+        static bool fitsTraversalStack(const Node* nodes, size_t numberOfNodes) {
+            // Interior nodes above each node
+            std::vector<int> depth(numberOfNodes, 0);
+            for (size_t i = 0; i < numberOfNodes; i++) {
+                if (nodes[i].count > 0) continue;
+                // Each interior node on the way down pushes one entry
+                int childDepth = depth[i] + 1;
+                if (childDepth > maxDepth) return false;
+                depth[i + 1] = std::max(depth[i + 1], childDepth);
+                depth[nodes[i].index] = std::max(depth[nodes[i].index], childDepth);
+            }
+            return true;
+        }
+
+    private:
+        // Maximum number of primitives in a leaf (same as `BvhNode`)
+        static constexpr size_t maxLeafSize = 2;
+        // Size of the traversal stack. Splits are at the median, so the depth
+        // of the tree is about log2 of the number of primitives.
+        static constexpr int maxDepth = 64;
+
+        std::pmr::vector<Node> nodes;
+        std::pmr::vector<Prim> primitives;
+
+        // Builds the subtree over primitives `order[start..end)` and returns the index
+        // of its root. Splits in the middle of the span, after sorting it along the
+        // longest axis (the same strategy as `BvhNode`).
+        // Nodes are appended to `nodes`.
+        static uint32_t buildNode(std::vector<Node>& nodes, const std::vector<Aabb>& boxes,
+                                  std::vector<uint32_t>& order, size_t start, size_t end) {
+            uint32_t nodeIndex = nodes.size();
+            nodes.emplace_back();
+
+            Aabb bbox = Aabb::empty;
+            for (size_t i = start; i < end; i++) {
+                bbox = Aabb(bbox, boxes[order[i]]);
+            }
+            int axis = bbox.longestAxis();
+            nodes[nodeIndex].bbox = bbox;
+            nodes[nodeIndex].axis = axis;
+
+            size_t span = end - start;
+            if (span <= maxLeafSize) {
+                nodes[nodeIndex].index = start;
+                nodes[nodeIndex].count = span;
+                return nodeIndex;
+            }
+
+            std::sort(order.begin() + start, order.begin() + end,
+                      [&boxes, axis](uint32_t a, uint32_t b) {
+                          return boxes[a].axisInterval(axis).min < boxes[b].axisInterval(axis).min;
+                      });
+            size_t mid = start + span/2;
+            buildNode(nodes, boxes, order, start, mid);
+            uint32_t right = buildNode(nodes, boxes, order, mid, end);
+            nodes[nodeIndex].index = right;
+            nodes[nodeIndex].count = 0;
+            return nodeIndex;
+        }
+};
@@ -0,0 +1,207 @@
+#include "guiding.hpp"
+#include "utilities.hpp"
+
+#include <cmath>
+
+namespace {
+    // Quadtree cells with more than this fraction of the total weight are split...
+    const float subdivisionThreshold = 0.01f;
+    // ...up to this depth
+    const int maxQuadtreeDepth = 20;
+    // Regions are split when a pass records more than this many samples in them,
+    // times the square root of the pass's number of paths (which doubles each pass)
+    const float spatialThreshold = 2000.0f;
+
+    // Area-preserving mapping between unit vectors and the unit square
+    void directionToSquare(const Vec3& d, float& x, float& y) {
+        x = std::clamp((d.z + 1) * 0.5f, 0.0f, 1.0f);
+        float phi = std::atan2(d.y, d.x) * (0.5f / pi);
+        y = phi < 0 ? phi + 1 : phi;
+    }
+
+    Vec3 squareToDirection(float x, float y) {
+        float cosTheta = 2 * x - 1;
+        float sinTheta = std::sqrt(std::max(0.0f, 1 - cosTheta * cosTheta));
+        float phi = 2 * pi * y;
+        return Vec3(sinTheta * std::cos(phi), sinTheta * std::sin(phi), cosTheta);
+    }
+
+    // Quadrant of the unit square containing (x,y), which is mapped to the
+    // unit square of the quadrant
+    inline int quadrant(float& x, float& y) {
+        int qx = x >= 0.5f, qy = y >= 0.5f;
+        x = 2 * x - qx;
+        y = 2 * y - qy;
+        return qx + 2 * qy;
+    }
+}
+
+void guiding::DirectionTree::record(const Vec3& direction, float weight) {
+    if (!(weight > 0) || !std::isfinite(weight)) return;
+    float x, y;
+    directionToSquare(direction, x, y);
+    uint32_t n = 0;
+    while (true) {
+        int q = quadrant(x, y);
+        if (!nodes[n].children[q]) {
+            nodes[n].sums[q].add(weight);
+            return;
+        }
+        n = nodes[n].children[q];
+    }
+}
+
+void guiding::DirectionTree::build() {
+    // Children come after their parent
+    for (size_t n = nodes.size(); n-- > 0;) {
+        for (int q = 0; q < 4; q++) {
+            if (nodes[n].children[q]) nodes[n].sums[q] = nodes[nodes[n].children[q]].total();
+        }
+    }
+}
+
+float guiding::DirectionTree::total() const {
+    return nodes[0].total();
+}
+
+Vec3 guiding::DirectionTree::sample() const {
+    // Cell of the quadrant picked at each level
+    float x0 = 0.0f, y0 = 0.0f, size = 1.0f;
+    uint32_t n = 0;
+    while (true) {
+        const Node& node = nodes[n];
+        float total = node.total();
+        int q;
+        if (total <= 0) {
+            // Nothing recorded below this node: uniform
+            q = std::min(int(randomFloat() * 4), 3);
+        } else {
+            float r = randomFloat() * total;
+            for (q = 0; q < 3; q++) {
+                if (r < node.sums[q].get()) break;
+                r -= node.sums[q].get();
+            }
+            // Rounding can land past the last non-empty quadrant
+            while (node.sums[q].get() <= 0) q--;
+        }
+        size *= 0.5f;
+        x0 += (q & 1) * size;
+        y0 += (q >> 1) * size;
+        if (!node.children[q]) break;
+        n = node.children[q];
+    }
+    return squareToDirection(x0 + randomFloat() * size, y0 + randomFloat() * size);
+}
+
+float guiding::DirectionTree::pdf(const Vec3& direction) const {
+    float x, y;
+    directionToSquare(direction, x, y);
+    // Density over the unit square
+    float density = 1.0f;
+    uint32_t n = 0;
+    while (true) {
+        const Node& node = nodes[n];
+        float total = node.total();
+        if (total <= 0) break;
+        int q = quadrant(x, y);
+        density *= 4 * node.sums[q].get() / total;
+        if (!node.children[q] || density == 0) break;
+        n = node.children[q];
+    }
+    // The square maps to the sphere's 4π steradians with a constant Jacobian
+    return density / (4 * pi);
+}
+
+guiding::DirectionTree guiding::DirectionTree::refined() const {
+    DirectionTree tree;
+    float total = this->total();
+    if (total <= 0) return tree;
+
+    struct Entry {
+        // Node of the new tree
+        uint32_t node;
+        // Node of this tree over the same cell (-1 if this tree has a leaf
+        // there, whose weight is assumed to be spread evenly)
+        int64_t old;
+        // Weight of the cell
+        float weight;
+        int depth;
+    };
+    std::vector<Entry> stack = {{0, 0, total, 1}};
+    while (!stack.empty()) {
+        Entry entry = stack.back();
+        stack.pop_back();
+        for (int q = 0; q < 4; q++) {
+            float weight = entry.old >= 0 ? nodes[entry.old].sums[q].get() : entry.weight / 4;
+            if (weight <= total * subdivisionThreshold || entry.depth >= maxQuadtreeDepth) continue;
+            int64_t old = entry.old >= 0 && nodes[entry.old].children[q] ? int64_t(nodes[entry.old].children[q]) : -1;
+            uint32_t child = tree.nodes.size();
+            tree.nodes.emplace_back();
+            tree.nodes[entry.node].children[q] = child;
+            stack.push_back({child, old, weight, entry.depth + 1});
+        }
+    }
+    return tree;
+}
+
+guiding::SdTree::SdTree(const Aabb& bounds) : regions(1) {
+    Node root;
+    root.min = Vec3(bounds.x.min, bounds.y.min, bounds.z.min);
+    root.max = Vec3(bounds.x.max, bounds.y.max, bounds.z.max);
+    nodes.push_back(root);
+}
+
+guiding::Region& guiding::SdTree::region(const Point3& p) {
+    uint32_t n = 0;
+    while (nodes[n].children[0]) {
+        const Node& node = nodes[n];
+        n = node.children[p[node.axis] < node.split ? 0 : 1];
+    }
+    return regions[nodes[n].region];
+}
+
+void guiding::SdTree::update(int pass) {
+    for (Region& region : regions) {
+        region.building.build();
+        region.sampling = region.building;
+    }
+
+    // Split regions along their longest axis until each one has few enough samples
+    // (nodes added by the loop are visited by it too)
+    float threshold = spatialThreshold * std::sqrt(std::ldexp(1.0f, pass));
+    for (size_t n = 0; n < nodes.size(); n++) {
+        if (nodes[n].children[0]) continue;
+        Region& region = regions[nodes[n].region];
+        uint32_t samples = region.samples.load();
+        if (samples <= threshold) continue;
+        // Both halves are assumed to have recorded half of the samples
+        region.samples = samples / 2;
+        Region half = region;
+        regions.push_back(half);
+
+        Vec3 extent = nodes[n].max - nodes[n].min;
+        int axis = extent.x > extent.y ? (extent.x > extent.z ? 0 : 2) : (extent.y > extent.z ? 1 : 2);
+        float split = 0.5f * (nodes[n].min[axis] + nodes[n].max[axis]);
+        Node left = nodes[n], right = nodes[n];
+        left.max[axis] = split;
+        right.min[axis] = split;
+        right.region = regions.size() - 1;
+        nodes[n].axis = axis;
+        nodes[n].split = split;
+        nodes[n].children[0] = nodes.size();
+        nodes[n].children[1] = nodes.size() + 1;
+        nodes.push_back(left);
+        nodes.push_back(right);
+    }
+
+    for (Region& region : regions) {
+        region.building = region.sampling.refined();
+        region.samples = 0;
+    }
+}
+
+size_t guiding::SdTree::memoryUsage() const {
+    size_t bytes = nodes.size() * sizeof(Node) + regions.size() * sizeof(Region);
+    for (const Region& region : regions) bytes += region.sampling.memoryUsage() + region.building.memoryUsage();
+    return bytes;
+}
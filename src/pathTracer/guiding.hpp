@@ -0,0 +1,144 @@
+#pragma once
+
+#include "myPT.hpp"
+#include "aabb.hpp"
+
+#include <atomic>
+#include <cstdint>
+
+// PATH GUIDING
+// Practical path guiding (Müller et al. 2017): the light arriving at each
+// region of the scene is learned over a few training passes, in an SD-tree: a
+// binary tree splitting the scene's bounding box into regions, with a quadtree
+// over the sphere of directions in each region. At hits on surfaces that
+// sample lights (non-specular ones), scattered directions are then sampled
+// from a mix of the material's distribution and the quadtree of the hit's
+// region, so that more paths head to where light comes from.
+// During a pass, paths record into one set of quadtrees and sample from the
+// set recorded by the previous pass. The trees only change between passes, so
+// recording is lock-free: an atomic addition to a quadtree leaf.
+namespace guiding {
+    // Probability of sampling the material's distribution rather than the
+    // learned one, where something was learned
+    const float bsdfSamplingFraction = 0.5f;
+
+    // Float that threads can add to concurrently (copies aren't atomic, and are
+    // only made between passes)
+    class AtomicFloat {
+        public:
+            AtomicFloat(float value = 0.0f) : value(value) {}
+            AtomicFloat(const AtomicFloat& other) : value(other.get()) {}
+            AtomicFloat& operator=(const AtomicFloat& other) {
+                value.store(other.get(), std::memory_order_relaxed);
+                return *this;
+            }
+
+            float get() const { return value.load(std::memory_order_relaxed); }
+            void add(float x) {
+                float old = get();
+                while (!value.compare_exchange_weak(old, old + x, std::memory_order_relaxed)) {}
+            }
+
+        private:
+            std::atomic<float> value;
+    };
+
+    // Distribution of directions, as a quadtree over the unit square mapped to
+    // the sphere by an area-preserving projection ((cosθ+1)/2, φ/2π), whose
+    // cells hold the light recorded in their directions
+    class DirectionTree {
+        public:
+            DirectionTree() : nodes(1) {}
+
+            // Adds `weight` to the leaf cell containing `direction` (unit vector)
+            void record(const Vec3& direction, float weight);
+            // Sums the recorded weights up the tree, after recording
+            void build();
+            // Sum of the recorded weights (after `build`)
+            float total() const;
+
+            // Returns a direction (unit vector) sampled proportionally to the
+            // recorded weights
+            Vec3 sample() const;
+            // Probability density (solid angle) with which `sample` returns `direction`
+            float pdf(const Vec3& direction) const;
+
+            // Empty tree whose cells are split where this tree has more than
+            // a small fraction of its total weight
+            DirectionTree refined() const;
+
+            size_t numberOfNodes() const { return nodes.size(); }
+            size_t memoryUsage() const { return nodes.size() * sizeof(Node); }
+
+        private:
+            // Quadrants (x, y) of a node are stored in the order (0,0), (1,0),
+            // (0,1), (1,1)
+            struct Node {
+                AtomicFloat sums[4];
+                // Index of each quadrant's node (0 if the quadrant is a leaf)
+                uint32_t children[4] = {};
+
+                float total() const { return sums[0].get() + sums[1].get() + sums[2].get() + sums[3].get(); }
+            };
+            // Root first, and each node before its children
+            std::vector<Node> nodes;
+    };
+
+    // Region of the scene, at a leaf of the SD-tree
+    class Region {
+        public:
+            Region() = default;
+            Region(const Region& other)
+                : sampling(other.sampling), building(other.building), samples(other.samples.load()) {}
+
+            // Distribution learned by the previous pass (empty during the first one)
+            const DirectionTree& samplingTree() const { return sampling; }
+
+            // Records light arriving from `direction`: its luminance (times the
+            // cosine term) over the density with which the direction was sampled
+            void record(const Vec3& direction, float weight) {
+                building.record(direction, weight);
+                samples.fetch_add(1, std::memory_order_relaxed);
+            }
+
+        private:
+            friend class SdTree;
+            DirectionTree sampling;
+            DirectionTree building;
+            // Records of the current pass
+            std::atomic<uint32_t> samples{0};
+    };
+
+    class SdTree {
+        public:
+            explicit SdTree(const Aabb& bounds);
+
+            // Region containing `p`
+            Region& region(const Point3& p);
+
+            // Ends training pass `pass` (from 0): what was recorded becomes the
+            // distributions to sample, regions that recorded many samples are
+            // split, and the quadtrees to record into are refined where the
+            // recorded light was concentrated
+            void update(int pass);
+
+            size_t numberOfRegions() const { return regions.size(); }
+            // Memory used by the trees, in bytes
+            size_t memoryUsage() const;
+
+        private:
+            struct Node {
+                // Bounds of the node
+                Vec3 min, max;
+                // Split plane (interior nodes)
+                int axis = 0;
+                float split = 0.0f;
+                // Indices of the children (0 for leaves)
+                uint32_t children[2] = {};
+                // Index of the region (leaves)
+                uint32_t region = 0;
+            };
+            std::vector<Node> nodes;
+            std::vector<Region> regions;
+    };
+}
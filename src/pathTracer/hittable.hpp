@@ -8,16 +8,30 @@
 // needed to solve dependencies
 class Aabb;
 class Material;
+class Hittable;
 
+// Traversal only records `t`, `object` and the barycentric coordinates `b1`, `b2`.
+// The other fields (surface attributes) are filled in by
+// `Hittable::computeSurfaceInteraction`, once, for the closest hit.
 struct HitRecord {
     Point3 p;
     Vec3 normal;
-    std::shared_ptr<Material> material;
+    const Material* material = nullptr;
     float t;
     // u,v texture coordinates
     float u;
     float v;
     bool frontFace;
+    // Primitive that was hit
+    const Hittable* object = nullptr;
+    // Barycentric coordinates of the hit point on the primitive
+    // (only meaningful for triangles)
+    float b1;
+    float b2;
+    // Width of the ray's footprint at the hit point (world units), set before
+    // `computeSurfaceInteraction`, which converts it to u,v units for texture filtering
+    float footprint = 0.0f;
+    float uvFootprint = 0.0f;
     // Sets the hit record normal vector
     // NOTE: the parameter `outwardNormal` is assumed to have unit length
     void setFaceNormal(const Ray& r, const Vec3& outwardNormal) {
@@ -29,6 +43,34 @@ struct HitRecord {
 class Hittable {
     public:
         virtual ~Hittable() = default;
+        // Finds the closest intersection in `rayT`, recording only `t`, `object` and
+        // barycentric coordinates in `rec`
         virtual bool hit(const Ray& r, Interval rayT, HitRecord& rec) const = 0;
+        // Fills the surface attributes of `rec` (hit point, normal, material and
+        // texture coordinates). Called only on the primitive stored in `rec.object`.
+        virtual void computeSurfaceInteraction(const Ray& r, HitRecord& rec) const {}
+        // Returns true if the ray hits anything in `rayT`. Any intersection will do,
+        // so implementations can stop at the first one and skip attribute work.
+        virtual bool occluded(const Ray& r, Interval rayT) const {
+            HitRecord rec;
+            return hit(r, rayT, rec);
+        }
         virtual Aabb boundingBox() const = 0;
+
+        // EMITTERS (primitives whose material emits light)
+
+        // Adds the emitters contained in this object to `emitters`
+        virtual void collectEmitters(std::vector<const Hittable*>& emitters) const {}
+        // Material of the primitive (null for aggregates)
+        virtual const Material* getMaterial() const { return nullptr; }
+        // Surface area of the primitive
+        virtual float area() const { return 0.0f; }
+        // Maps `u1`,`u2` in [0,1] to a point uniformly distributed (by area) on the
+        // primitive's surface. `normal` is set to the geometric normal at that point.
+        virtual Point3 sampleSurface(float u1, float u2, Vec3& normal) const {
+            normal = Vec3(0.0f, 1.0f, 0.0f);
+            return Point3(0.0f, 0.0f, 0.0f);
+        }
+        // Geometric normal at point `q` on the primitive's surface
+        virtual Vec3 geometricNormal(const Point3& q) const { return Vec3(0.0f, 1.0f, 0.0f); }
 };
\ No newline at end of file
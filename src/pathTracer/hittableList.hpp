@@ -35,8 +35,19 @@ class HittableList : public Hittable {
             return hitAnything;
         }
 
+        bool occluded(const Ray& r, Interval rayT) const override {
+            for (const auto& object : objects) {
+                if (object->occluded(r, rayT)) return true;
+            }
+            return false;
+        }
+
         Aabb boundingBox() const override { return bbox; }
 
+        void collectEmitters(std::vector<const Hittable*>& emitters) const override {
+            for (const auto& object : objects) object->collectEmitters(emitters);
+        }
+
     private:
         Aabb bbox;      
 };
\ No newline at end of file
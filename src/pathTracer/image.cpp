@@ -1,5 +1,13 @@
 #include "image.hpp"
 
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+
+#include "trace.hpp"
+
 #define STB_IMAGE_IMPLEMENTATION
 #include <stb_image.h>
 
@@ -10,29 +18,146 @@ Image::Image(const std::string& filePath) : filePath(filePath) {
 }
 
 Image::~Image() {
-    delete[] bdata;
     STBI_FREE(fdata);
+    if (mapping) TextureCache::instance().unmap(mapping);
 }
 
 bool Image::load(const std::string& filePath) {
     this->filePath = filePath;
-    int n;
-    // n = original bytes per pixel in file
-    // bytesPerPixel = desired bytes per pixel
-    fdata = stbi_loadf(filePath.c_str(), &imageWidth, &imageHeight, &n, bytesPerPixel);
-    if (fdata == nullptr) return false;
-
-    bytesPerScanline = imageWidth * bytesPerPixel;
-    convertToBytes();
+    if (stbi_is_hdr(filePath.c_str())) {
+        trace::Scope scope("texture decode", "load", filePath.c_str());
+        int n;
+        // n = original bytes per pixel in file
+        // bytesPerPixel = desired bytes per pixel
+        fdata = stbi_loadf(filePath.c_str(), &imageWidth, &imageHeight, &n, bytesPerPixel);
+        return fdata != nullptr;
+    }
+    if (TextureCache::instance().enabled()) return loadTiled(filePath);
+    if (!decode(filePath)) return false;
+    pages = ownedPages.data();
+    return true;
+}
+
+bool Image::decode(const std::string& filePath) {
+    trace::Scope scope("texture decode", "load", filePath.c_str());
+    int n, w, h;
+    // 8-bit data is kept sRGB-encoded, and only decoded on lookup
+    unsigned char* bdata = stbi_load(filePath.c_str(), &w, &h, &n, bytesPerPixel);
+    if (bdata == nullptr) return false;
+    imageWidth = w;
+    imageHeight = h;
+    buildMipPyramid(bdata);
+    stbi_image_free(bdata);
+    return true;
+}
+
+bool Image::loadTiled(const std::string& filePath) {
+    std::string tiledPath = TextureCache::tiledFilePath(filePath);
+    if (!tiledFileIsFresh(tiledPath)) {
+        std::clog << "Converting " << filePath << " to tiled texture " << tiledPath << "\n";
+        if (!decode(filePath)) return false;
+        if (!writeTiledFile(tiledPath)) fatalError("Error: failed writing tiled texture " + tiledPath);
+        // From now on, data is read from the file
+        std::vector<Page>().swap(ownedPages);
+    }
+    mapping = TextureCache::instance().map(tiledPath, sizeof(Page));
+    if (mapping == nullptr) return false;
+
+    const TiledFileHeader* header = static_cast<const TiledFileHeader*>(mapping->header());
+    imageWidth = header->width;
+    imageHeight = header->height;
+    levels.assign(header->levels, header->levels + header->numberOfLevels);
+    pages = static_cast<const Page*>(mapping->data());
     return true;
 }
 
+bool Image::tiledFileIsFresh(const std::string& tiledPath) const {
+    namespace fs = std::filesystem;
+    std::error_code error;
+    if (!fs::exists(tiledPath, error)) return false;
+    if (fs::last_write_time(tiledPath, error) < fs::last_write_time(filePath, error)) return false;
+
+    TiledFileHeader header;
+    std::ifstream file(tiledPath, std::ios::binary);
+    if (!file.read(reinterpret_cast<char*>(&header), sizeof(header))) return false;
+    return std::memcmp(header.magic, "PTTILES", 8) == 0
+           && header.version == tiledFileVersion
+           && header.numberOfLevels > 0 && header.numberOfLevels <= maxLevels;
+}
+
+bool Image::writeTiledFile(const std::string& tiledPath) const {
+    trace::Scope scope("tiled texture write", "output", tiledPath.c_str());
+    if (levels.size() > size_t(maxLevels)) return false;
+    std::filesystem::create_directories(std::filesystem::path(tiledPath).parent_path());
+
+    // The header takes a whole page, so that data pages are aligned in the file
+    Page headerPage = {};
+    TiledFileHeader* header = reinterpret_cast<TiledFileHeader*>(&headerPage);
+    std::memcpy(header->magic, "PTTILES", 8);
+    header->version = tiledFileVersion;
+    header->width = imageWidth;
+    header->height = imageHeight;
+    header->numberOfLevels = levels.size();
+    std::copy(levels.begin(), levels.end(), header->levels);
+
+    // Written under a temporary name, so that an interrupted conversion
+    // doesn't leave a truncated file behind
+    std::string tempPath = tiledPath + ".tmp";
+    std::ofstream file(tempPath, std::ios::binary);
+    file.write(reinterpret_cast<const char*>(&headerPage), sizeof(Page));
+    file.write(reinterpret_cast<const char*>(ownedPages.data()), ownedPages.size() * sizeof(Page));
+    file.close();
+    if (!file) return false;
+    std::error_code error;
+    std::filesystem::rename(tempPath, tiledPath, error);
+    return !error;
+}
+
 const unsigned char* Image::pixelData(int x, int y) const {
     static unsigned char magenta[] = {255, 0, 255};
-    if (bdata == nullptr) return magenta;
+    if (levels.empty()) return magenta;
+    x = clamp(x, 0, imageWidth);
+    y = clamp(y, 0, imageHeight);
+    return texel(levels[0], x, y);
+}
+
+Color Image::linearColor(int x, int y) const {
+    if (fdata == nullptr && levels.empty()) return Color(1.0f, 0.0f, 1.0f);
     x = clamp(x, 0, imageWidth);
     y = clamp(y, 0, imageHeight);
-    return bdata + y * bytesPerScanline + x * bytesPerPixel;
+    return texelColor(0, x, y);
+}
+
+Color Image::bilinear(float u, float v, int level) const {
+    if (isHdr()) {
+        Footprint f = bilinearFootprint(u, v, imageWidth, imageHeight);
+        Color top = (1 - f.fx) * texelColor(0, f.x0, f.y0) + f.fx * texelColor(0, f.x1, f.y0);
+        Color bottom = (1 - f.fx) * texelColor(0, f.x0, f.y1) + f.fx * texelColor(0, f.x1, f.y1);
+        return (1 - f.fy) * top + f.fy * bottom;
+    }
+    if (levels.empty()) return Color(1.0f, 0.0f, 1.0f);
+
+    const Level& l = levels[level];
+    Footprint f = bilinearFootprint(u, v, l.width, l.height);
+    Color top = (1 - f.fx) * decodeTexel(texel(l, f.x0, f.y0)) + f.fx * decodeTexel(texel(l, f.x1, f.y0));
+    Color bottom = (1 - f.fx) * decodeTexel(texel(l, f.x0, f.y1)) + f.fx * decodeTexel(texel(l, f.x1, f.y1));
+    return (1 - f.fy) * top + f.fy * bottom;
+}
+
+Color Image::trilinear(float u, float v, float lod) const {
+    int lastLevel = numberOfLevels() - 1;
+    if (!(lod > 0)) return bilinear(u, v, 0);
+    if (lod >= lastLevel) return bilinear(u, v, lastLevel);
+    int level = int(lod);
+    float t = lod - level;
+    return (1 - t) * bilinear(u, v, level) + t * bilinear(u, v, level + 1);
+}
+
+size_t Image::memoryUsage() const {
+    if (isHdr()) return size_t(imageWidth) * imageHeight * bytesPerPixel * sizeof(float);
+    if (levels.empty()) return 0;
+    const Level& last = levels.back();
+    return (last.firstPage + 1) * sizeof(Page);
 }
 
 int Image::clamp(int x, int low, int high) {
@@ -42,20 +167,94 @@ int Image::clamp(int x, int low, int high) {
     return high - 1;
 }
 
-unsigned char Image::floatToByte(float value) {
-    if (value <= 0.0) return 0;
-    if (1.0 <= value) return 255;
-    return static_cast<unsigned char>(256.0 * value);
+Image::Footprint Image::bilinearFootprint(float u, float v, int width, int height) {
+    // Texel centers are at half-integer coordinates
+    // (shifted by one so that truncation rounds down). Clamping first keeps the
+    // conversions to int in range, and turns NaN coordinates into 0.
+    float x = std::fmin(std::fmax(u * width + 0.5f, 0.0f), float(width));
+    float y = std::fmin(std::fmax(v * height + 0.5f, 0.0f), float(height));
+    int x0 = int(x) - 1;
+    int y0 = int(y) - 1;
+    Footprint f;
+    f.fx = x - (x0 + 1);
+    f.fy = y - (y0 + 1);
+    // Clamp to the edges of the image
+    f.x0 = clamp(x0, 0, width);
+    f.x1 = clamp(x0 + 1, 0, width);
+    f.y0 = clamp(y0, 0, height);
+    f.y1 = clamp(y0 + 1, 0, height);
+    return f;
+}
+
+Color Image::texelColor(int level, int x, int y) const {
+    if (isHdr()) {
+        const float* pixel = fdata + (y * imageWidth + x) * bytesPerPixel;
+        return Color(pixel[0], pixel[1], pixel[2]);
+    }
+    return decodeTexel(texel(levels[level], x, y));
+}
+
+void Image::addLevel(int width, int height) {
+    Level level;
+    level.width = width;
+    level.height = height;
+    level.pagesX = (width + pageTexels - 1) / pageTexels;
+    int pagesY = (height + pageTexels - 1) / pageTexels;
+    level.firstPage = ownedPages.size();
+    ownedPages.resize(ownedPages.size() + size_t(level.pagesX) * pagesY);
+    levels.push_back(level);
 }
 
-void Image::convertToBytes() {
-    int totalBytes = imageWidth * imageHeight * bytesPerPixel;
-    bdata = new unsigned char[totalBytes];
-    // Iterate through all pixel components, converting from [0.0, 1.0] float values to
-    // unsigned [0, 255] byte values.
-    auto* bptr = bdata;
-    auto* fptr = fdata;
-    for (auto i = 0; i < totalBytes; i++, fptr++, bptr++) {
-        *bptr = floatToByte(*fptr);
+void Image::buildMipPyramid(const unsigned char* data) {
+    // Reserve space for all levels up front
+    size_t totalPages = 0;
+    for (int w = imageWidth, h = imageHeight; ; w = std::max(w/2, 1), h = std::max(h/2, 1)) {
+        totalPages += size_t((w + pageTexels - 1) / pageTexels) * ((h + pageTexels - 1) / pageTexels);
+        if (w == 1 && h == 1) break;
+    }
+    ownedPages.reserve(totalPages);
+
+    addLevel(imageWidth, imageHeight);
+    for (int y = 0; y < imageHeight; y++) {
+        for (int x = 0; x < imageWidth; x++) {
+            const unsigned char* pixel = data + (y * imageWidth + x) * bytesPerPixel;
+            std::copy(pixel, pixel + bytesPerPixel, texel(levels[0], x, y));
+        }
+    }
+
+    while (levels.back().width > 1 || levels.back().height > 1) {
+        Level prev = levels.back();
+        addLevel(std::max(prev.width/2, 1), std::max(prev.height/2, 1));
+        const Level& level = levels.back();
+        for (int y = 0; y < level.height; y++) {
+            for (int x = 0; x < level.width; x++) {
+                // Box filter in linear space (odd sizes clamp to the last row/column)
+                Color sum(0.0f, 0.0f, 0.0f);
+                for (int dy = 0; dy < 2; dy++) {
+                    for (int dx = 0; dx < 2; dx++) {
+                        sum += decodeTexel(texel(prev, clamp(2*x + dx, 0, prev.width),
+                                                  clamp(2*y + dy, 0, prev.height)));
+                    }
+                }
+                unsigned char* t = texel(level, x, y);
+                for (int c = 0; c < 3; c++) t[c] = linearToSrgb(sum[c] / 4);
+            }
+        }
     }
-}
\ No newline at end of file
+}
+
+const std::array<float, 256> Image::srgbTable = [] {
+    std::array<float, 256> table;
+    for (int i = 0; i < 256; i++) {
+        float c = i / 255.0f;
+        table[i] = (c <= 0.04045f) ? c / 12.92f : std::pow((c + 0.055f) / 1.055f, 2.4f);
+    }
+    return table;
+}();
+
+unsigned char Image::linearToSrgb(float value) {
+    if (value <= 0.0f) return 0;
+    if (value >= 1.0f) return 255;
+    float c = (value <= 0.0031308f) ? 12.92f * value : 1.055f * std::pow(value, 1/2.4f) - 0.055f;
+    return static_cast<unsigned char>(c * 255.0f + 0.5f);
+}
@@ -1,6 +1,10 @@
 #pragma once
 
 #include "myPT.hpp"
+#include "textureCache.hpp"
+
+#include <array>
+#include <cstdint>
 
 class Image {
     public:
@@ -11,41 +15,160 @@ class Image {
 
         ~Image();
 
-        // Loads the linear (gamma=1) image data from the given file name.
+        // Loads the image data from the given file name.
         // Returns true if the load succeeded.
-        // The resulting data buffer contains the three [0.0, 1.0] floating-point values
-        // for the each pixel (red, green, blue).
-        // Pixels are contiguous, going left to right for the width of the image, followed
-        // by the next row below, for the full height of the image.
+        // Low dynamic range images are kept as 8-bit sRGB texels (a single copy),
+        // stored in tiles of `tileSize` x `tileSize` texels, with a precomputed
+        // mip pyramid (each level half the size of the previous one).
+        // If the texture cache is enabled, the tiles are written to a file once and
+        // paged in from it on access, instead.
+        // High dynamic range images (.hdr) are kept as linear floating point values,
+        // without mip levels.
         bool load(const std::string& filePath);
 
-        int width()  const { return (fdata == nullptr) ? 0 : imageWidth; }
-        int height() const { return (fdata == nullptr) ? 0 : imageHeight; }
+        int width()  const { return imageWidth; }
+        int height() const { return imageHeight; }
 
-        // Return the address of the three RGB bytes of the pixel at (x,y).
-        // If there is no image data, returns magenta.
+        // Number of mip levels (level 0 is the full resolution image)
+        int numberOfLevels() const { return isHdr() ? 1 : levels.size(); }
+
+        bool isHdr() const { return fdata != nullptr; }
+
+        // Return the address of the three sRGB-encoded RGB bytes of the pixel at (x,y)
+        // of the full resolution image.
+        // If there is no 8-bit image data, returns magenta.
         const unsigned char* pixelData(int x, int y) const;
 
+        // Return the linear floating point color of the pixel at (x,y), without
+        // clamping to [0,1] (used for high dynamic range images).
+        // If there is no image data, returns magenta.
+        Color linearColor(int x, int y) const;
+
+        // Linear color at texture coordinates (u,v) in [0,1]^2, bilinearly
+        // interpolated between the four nearest texels of mip level `level`
+        Color bilinear(float u, float v, int level) const;
+
+        // Linear color at texture coordinates (u,v) in [0,1]^2, blending the bilinear
+        // lookups of the two mip levels around `lod`.
+        // `lod` is the base 2 logarithm of the lookup's footprint, in texels of level 0.
+        Color trilinear(float u, float v, float lod) const;
+
+        // Bytes used to store the pixel data (all mip levels). For images paged
+        // by the texture cache, this is the size of the mapped data, not what's resident.
+        size_t memoryUsage() const;
+
         const std::string& getFilePath(){return filePath;}
 
     private:
+        // Tile side, in texels. With 4 bytes per texel (RGB plus one byte
+        // of padding), a tile fills a 64-byte cache line.
+        static const int tileSize = 4;
+        struct alignas(64) Tile {
+            unsigned char texels[tileSize * tileSize][4];
+        };
+        // Tiles are grouped in square pages of `pageTiles` x `pageTiles` tiles,
+        // the unit in which the texture cache pages data in and out
+        static const int pageTiles = 8;
+        static const int pageTexels = pageTiles * tileSize;
+        struct Page {
+            Tile tiles[pageTiles * pageTiles];
+        };
+        static_assert(sizeof(Page) == TextureCache::pageSize);
+
+        struct Level {
+            int32_t width;
+            int32_t height;
+            // Number of pages in a row of pages
+            int32_t pagesX;
+            // Index of the level's first page
+            uint64_t firstPage;
+        };
+
+        // Header of tiled files: it fills the first page, and is followed by
+        // the pages of all mip levels
+        static const int maxLevels = 32;
+        static const uint32_t tiledFileVersion = 1;
+        struct TiledFileHeader {
+            char magic[8];
+            uint32_t version;
+            int32_t width;
+            int32_t height;
+            int32_t numberOfLevels;
+            Level levels[maxLevels];
+        };
+
         std::string filePath;
         const int bytesPerPixel = 3;
-        // Linear floating point pixel data
+        // Linear floating point pixel data (high dynamic range images only)
         float *fdata = nullptr;
-        // Linear 8-bit pixel data
-        unsigned char *bdata = nullptr;
+        // sRGB 8-bit pixel data of all mip levels (low dynamic range images only).
+        // Points either to `ownedPages` or to a tiled file mapped by the texture cache.
+        const Page* pages = nullptr;
+        std::vector<Page> ownedPages;
+        TextureCache::Mapping* mapping = nullptr;
+        std::vector<Level> levels;
         // Loaded image width
         int imageWidth = 0;
         // Loaded image height
         int imageHeight = 0;
-        int bytesPerScanline = 0;
 
         static int clamp(int x, int low, int high);
 
-        static unsigned char floatToByte(float value);
+        // Bilinear interpolation weights and the four texels around (u,v),
+        // on a `width` x `height` grid
+        struct Footprint {
+            int x0, x1, y0, y1;
+            float fx, fy;
+        };
+        static Footprint bilinearFootprint(float u, float v, int width, int height);
+
+        // Address of the four bytes of texel (x,y) of mip level `level`
+        // (coordinates are non-negative, so unsigned division compiles to shifts)
+        const unsigned char* texel(const Level& level, unsigned x, unsigned y) const {
+            size_t page = level.firstPage + (y / pageTexels) * level.pagesX + x / pageTexels;
+            if (mapping) mapping->touch(page);
+            return pages[page].tiles[tileIndex(x, y)].texels[(y % tileSize) * tileSize + x % tileSize];
+        }
+        unsigned char* texel(const Level& level, unsigned x, unsigned y) {
+            size_t page = level.firstPage + (y / pageTexels) * level.pagesX + x / pageTexels;
+            return ownedPages[page].tiles[tileIndex(x, y)].texels[(y % tileSize) * tileSize + x % tileSize];
+        }
+        // Index of the tile of texel (x,y) in its page
+        static unsigned tileIndex(unsigned x, unsigned y) {
+            return (y / tileSize % pageTiles) * pageTiles + x / tileSize % pageTiles;
+        }
+
+        // Linear color of a texel's bytes
+        static Color decodeTexel(const unsigned char* t) {
+            return Color(srgbToLinear(t[0]), srgbToLinear(t[1]), srgbToLinear(t[2]));
+        }
+
+        // Linear color of texel (x,y) of mip level `level`
+        Color texelColor(int level, int x, int y) const;
+
+        // Appends an empty `width` x `height` mip level
+        void addLevel(int width, int height);
+
+        // Decodes the image file into `ownedPages`
+        bool decode(const std::string& filePath);
+
+        // Copies the 8-bit row-major pixel data in `data` to level 0, then
+        // fills the other levels by averaging 2x2 blocks of the previous one
+        void buildMipPyramid(const unsigned char* data);
+
+        // Loads the image through the texture cache, converting it to a tiled
+        // file first if there isn't an up to date one
+        bool loadTiled(const std::string& filePath);
+
+        // Whether `tiledPath` is a valid tiled file, newer than the image file
+        bool tiledFileIsFresh(const std::string& tiledPath) const;
+
+        // Writes `ownedPages` and the mip level layout to a tiled file
+        bool writeTiledFile(const std::string& tiledPath) const;
 
-        // Convert the linear floating point pixel data to bytes, storing the resulting
-        // byte data in the `bdata` member.
-        void convertToBytes();
-};
\ No newline at end of file
+        // sRGB encoding of 8-bit values
+        static float srgbToLinear(unsigned char value) { return srgbTable[value]; }
+        // Linear values of the 256 sRGB-encoded 8-bit values
+        static const std::array<float, 256> srgbTable;
+        static unsigned char linearToSrgb(float value);
+};
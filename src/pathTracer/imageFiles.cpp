@@ -0,0 +1,185 @@
+#include "imageFiles.hpp"
+
+#include <algorithm>
+#include <fstream>
+
+namespace {
+    uint32_t crc32(const uint8_t* data, size_t length, uint32_t crc = 0) {
+        static uint32_t table[256] = {};
+        if (table[1] == 0) {
+            for (uint32_t n = 0; n < 256; n++) {
+                uint32_t c = n;
+                for (int k = 0; k < 8; k++) c = (c & 1) ? 0xEDB88320u ^ (c >> 1) : c >> 1;
+                table[n] = c;
+            }
+        }
+        crc = ~crc;
+        for (size_t i = 0; i < length; i++) crc = table[(crc ^ data[i]) & 0xFF] ^ (crc >> 8);
+        return ~crc;
+    }
+
+    void appendBigEndian(std::vector<uint8_t>& out, uint32_t value) {
+        for (int shift = 24; shift >= 0; shift -= 8) out.push_back(uint8_t(value >> shift));
+    }
+
+    template <typename T>
+    void appendLittleEndian(std::vector<uint8_t>& out, T value) {
+        const uint8_t* bytes = reinterpret_cast<const uint8_t*>(&value);
+        // x86 is little-endian
+        out.insert(out.end(), bytes, bytes + sizeof(T));
+    }
+
+    // Appends an OpenEXR header attribute: name, type, size and value
+    void appendAttribute(std::vector<uint8_t>& out, const std::string& name, const std::string& type,
+                         const std::vector<uint8_t>& value) {
+        out.insert(out.end(), name.begin(), name.end());
+        out.push_back(0);
+        out.insert(out.end(), type.begin(), type.end());
+        out.push_back(0);
+        appendLittleEndian<int32_t>(out, value.size());
+        out.insert(out.end(), value.begin(), value.end());
+    }
+
+    // Writes a PNG chunk: length, type, data and CRC (of type and data)
+    void writeChunk(std::ofstream& file, const char type[4], const std::vector<uint8_t>& data) {
+        std::vector<uint8_t> chunk;
+        appendBigEndian(chunk, data.size());
+        chunk.insert(chunk.end(), type, type + 4);
+        chunk.insert(chunk.end(), data.begin(), data.end());
+        appendBigEndian(chunk, crc32(chunk.data() + 4, chunk.size() - 4));
+        file.write(reinterpret_cast<const char*>(chunk.data()), chunk.size());
+    }
+}
+
+bool imageFiles::writePng(const std::string& filePath, int width, int height, const uint8_t* rgb) {
+    std::ofstream file(filePath, std::ios::binary);
+    if (!file) return false;
+    const uint8_t signature[8] = {0x89, 'P', 'N', 'G', '\r', '\n', 0x1A, '\n'};
+    file.write(reinterpret_cast<const char*>(signature), sizeof(signature));
+
+    std::vector<uint8_t> header;
+    appendBigEndian(header, width);
+    appendBigEndian(header, height);
+    // 8 bits per channel, RGB, default compression, filtering and no interlacing
+    header.insert(header.end(), {8, 2, 0, 0, 0});
+    writeChunk(file, "IHDR", header);
+
+    // Scanlines, each preceded by its filter type (0: none)
+    size_t rowBytes = size_t(width) * 3;
+    std::vector<uint8_t> raw;
+    raw.reserve((rowBytes + 1) * height);
+    for (int y = 0; y < height; y++) {
+        raw.push_back(0);
+        raw.insert(raw.end(), rgb + y * rowBytes, rgb + (y + 1) * rowBytes);
+    }
+    // zlib stream of stored (uncompressed) deflate blocks, of up to 65535 bytes
+    std::vector<uint8_t> data = {0x78, 0x01};
+    for (size_t offset = 0; ; offset += 65535) {
+        size_t length = std::min<size_t>(65535, raw.size() - offset);
+        bool last = offset + length >= raw.size();
+        data.push_back(last ? 1 : 0);
+        data.push_back(length & 0xFF);
+        data.push_back(length >> 8);
+        data.push_back(~length & 0xFF);
+        data.push_back((~length >> 8) & 0xFF);
+        data.insert(data.end(), raw.begin() + offset, raw.begin() + offset + length);
+        if (last) break;
+    }
+    uint32_t a = 1, b = 0;
+    for (uint8_t byte : raw) {
+        a = (a + byte) % 65521;
+        b = (b + a) % 65521;
+    }
+    appendBigEndian(data, (b << 16) | a);
+    writeChunk(file, "IDAT", data);
+    writeChunk(file, "IEND", {});
+    return bool(file);
+}
+
+bool imageFiles::writePfm(const std::string& filePath, int width, int height, const float* rgb) {
+    std::ofstream file(filePath, std::ios::binary);
+    if (!file) return false;
+    // A negative scale means little-endian data (as on x86); rows go from the bottom one up
+    file << "PF\n" << width << " " << height << "\n-1.0\n";
+    for (int y = height - 1; y >= 0; y--) {
+        file.write(reinterpret_cast<const char*>(rgb + size_t(y) * width * 3), size_t(width) * 3 * sizeof(float));
+    }
+    return bool(file);
+}
+
+bool imageFiles::writeExr(const std::string& filePath, int width, int height,
+                          std::vector<ExrChannel> channels) {
+    std::ofstream file(filePath, std::ios::binary);
+    if (!file) return false;
+    // Channels are stored in alphabetical order
+    std::sort(channels.begin(), channels.end(),
+              [](const ExrChannel& a, const ExrChannel& b) { return a.name < b.name; });
+
+    // Magic number, and version 2 (single part, scanlines)
+    std::vector<uint8_t> header = {0x76, 0x2f, 0x31, 0x01, 2, 0, 0, 0};
+    std::vector<uint8_t> value;
+    for (const ExrChannel& channel : channels) {
+        value.insert(value.end(), channel.name.begin(), channel.name.end());
+        value.push_back(0);
+        // Pixel type (2: float), linear flag, 3 reserved bytes, x and y sampling
+        appendLittleEndian<int32_t>(value, 2);
+        value.insert(value.end(), {0, 0, 0, 0});
+        appendLittleEndian<int32_t>(value, 1);
+        appendLittleEndian<int32_t>(value, 1);
+    }
+    value.push_back(0);
+    appendAttribute(header, "channels", "chlist", value);
+    // No compression
+    appendAttribute(header, "compression", "compression", {0});
+    value.clear();
+    for (int32_t v : {0, 0, width - 1, height - 1}) appendLittleEndian(value, v);
+    appendAttribute(header, "dataWindow", "box2i", value);
+    appendAttribute(header, "displayWindow", "box2i", value);
+    // Increasing y
+    appendAttribute(header, "lineOrder", "lineOrder", {0});
+    value.clear();
+    appendLittleEndian(value, 1.0f);
+    appendAttribute(header, "pixelAspectRatio", "float", value);
+    appendAttribute(header, "screenWindowWidth", "float", value);
+    value.clear();
+    appendLittleEndian(value, 0.0f);
+    appendLittleEndian(value, 0.0f);
+    appendAttribute(header, "screenWindowCenter", "v2f", value);
+    header.push_back(0);
+
+    // Offset table (of each scanline), then the scanlines: y, size of the data,
+    // and the row of each channel
+    size_t rowBytes = channels.size() * width * sizeof(float);
+    uint64_t offset = header.size() + size_t(height) * sizeof(uint64_t);
+    for (int y = 0; y < height; y++) {
+        appendLittleEndian<uint64_t>(header, offset);
+        offset += 8 + rowBytes;
+    }
+    file.write(reinterpret_cast<const char*>(header.data()), header.size());
+    for (int y = 0; y < height; y++) {
+        int32_t line[2] = {y, int32_t(rowBytes)};
+        file.write(reinterpret_cast<const char*>(line), sizeof(line));
+        for (const ExrChannel& channel : channels) {
+            file.write(reinterpret_cast<const char*>(channel.data.data() + size_t(y) * width), width * sizeof(float));
+        }
+    }
+    return bool(file);
+}
+
+bool imageFiles::readPfm(const std::string& filePath, int& width, int& height, std::vector<float>& rgb) {
+    std::ifstream file(filePath, std::ios::binary);
+    std::string type;
+    float scale;
+    if (!(file >> type >> width >> height >> scale) || type != "PF" || scale >= 0
+        || width <= 0 || height <= 0) {
+        return false;
+    }
+    // A single whitespace character separates the header from the data
+    file.get();
+    size_t rowFloats = size_t(width) * 3;
+    rgb.resize(rowFloats * height);
+    for (int y = height - 1; y >= 0; y--) {
+        file.read(reinterpret_cast<char*>(rgb.data() + y * rowFloats), rowFloats * sizeof(float));
+    }
+    return bool(file);
+}
@@ -0,0 +1,29 @@
+#pragma once
+
+#include "myPT.hpp"
+
+#include <cstdint>
+
+// Writers of image files other than the rendered PPM images (e.g. for debugging
+// outputs), and readers of the raw ones. Pixels are given row by row, from the
+// top row, and each function returns false if the file can't be written or read.
+namespace imageFiles {
+    // 8-bit RGB PNG (stored without compression, so that no zlib is needed)
+    bool writePng(const std::string& filePath, int width, int height, const uint8_t* rgb);
+
+    // Portable float map (.pfm): 32-bit float RGB, for raw data
+    bool writePfm(const std::string& filePath, int width, int height, const float* rgb);
+
+    // Channel of an OpenEXR image: a plane of floats
+    struct ExrChannel {
+        std::string name;
+        std::vector<float> data;
+    };
+
+    // OpenEXR image with any number of 32-bit float channels (uncompressed
+    // scanlines), e.g. R, G, B and arbitrary output variables
+    bool writeExr(const std::string& filePath, int width, int height, std::vector<ExrChannel> channels);
+
+    // Reads a float RGB .pfm file (little-endian, as written by `writePfm`)
+    bool readPfm(const std::string& filePath, int& width, int& height, std::vector<float>& rgb);
+}
@@ -0,0 +1,162 @@
+#include "lightBvh.hpp"
+#include "material.hpp"
+#include "utilities.hpp"
+
+#include <algorithm>
+#include <numeric>
+
+LightBvh::LightBvh(const std::vector<const Hittable*>& sceneEmitters)
+        : emitters(sceneEmitters) {
+    if (emitters.empty()) return;
+    // Power of every emitter: luminance of the emitted radiance times the area
+    std::vector<Point3> centroids;
+    std::vector<float> powers;
+    for (const Hittable* emitter : emitters) {
+        Aabb box = emitter->boundingBox();
+        centroids.push_back(Point3((box.x.min + box.x.max) / 2,
+                                   (box.y.min + box.y.max) / 2,
+                                   (box.z.min + box.z.max) / 2));
+        const Material* mat = emitter->getMaterial();
+        Color emit = mat->emitted(0.0f, 0.0f, centroids.back());
+        powers.push_back(luminance(emit) * emitter->area());
+    }
+    trails.resize(emitters.size());
+    nodes.reserve(2 * emitters.size());
+    buildNode(centroids, powers, 0, emitters.size(), 0, 0);
+
+    for (uint32_t i = 0; i < emitters.size(); i++) {
+        emitterIndex[emitters[i]] = i;
+    }
+}
+
+uint32_t LightBvh::buildNode(std::vector<Point3>& centroids, std::vector<float>& powers,
+                             size_t start, size_t end, int depth, uint64_t trail) {
+    uint32_t nodeIndex = nodes.size();
+    nodes.emplace_back();
+
+    Aabb bbox = Aabb::empty;
+    float power = 0.0f;
+    for (size_t i = start; i < end; i++) {
+        bbox = Aabb(bbox, emitters[i]->boundingBox());
+        power += powers[i];
+    }
+    nodes[nodeIndex].bbox = bbox;
+    nodes[nodeIndex].power = power;
+
+    // Leaves hold a single emitter. Splits are at the median, so the depth
+    // (and the number of bits in a trail) is about log2 of the number of emitters.
+    if (end - start == 1) {
+        nodes[nodeIndex].leaf = true;
+        nodes[nodeIndex].index = start;
+        trails[start] = trail;
+        return nodeIndex;
+    }
+
+    // Split in the middle of the span, sorted by centroid along the longest axis
+    Aabb centroidBox = Aabb::empty;
+    for (size_t i = start; i < end; i++) {
+        centroidBox = Aabb(centroidBox, Aabb(centroids[i], centroids[i]));
+    }
+    int axis = centroidBox.longestAxis();
+    std::vector<size_t> order(end - start);
+    std::iota(order.begin(), order.end(), start);
+    std::sort(order.begin(), order.end(), [&centroids, axis](size_t a, size_t b) {
+        return centroids[a][axis] < centroids[b][axis];
+    });
+    // Apply the permutation to the three arrays
+    std::vector<const Hittable*> sortedEmitters;
+    std::vector<Point3> sortedCentroids;
+    std::vector<float> sortedPowers;
+    for (size_t i : order) {
+        sortedEmitters.push_back(emitters[i]);
+        sortedCentroids.push_back(centroids[i]);
+        sortedPowers.push_back(powers[i]);
+    }
+    std::copy(sortedEmitters.begin(), sortedEmitters.end(), emitters.begin() + start);
+    std::copy(sortedCentroids.begin(), sortedCentroids.end(), centroids.begin() + start);
+    std::copy(sortedPowers.begin(), sortedPowers.end(), powers.begin() + start);
+
+    size_t mid = start + (end - start)/2;
+    buildNode(centroids, powers, start, mid, depth+1, trail);
+    uint32_t right = buildNode(centroids, powers, mid, end, depth+1, trail | (uint64_t(1) << depth));
+    nodes[nodeIndex].leaf = false;
+    nodes[nodeIndex].index = right;
+    return nodeIndex;
+}
+
+float LightBvh::importance(const Node& node, const Point3& p) {
+    const Aabb& box = node.bbox;
+    Point3 center((box.x.min + box.x.max) / 2,
+                  (box.y.min + box.y.max) / 2,
+                  (box.z.min + box.z.max) / 2);
+    Vec3 halfDiagonal(box.x.size() / 2, box.y.size() / 2, box.z.size() / 2);
+    Vec3 d = center - p;
+    float dist2 = std::fmax(glm::dot(d, d), glm::dot(halfDiagonal, halfDiagonal));
+    return node.power / dist2;
+}
+
+float LightBvh::leftProbability(uint32_t nodeIndex, const Point3& p) const {
+    float left = importance(nodes[nodeIndex + 1], p);
+    float right = importance(nodes[nodes[nodeIndex].index], p);
+    if (left + right <= 0) return 0.5f;
+    return left / (left + right);
+}
+
+bool LightBvh::sample(const Point3& p, LightSample& ls) const {
+    if (emitters.empty()) return false;
+
+    // Walk down the tree, choosing each child by importance
+    float pmf = 1.0f;
+    uint32_t current = 0;
+    while (!nodes[current].leaf) {
+        float pLeft = leftProbability(current, p);
+        if (randomFloat() < pLeft) {
+            pmf *= pLeft;
+            current = current + 1;
+        } else {
+            pmf *= 1.0f - pLeft;
+            current = nodes[current].index;
+        }
+    }
+    if (pmf <= 0) return false;
+    const Hittable* emitter = emitters[nodes[current].index];
+
+    ls.p = emitter->sampleSurface(randomFloat(), randomFloat(), ls.normal);
+    ls.emitted = emitter->getMaterial()->emitted(0.0f, 0.0f, ls.p);
+
+    // Convert the area density (1/area) to solid angle at `p`
+    Vec3 toLight = ls.p - p;
+    float dist2 = glm::dot(toLight, toLight);
+    float cosLight = std::fabs(glm::dot(ls.normal, toLight)) / std::sqrt(dist2);
+    if (cosLight <= 1e-6f || dist2 <= 0) return false;
+    ls.pdf = pmf * dist2 / (cosLight * emitter->area());
+    return true;
+}
+
+float LightBvh::pdf(const Point3& p, const Hittable* emitter, const Point3& q) const {
+    auto it = emitterIndex.find(emitter);
+    if (it == emitterIndex.end()) return 0.0f;
+    uint64_t trail = trails[it->second];
+
+    // Follow the emitter's trail, multiplying the probabilities of each choice
+    float pmf = 1.0f;
+    uint32_t current = 0;
+    int depth = 0;
+    while (!nodes[current].leaf) {
+        float pLeft = leftProbability(current, p);
+        if (trail & (uint64_t(1) << depth)) {
+            pmf *= 1.0f - pLeft;
+            current = nodes[current].index;
+        } else {
+            pmf *= pLeft;
+            current = current + 1;
+        }
+        depth++;
+    }
+
+    Vec3 toLight = q - p;
+    float dist2 = glm::dot(toLight, toLight);
+    float cosLight = std::fabs(glm::dot(emitter->geometricNormal(q), toLight)) / std::sqrt(dist2);
+    if (cosLight <= 1e-6f || dist2 <= 0) return 0.0f;
+    return pmf * dist2 / (cosLight * emitter->area());
+}
@@ -0,0 +1,74 @@
+#pragma once
+
+#include "myPT.hpp"
+#include "hittable.hpp"
+#include "aabb.hpp"
+
+#include <cstdint>
+#include <unordered_map>
+
+// A point sampled on an emitter, as seen from a shading point
+struct LightSample {
+    Point3 p;
+    // Geometric normal of the emitter at `p`
+    Vec3 normal;
+    // Radiance emitted at `p`
+    Color emitted;
+    // Probability density of the sample, with respect to solid angle at the shading point
+    // (includes the probability of choosing the emitter)
+    float pdf;
+};
+
+// Bounding Volume Hierarchy over the emitters of a scene, used to pick
+// an emitter with probability proportional to its estimated contribution
+// to a shading point, in O(log n) per sample
+class LightBvh {
+    public:
+        LightBvh(const std::vector<const Hittable*>& emitters);
+
+        bool empty() const { return emitters.empty(); }
+
+        size_t numberOfEmitters() const { return emitters.size(); }
+
+        // Picks an emitter by estimated contribution to shading point `p`,
+        // then samples a point on it uniformly by area.
+        // Returns false if there are no emitters or the sample is degenerate.
+        bool sample(const Point3& p, LightSample& ls) const;
+
+        // Probability density (solid angle at `p`) with which `sample` picks
+        // point `q` on `emitter`. Returns 0 if `emitter` isn't in the hierarchy.
+        float pdf(const Point3& p, const Hittable* emitter, const Point3& q) const;
+
+    private:
+        struct Node {
+            Aabb bbox;
+            // Sum of the emitted power of the emitters in the subtree
+            float power;
+            // Interior node: index of the right child (the left child follows the node).
+            // Leaf: index of the emitter.
+            uint32_t index;
+            bool leaf;
+        };
+
+        std::vector<Node> nodes;
+        // Emitters, in the order in which leaves reference them
+        std::vector<const Hittable*> emitters;
+        // For each emitter: the path from the root to its leaf,
+        // one bit per level (1 = right child)
+        std::vector<uint64_t> trails;
+        // Index of each emitter in `emitters`
+        std::unordered_map<const Hittable*, uint32_t> emitterIndex;
+
+        // Builds the subtree over `emitters[start..end)` at depth `depth`, where
+        // `trail` is the path to its root. Returns the index of the root.
+        uint32_t buildNode(std::vector<Point3>& centroids, std::vector<float>& powers,
+                           size_t start, size_t end, int depth, uint64_t trail);
+
+        // Estimated contribution of the emitters in `node` to point `p`:
+        // their power over the squared distance to the center of the node's bounding box,
+        // clamped so that it doesn't blow up when `p` is close to (or inside) the box
+        static float importance(const Node& node, const Point3& p);
+
+        // Probability of picking the left child of interior node `nodeIndex`, from point `p`
+        float leftProbability(uint32_t nodeIndex, const Point3& p) const;
+};
@@ -1,11 +1,17 @@
 #include "myPT.hpp"
 #include "camera.hpp"
-#include "hittableList.hpp"
 #include "scenes.hpp"
+#include "textureCache.hpp"
+#include "streamedBvh.hpp"
+#include "trace.hpp"
+
+#include <iomanip>
 
 using namespace comUtils;
 
-void chooseCameraAndScene(Camera& cam, HittableList& scene){
+// Returns the scene, allocated in `arena`
+const Hittable* chooseCameraAndScene(Camera& cam, SceneArena& arena){
+    const Hittable* scene;
     int sceneNum = ptInput::readSceneNumber(INPUT_FILE);
     switch (sceneNum) {
         case 0:
@@ -15,56 +21,92 @@ void chooseCameraAndScene(Camera& cam, HittableList& scene){
             std::string modelPath = input::readModelName(INPUT_FILE);
             std::string temp = modelPath;
             modelPath = "models/" + temp + "/" + temp + ".obj"; 
-            scene = HittableList(ptScenes::externalModel(modelPath));
+            scene = ptScenes::externalModel(modelPath, arena);
             break;
         } case 1:
             // RAY TRACING IN ONE WEEKEND SPHERES
-            cam = Camera(16.0f/9.0f, 1920, 20, Vec3(13,2,3), Vec3(0,0,0));
+            cam = ptScenes::oneWeekendSpheresCamera();
             cam.setImageName(input::readOutputImageName(INPUT_FILE));
-            cam.setSamplesPerPixel(10);
-            cam.setMaxDepth(50);
-            cam.setDefocusAngle(0.6);
-            cam.setFocusDist(10.0);
-            cam.setBackground(Color(0.70, 0.80, 1.00));
-            scene = HittableList(ptScenes::oneWeekendSpheres());
+            scene = ptScenes::oneWeekendSpheres(arena);
             break; 
         case 2:
             // CORNELL BOX
-            cam = Camera(1, 800, 40, Point3(278,278,-800), Point3(278,278,0));
+            cam = ptScenes::cornellBoxCamera();
             cam.setImageName(input::readOutputImageName(INPUT_FILE));
-            cam.setSamplesPerPixel(10000);
-            cam.setMaxDepth(7);
-            scene = HittableList(ptScenes::cornellBox());
+            scene = ptScenes::cornellBox(arena);
             break;
         case 3:
             // MIRROR ROOM
-            //cam = Camera(1, 100, 60, Point3(400,400,50), Point3(250,250,700));
-            cam = Camera(1, 1000, 45, Point3(100,300,550), Point3(305,300,75));
+            cam = ptScenes::mirrorRoomCamera();
             cam.setImageName(input::readOutputImageName(INPUT_FILE));
-            cam.setSamplesPerPixel(1000);
-            cam.setMaxDepth(40);
-            scene = HittableList(ptScenes::mirrorRoom());
+            scene = ptScenes::mirrorRoom(arena);
             break;
     }
+    // Environment lighting applies to every scene
+    std::string envMapPath = ptInput::readEnvironmentMap(INPUT_FILE);
+    if (envMapPath != "none") {
+        std::clog << "Loading environment map " << envMapPath << "\n";
+        auto envMap = std::make_shared<Image>(envMapPath);
+        cam.setEnvironment(std::make_shared<EnvironmentLight>(
+                           envMap, ptInput::readEnvironmentIntensity(INPUT_FILE)));
+    }
+    return scene;
 }
 
 void renderScene(Camera cam, const Hittable& scene){
+    trace::Scope scope("render", "render");
     auto start = std::chrono::high_resolution_clock::now();
     cam.render(scene);
     auto stop = std::chrono::high_resolution_clock::now();
-    auto duration = std::chrono::duration_cast<std::chrono::seconds>(stop - start);
-    unsigned int seconds = duration.count();
+    auto duration = std::chrono::duration_cast<std::chrono::milliseconds>(stop - start);
+    unsigned int seconds = duration.count() / 1000;
+    unsigned int milliseconds = duration.count() % 1000;
     std::clog << "Rendering time: " << seconds/3600 << "h "
-              << (seconds/60)%60 << "m " << seconds%60 << "s\n";
+              << (seconds/60)%60 << "m " << seconds%60 << "."
+              << std::setw(3) << std::setfill('0') << milliseconds << std::setfill(' ') << "s ("
+              << cam.raysTraced() / 1000.0 / std::max<long long>(duration.count(), 1) << " Mrays/s)\n";
 }
 
 int main() {
+    trace::setThreadName("main");
     std::clog << "Running " << ptInput::readNumThreads(INPUT_FILE)
               << " threads, with " << ptInput::readNumSubImages(INPUT_FILE)
               << " sub-images to be rendered\n\n";
+    // Textures are paged in through the cache, if it has a budget
+    TextureCache& textureCache = TextureCache::instance();
+    textureCache.setBudget(size_t(ptInput::readTextureCacheBudget(INPUT_FILE)) << 20);
+    // Models are streamed from their clusters file, if there's a budget
+    StreamedBvh::setBudget(size_t(ptInput::readGeometryBudget(INPUT_FILE)) << 20);
     Camera cam;
-    HittableList scene;
-    chooseCameraAndScene(cam, scene);
-    renderScene(cam, scene);
+    // Everything in the scene lives in the arena, and is freed at once at exit
+    SceneArena arena;
+    auto start = std::chrono::steady_clock::now();
+    const Hittable* scene;
+    {
+        trace::Scope scope("scene construction", "load");
+        scene = chooseCameraAndScene(cam, arena);
+    }
+    auto stop = std::chrono::steady_clock::now();
+    SceneArena::Stats arenaStats = arena.stats();
+    std::clog << "Scene construction: "
+              << std::chrono::duration_cast<std::chrono::milliseconds>(stop - start).count() << " ms, "
+              << (arenaStats.bytes >> 10) << " kB in the scene arena ("
+              << arenaStats.objects << " objects, " << arenaStats.blocks << " blocks)\n";
+    renderScene(cam, *scene);
+    if (textureCache.enabled()) {
+        TextureCache::Stats stats = textureCache.stats();
+        uint64_t lookups = stats.hits + stats.misses;
+        std::clog << "Texture cache: " << stats.hits << " hits, " << stats.misses << " misses ("
+                  << (lookups ? 100.0 * stats.hits / lookups : 0.0) << "% hit rate), "
+                  << stats.evictions << " evictions, "
+                  << (stats.residentBytes >> 20) << " MB resident\n";
+    }
+    if (StreamedBvh::enabled()) {
+        StreamedBvh::Stats stats = StreamedBvh::stats();
+        std::clog << "Geometry streaming: " << stats.loads << " cluster loads ("
+                  << (stats.bytesRead >> 20) << " MB read), " << stats.evictions << " evictions, "
+                  << (stats.residentBytes >> 20) << " MB resident\n";
+    }
+    trace::write(std::string(OUTPUT_DIR) + "/" + input::readOutputImageName(INPUT_FILE) + "_trace.json");
     return 0;
 }
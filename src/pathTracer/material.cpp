@@ -8,10 +8,32 @@ bool Lambertian::scatter(const Ray& in, const HitRecord& rec, Color& attenuation
     if (nearZero(scatterDirection)) scatterDirection = rec.normal;
 
     scattered = Ray(rec.p, scatterDirection);
-    attenuation = tex->value(rec.u, rec.v, rec.p);
+    attenuation = tex ? tex->value(rec.u, rec.v, rec.p, rec.uvFootprint) : albedo;
     return true;
 }
 
+Color Lambertian::evalScatter(const HitRecord& rec, const Vec3& wi) const {
+    float cosine = glm::dot(rec.normal, wi);
+    if (cosine <= 0) return Color(0.0f,0.0f,0.0f);
+    Color albedo = tex ? tex->value(rec.u, rec.v, rec.p, rec.uvFootprint) : this->albedo;
+    return albedo * (cosine / pi);
+}
+
+float Lambertian::scatterPdf(const HitRecord& rec, const Vec3& wi) const {
+    // `scatter` samples a cosine-weighted distribution
+    // (normal + random unit vector)
+    float cosine = glm::dot(rec.normal, wi);
+    return cosine <= 0 ? 0.0f : cosine / pi;
+}
+
+void Lambertian::writeAovs(const HitRecord& rec, aov::Sample& sample) const {
+    Material::writeAovs(rec, sample);
+    // The texture is only looked up if the albedo is wanted
+    if (sample.wants(aov::Albedo)) {
+        sample.set(aov::Albedo, tex ? tex->value(rec.u, rec.v, rec.p, rec.uvFootprint) : albedo);
+    }
+}
+
 bool Metal::scatter(const Ray& in, const HitRecord& rec, Color& attenuation,
                     Ray& scattered) const {
     Vec3 reflected = glm::reflect(in.direction(), rec.normal);
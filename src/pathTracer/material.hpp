@@ -5,9 +5,13 @@
 #include "hittable.hpp"
 #include "texture.hpp"
 #include "utilities.hpp"
+#include "aov.hpp"
+
+#include <atomic>
 
 class Material {
     public:
+    Material() : id(++numberOfMaterials) {}
     virtual bool scatter(const Ray& in, const HitRecord& rec,
                         Color& attenuation, Ray& scattered)
                         const { return false; }
@@ -15,40 +19,100 @@ class Material {
     virtual Color emitted(float u, float v, const Point3& p) const {
         return Color(0.0f,0.0f,0.0f);
     }
+    // Whether the material reads the u,v texture coordinates of the hit record.
+    // If not, primitives skip computing them.
+    virtual bool usesTexCoords() const { return false; }
+    // Whether the material emits light (emitters are sampled directly)
+    virtual bool isEmissive() const { return false; }
+    // Whether scattered rays leave in a single direction (perfect mirrors and
+    // glass), so that ray footprints don't spread more through the surface
+    virtual bool isSpecular() const { return false; }
+
+    // LIGHT SAMPLING (next event estimation)
+    // Only materials with a non-delta distribution of scattered directions can be
+    // lit by sampling lights directly
+
+    // Whether light sampling is used at hits on this material
+    virtual bool sampleLights() const { return false; }
+    // Scattering function times the cosine term, for light arriving from direction `wi`
+    // (unit vector) and leaving towards the ray origin
+    virtual Color evalScatter(const HitRecord& rec, const Vec3& wi) const {
+        return Color(0.0f,0.0f,0.0f);
+    }
+    // Probability density (solid angle) with which `scatter` picks direction `wi`
+    virtual float scatterPdf(const HitRecord& rec, const Vec3& wi) const { return 0.0f; }
+
+    // Writes the material's output variables for a camera ray's hit `rec`
+    // (its number, and its albedo if the material has one)
+    virtual void writeAovs(const HitRecord& rec, aov::Sample& sample) const {
+        sample.set(aov::MaterialId, float(id));
+    }
     virtual ~Material() = default;
+
+    private:
+    // Number of the material, in order of construction (from 1)
+    uint32_t id;
+    inline static std::atomic<uint32_t> numberOfMaterials{0};
 };
 
 // Lambertian surface
-class Lambertian : public Material {
+class Lambertian final : public Material {
     public:
-        Lambertian(const Color& albedo) : tex(std::make_shared<SolidColor>(albedo)) {}
+        // Solid color albedo is stored directly (no texture lookup)
+        Lambertian(const Color& albedo) : albedo(albedo) {}
         
-        Lambertian(std::shared_ptr<Texture> tex) : tex(tex) {}
+        Lambertian(const Texture* tex) : tex(tex) {}
         
         bool scatter(const Ray& in, const HitRecord& rec, Color& attenuation,
                     Ray& scattered) const override;
+
+        bool usesTexCoords() const override { return tex && tex->usesTexCoords(); }
+
+        bool sampleLights() const override { return true; }
+
+        Color evalScatter(const HitRecord& rec, const Vec3& wi) const override;
+
+        float scatterPdf(const HitRecord& rec, const Vec3& wi) const override;
+
+        void writeAovs(const HitRecord& rec, aov::Sample& sample) const override;
     private:
-        std::shared_ptr<Texture> tex;
+        // Null for solid color surfaces
+        const Texture* tex = nullptr;
+        Color albedo;
 };
 
 // Metal surface
-class Metal : public Material {
+class Metal final : public Material {
     public:
         Metal(const Color& albedo, float fuzz) : albedo(albedo), fuzz(fuzz < 1 ? fuzz : 1) {}
         bool scatter(const Ray& in, const HitRecord& rec, Color& attenuation,
                     Ray& scattered) const override;
+
+        bool isSpecular() const override { return fuzz == 0; }
+
+        void writeAovs(const HitRecord& rec, aov::Sample& sample) const override {
+            Material::writeAovs(rec, sample);
+            sample.set(aov::Albedo, albedo);
+        }
     private:
         Color albedo;
         float fuzz;
 };
 
 // Dielectric surface
-class Dielectric : public Material {
+class Dielectric final : public Material {
     public:
         Dielectric(float refractionIndex) : refractionIndex(refractionIndex) {}  
         bool scatter(const Ray& in, const HitRecord& rec, Color& attenuation,
                     Ray& scattered) const override;
 
+        bool isSpecular() const override { return true; }
+
+        void writeAovs(const HitRecord& rec, aov::Sample& sample) const override {
+            Material::writeAovs(rec, sample);
+            sample.set(aov::Albedo, Color(1.0f, 1.0f, 1.0f));
+        }
+
     private:
         // Refractive index in vacuum or air, or the ratio of the material's
         // refractive index over the refractive index of the enclosing media
@@ -56,13 +120,15 @@ class Dielectric : public Material {
         static float reflectance(float cosine, float refractionIndex);
 };
 
-class DiffuseLight : public Material {
+class DiffuseLight final : public Material {
     public:        
         DiffuseLight(const Color& emit) : emit(emit) {}
         
         Color emitted(float u, float v, const Point3& p) const override {
             return emit;
         }
+
+        bool isEmissive() const override { return true; }
     private:
         Color emit;
 };
\ No newline at end of file
@@ -1,28 +1,39 @@
 #include "mesh.hpp"
 
 void Mesh::loadTriangles(aiMesh *assimpMesh) {
-    triangles.clear();
+    vertices.clear();
+    vertices.reserve(assimpMesh->mNumVertices);
+    for (unsigned int i = 0; i < assimpMesh->mNumVertices; i++) {
+        vertices.push_back(getVertexData(assimpMesh, i));
+    }
+    indices.clear();
+    indices.reserve(3 * assimpMesh->mNumFaces);
     for (unsigned int i = 0; i < assimpMesh->mNumFaces; i++) {
         // All faces should be triangles
-        Vertex v0, v1, v2;
         aiFace face = assimpMesh->mFaces[i];
         if (face.mNumIndices != 3) {
             fatalError("Error: one of the faces in the mesh is not a triangle");
         }
-        v0 = getVertexData(assimpMesh, face.mIndices[0]);
-        v1 = getVertexData(assimpMesh, face.mIndices[1]);
-        v2 = getVertexData(assimpMesh, face.mIndices[2]);
-
-        triangles.push_back(make_shared<Triangle>(v0, v1, v2, material));
+        indices.insert(indices.end(), face.mIndices, face.mIndices + 3);
     }
 }
 
-std::shared_ptr<BvhNode> Mesh::buildBvh(){
-    HittableList list;
-    for (unsigned int i = 0; i < triangles.size(); i++) {
-        list.add(triangles[i]);
+void Mesh::setGeometry(std::vector<Vertex> vertices, std::vector<uint32_t> indices) {
+    this->vertices = std::move(vertices);
+    this->indices = std::move(indices);
+}
+
+void Mesh::appendTriangles(std::vector<Triangle>& triangles) const {
+    for (size_t i = 0; i < numberOfTriangles(); i++) {
+        triangles.push_back(getTriangle(i));
     }
-    return std::make_shared<BvhNode>(list);
+}
+
+FlatBvh<Triangle>* Mesh::buildBvh(SceneArena& arena){
+    std::vector<Triangle> triangles;
+    triangles.reserve(numberOfTriangles());
+    appendTriangles(triangles);
+    return arena.make<FlatBvh<Triangle>>(std::move(triangles), nullptr, arena.resource());
 }        
 
 Vertex Mesh::getVertexData(aiMesh *assimpMesh, unsigned int index){
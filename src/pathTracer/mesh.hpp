@@ -3,28 +3,51 @@
 #include "myPT.hpp"
 #include "triangle.hpp"
 #include "material.hpp"
-#include "bvh.hpp"
+#include "flatBvh.hpp"
+#include "sceneArena.hpp"
 
 #include <assimp/scene.h>
+#include <cstdint>
 
 class Mesh {
     public:
-        Mesh(std::shared_ptr<Material> material) : material(material) {};
+        Mesh(const Material* material) : material(material) {};
 
         // Loads triangles of the assimp mesh.
         // All faces in the assimp mesh need to be triangles.
         void loadTriangles(aiMesh *assimpMesh);
 
-        unsigned int numberOfTriangles() const {return triangles.size();}
+        // Sets the mesh's indexed geometry: every three indices in `indices`
+        // are the vertices of a triangle
+        void setGeometry(std::vector<Vertex> vertices, std::vector<uint32_t> indices);
 
-        // Returns a Bounding Volume Hierarchy built with triangles in mesh
-        std::shared_ptr<BvhNode> buildBvh();
+        unsigned int numberOfTriangles() const {return indices.size() / 3;}
+
+        // Triangle number `index` of the mesh
+        Triangle getTriangle(size_t index) const {
+            return Triangle(vertices[indices[3*index]], vertices[indices[3*index+1]],
+                            vertices[indices[3*index+2]], material);
+        }
+
+        // Appends all triangles of the mesh to `triangles`
+        void appendTriangles(std::vector<Triangle>& triangles) const;
+
+        const std::vector<Vertex>& getVertices() const {return vertices;}
+
+        const std::vector<uint32_t>& getIndices() const {return indices;}
+
+        // Returns a Bounding Volume Hierarchy built with triangles in mesh,
+        // allocated in `arena`
+        FlatBvh<Triangle>* buildBvh(SceneArena& arena);
 
     private:
-        // A mesh is represented as a list of triangles,
-        // all sharing the same material.
-        std::vector<std::shared_ptr<Triangle>> triangles;
-        std::shared_ptr<Material> material;
+        // A mesh is represented as indexed vertex data (three indices per
+        // triangle), all triangles sharing the same material.
+        // Triangles are only made when needed (e.g. to build a BVH).
+        std::vector<Vertex> vertices;
+        std::vector<uint32_t> indices;
+        // Owned by the scene (see `SceneArena`)
+        const Material* material;
         
         // Returns data assigned to the mesh's vertex with index `index`
         Vertex getVertexData(aiMesh *assimpMesh, unsigned int index);
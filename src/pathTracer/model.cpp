@@ -1,4 +1,10 @@
 #include "model.hpp"
+#include "utilities.hpp"
+#include "objLoader.hpp"
+#include "trace.hpp"
+
+#include <algorithm>
+#include <cmath>
 
 using std::shared_ptr;
 using std::make_shared;
@@ -6,110 +12,407 @@ using std::string;
 
 using namespace comUtils::materials;
 
-std::shared_ptr<BvhNode> Model::buildBvh(){
-    // Bounding Volume Hierarchies of meshes
-    HittableList meshBvhs;
-    for (unsigned int i = 0; i < meshes.size(); i++) { 
-        meshBvhs.add(meshes[i].buildBvh());
+namespace {
+    using Clock = std::chrono::steady_clock;
+
+    long long milliseconds(Clock::duration d) {
+        return std::chrono::duration_cast<std::chrono::milliseconds>(d).count();
+    }
+}
+
+const Hittable* Model::buildBvh(){
+    trace::Scope scope("model BVH", "bvh", objFilePath.c_str());
+    auto start = Clock::now();
+    if (clusterFile) {
+        size_t numberOfClusters = clusterFile->numberOfClusters();
+        size_t numberOfTriangles = clusterFile->numberOfTriangles();
+        auto bvh = arena.make<StreamedBvh>(std::move(*clusterFile), std::move(clusterMaterials));
+        clusterFile.reset();
+        std::clog << "Model start-up time (streamed from " << StreamedBvh::filePath(objFilePath) << "): "
+                  << milliseconds(loadingTime + (Clock::now() - start)) << " ms, "
+                  << numberOfTriangles << " triangles in " << numberOfClusters << " clusters\n";
+        return bvh;
+    }
+#ifdef COMPRESSED_BVH
+    // The flat BVH is only a step towards the compressed one: keep it out of the scene
+    SceneArena flatArena;
+#else
+    SceneArena& flatArena = arena;
+#endif
+    size_t totTriangles = 0;
+    for (unsigned int i = 0; i < meshes.size(); i++) {
+        totTriangles += meshes[i].numberOfTriangles();
+    }
+    if (sceneCache) {
+        // The BVH is stored in the cache: only make its triangles, in leaf order
+        std::vector<size_t> firstTriangles;
+        size_t firstTriangle = 0;
+        for (const Mesh& mesh : meshes) {
+            firstTriangles.push_back(firstTriangle);
+            firstTriangle += mesh.numberOfTriangles();
+        }
+        // Made directly in the arena, where the BVH keeps them
+        std::pmr::vector<Triangle> triangles(flatArena.resource());
+        triangles.reserve(totTriangles);
+        const uint32_t* leafOrder = sceneCache->leafOrder();
+        for (size_t i = 0; i < totTriangles; i++) {
+            size_t m = std::upper_bound(firstTriangles.begin(), firstTriangles.end(), leafOrder[i])
+                       - firstTriangles.begin() - 1;
+            triangles.push_back(meshes[m].getTriangle(leafOrder[i] - firstTriangles[m]));
+        }
+        auto bvh = flatArena.make<FlatBvh<Triangle>>(sceneCache->nodes(), sceneCache->numberOfNodes(),
+                                                     std::move(triangles));
+        const Hittable* result = finishBvh(*bvh);
+        std::clog << "Model start-up time (scene cache): "
+                  << milliseconds(loadingTime + (Clock::now() - start)) << " ms"
+                  << " (cold path: " << std::lround(sceneCache->coldMilliseconds()) << " ms)\n";
+        if (StreamedBvh::enabled()) writeClusterFile(*bvh, leafOrder);
+        sceneCache.reset();
+        return result;
+    }
+
+    // All triangles in the model, from every mesh
+    std::vector<Triangle> triangles;
+    triangles.reserve(totTriangles);
+    for (unsigned int i = 0; i < meshes.size(); i++) {
+        meshes[i].appendTriangles(triangles);
     }
-    return make_shared<BvhNode>(meshBvhs);
+    std::vector<uint32_t> leafOrder;
+    auto bvh = flatArena.make<FlatBvh<Triangle>>(std::move(triangles), &leafOrder, flatArena.resource());
+    const Hittable* result = finishBvh(*bvh);
+    double coldMilliseconds =
+        std::chrono::duration<double, std::milli>(loadingTime + (Clock::now() - start)).count();
+    std::clog << "Model start-up time: " << std::lround(coldMilliseconds) << " ms\n";
+#ifdef SCENE_CACHE
+    if (useCaches) writeSceneCache(*bvh, leafOrder, coldMilliseconds);
+#endif
+    if (useCaches && StreamedBvh::enabled()) writeClusterFile(*bvh, leafOrder.data());
+    return result;
+}
+
+const Hittable* Model::finishBvh(const FlatBvh<Triangle>& bvh) {
+#ifdef COMPRESSED_BVH
+    return arena.make<CompressedBvh<Triangle>>(bvh, arena.resource());
+#else
+    return &bvh;
+#endif
 }
 
-void Model::initialize() {    
+void Model::initialize() {
+    trace::Scope scope("model load", "load", objFilePath.c_str());
+    auto start = Clock::now();
+    if (useCaches && StreamedBvh::enabled() && loadClusterFile()) {
+        loadingTime = Clock::now() - start;
+        return;
+    }
+#ifdef SCENE_CACHE
+    if (useCaches && loadSceneCache()) {
+        loadingTime = Clock::now() - start;
+        return;
+    }
+#endif
+
+    // The .mtl file is read once for all materials
+    string mtlFilePath = objFilePath;
+    mtlFilePath.replace(objFilePath.length()-3, 3, "mtl");
+    {
+        trace::Scope scope("material parse", "load", mtlFilePath.c_str());
+        materialLibrary = readMaterialLibrary(mtlFilePath);
+    }
+
+#ifdef NATIVE_OBJ_LOADER
+    if (!loadNative()) {
+        std::clog << "Native loader can't read " << objFilePath << ", falling back to assimp\n";
+        loadWithAssimp();
+    }
+#else
+    loadWithAssimp();
+#endif
+    loadingTime = Clock::now() - start;
+}
+
+bool Model::loadSceneCache() {
+    trace::Scope scope("scene cache read", "load", objFilePath.c_str());
+    auto start = Clock::now();
+    sceneCache = std::make_unique<SceneCache>();
+    if (!sceneCache->open(objFilePath)) {
+        sceneCache.reset();
+        return false;
+    }
+    meshes.clear();
+    meshMaterials.clear();
+    size_t totTriangles = 0;
+    for (size_t i = 0; i < sceneCache->numberOfMeshes(); i++) {
+        SceneCache::MeshData data = sceneCache->mesh(i);
+        meshMaterials.push_back(data.material);
+        meshes.emplace_back(makeMaterial(data.material));
+        meshes.back().setGeometry(
+            std::vector<Vertex>(data.vertices, data.vertices + data.numberOfVertices),
+            std::vector<uint32_t>(data.indices, data.indices + data.numberOfIndices));
+        totTriangles += meshes.back().numberOfTriangles();
+    }
+    if (totTriangles != sceneCache->numberOfTriangles()) {
+        // Inconsistent cache: load the model from scratch
+        meshes.clear();
+        meshMaterials.clear();
+        loadedTexImages.clear();
+        sceneCache.reset();
+        return false;
+    }
+    auto meshesTime = Clock::now() - start;
+
+    start = Clock::now();
+    loadTexImages();
+    auto texturesTime = Clock::now() - start;
+
+    std::clog << "Model loading times (scene cache " << SceneCache::cachePath(objFilePath) << "): "
+              << "meshes " << milliseconds(meshesTime) << " ms, "
+              << "textures " << milliseconds(texturesTime) << " ms ("
+              << loadedTexImages.size() << " images)\n";
+    return true;
+}
+
+void Model::writeSceneCache(const FlatBvh<Triangle>& bvh, const std::vector<uint32_t>& leafOrder,
+                            double coldMilliseconds) {
+    trace::Scope scope("scene cache write", "output", objFilePath.c_str());
+    std::vector<SceneCache::MeshData> data;
+    for (size_t i = 0; i < meshes.size(); i++) {
+        const Mesh& mesh = meshes[i];
+        data.push_back({meshMaterials[i], mesh.getVertices().data(), mesh.getVertices().size(),
+                        mesh.getIndices().data(), mesh.getIndices().size()});
+    }
+    // Not being able to write the cache (e.g. in a read-only directory) only costs time
+    const auto& nodes = bvh.getNodes();
+    if (!SceneCache::write(objFilePath, data, nodes.data(), nodes.size(), leafOrder, coldMilliseconds)) {
+        std::clog << "Warning: failed writing scene cache " << SceneCache::cachePath(objFilePath) << "\n";
+    }
+}
+
+bool Model::loadClusterFile() {
+    trace::Scope scope("clusters file read", "load", objFilePath.c_str());
+    clusterFile = std::make_unique<StreamedBvh::File>();
+    if (!clusterFile->open(objFilePath)) {
+        clusterFile.reset();
+        return false;
+    }
+    auto start = Clock::now();
+    meshes.clear();
+    clusterMaterials.clear();
+    for (const MaterialInfo& info : clusterFile->materials()) clusterMaterials.push_back(makeMaterial(info));
+    loadTexImages();
+    std::clog << "Model loading times (clusters file " << StreamedBvh::filePath(objFilePath) << "): "
+              << "materials and textures " << milliseconds(Clock::now() - start) << " ms ("
+              << loadedTexImages.size() << " images)\n";
+    return true;
+}
+
+void Model::writeClusterFile(const FlatBvh<Triangle>& bvh, const uint32_t* leafOrder) {
+    trace::Scope scope("clusters file write", "output", objFilePath.c_str());
+    // First triangle of each mesh, counting the triangles of all meshes in mesh order
+    std::vector<size_t> firstTriangles;
+    size_t firstTriangle = 0;
+    for (const Mesh& mesh : meshes) {
+        firstTriangles.push_back(firstTriangle);
+        firstTriangle += mesh.numberOfTriangles();
+    }
+    // Materials are stored per mesh
+    auto triangle = [&](size_t i) {
+        size_t m = std::upper_bound(firstTriangles.begin(), firstTriangles.end(), leafOrder[i])
+                   - firstTriangles.begin() - 1;
+        const Mesh& mesh = meshes[m];
+        size_t t = leafOrder[i] - firstTriangles[m];
+        StreamedBvh::TriangleRecord record;
+        for (int k = 0; k < 3; k++) record.vertices[k] = mesh.getVertices()[mesh.getIndices()[3*t + k]];
+        record.material = m;
+        return record;
+    };
+    auto start = Clock::now();
+    if (StreamedBvh::write(objFilePath, bvh, meshMaterials, triangle)) {
+        std::clog << "Wrote clusters file " << StreamedBvh::filePath(objFilePath) << " in "
+                  << milliseconds(Clock::now() - start) << " ms: the geometry will be streamed from it\n";
+    } else {
+        std::clog << "Warning: failed writing clusters file " << StreamedBvh::filePath(objFilePath) << "\n";
+    }
+}
+
+bool Model::loadNative() {
+    auto start = Clock::now();
+    std::vector<objLoader::ObjMesh> objMeshes;
+    {
+        trace::Scope scope("obj parse", "load", objFilePath.c_str());
+        if (!objLoader::load(objFilePath, objMeshes)) return false;
+    }
+    auto parseTime = Clock::now() - start;
+
+    // One material per mesh (the loader groups faces by material)
+    start = Clock::now();
+    std::vector<const Material*> materials;
+    materials.reserve(objMeshes.size());
+    meshMaterials.clear();
+    for (const objLoader::ObjMesh& objMesh : objMeshes) {
+        auto it = materialLibrary.find(objMesh.materialName);
+        if (it != materialLibrary.end()) {
+            meshMaterials.push_back(it->second);
+        } else {
+            // Grey, like assimp's default material
+            MaterialInfo defaultMaterial;
+            defaultMaterial.diffuse = glm::vec3(0.6f);
+            meshMaterials.push_back(defaultMaterial);
+        }
+        materials.push_back(makeMaterial(meshMaterials.back()));
+    }
+    auto materialsTime = Clock::now() - start;
+
+    start = Clock::now();
+    loadTexImages();
+    auto texturesTime = Clock::now() - start;
+
+    start = Clock::now();
+    meshes.clear();
+    meshes.reserve(objMeshes.size());
+    for (const Material* material : materials) meshes.emplace_back(material);
+    parallelFor(meshes.size(), [&](size_t i) {
+        meshes[i].setGeometry(std::move(objMeshes[i].vertices), std::move(objMeshes[i].indices));
+    });
+    auto meshesTime = Clock::now() - start;
+
+    std::clog << "Model loading times (native loader): parse " << milliseconds(parseTime) << " ms, "
+              << "materials " << milliseconds(materialsTime) << " ms, "
+              << "textures " << milliseconds(texturesTime) << " ms ("
+              << loadedTexImages.size() << " images), "
+              << "meshes " << milliseconds(meshesTime) << " ms\n";
+    return true;
+}
+
+void Model::loadWithAssimp() {
+    trace::Scope scope("assimp import", "load", objFilePath.c_str());
+    auto start = Clock::now();
     Assimp::Importer importer;
     const aiScene *scene = importer.ReadFile(objFilePath, aiProcess_Triangulate);
     if(!scene || scene->mFlags & AI_SCENE_FLAGS_INCOMPLETE || !scene->mRootNode) {
         fatalError(string("ERROR::ASSIMP::") + importer.GetErrorString());
     }
-    processNode(scene->mRootNode, scene);
+    auto importTime = Clock::now() - start;
+
+    start = Clock::now();
+    std::vector<MaterialInfo> materialInfos;
+    std::vector<const Material*> materials = loadMaterials(scene, materialInfos);
+    auto materialsTime = Clock::now() - start;
+
+    start = Clock::now();
+    loadTexImages();
+    auto texturesTime = Clock::now() - start;
+
+    // Meshes are independent of each other: convert them in parallel
+    start = Clock::now();
+    std::vector<aiMesh*> assimpMeshes;
+    processNode(scene->mRootNode, scene, assimpMeshes);
+    meshes.clear();
+    meshes.reserve(assimpMeshes.size());
+    meshMaterials.clear();
+    for (aiMesh *assimpMesh : assimpMeshes) {
+        meshes.emplace_back(materials[assimpMesh->mMaterialIndex]);
+        meshMaterials.push_back(materialInfos[assimpMesh->mMaterialIndex]);
+    }
+    parallelFor(meshes.size(), [&](size_t i) {
+        meshes[i].loadTriangles(assimpMeshes[i]);
+    });
+    auto meshesTime = Clock::now() - start;
+
+    std::clog << "Model loading times (assimp): import " << milliseconds(importTime) << " ms, "
+              << "materials " << milliseconds(materialsTime) << " ms, "
+              << "textures " << milliseconds(texturesTime) << " ms ("
+              << loadedTexImages.size() << " images), "
+              << "meshes " << milliseconds(meshesTime) << " ms\n";
 }
 
-void Model::processNode(aiNode *node, const aiScene *scene) {
-    // process all the node's meshes (if any)
+void Model::processNode(aiNode *node, const aiScene *scene, std::vector<aiMesh*>& assimpMeshes) {
+    // collect all the node's meshes (if any)
     for(unsigned int i = 0; i < node->mNumMeshes; i++) {
-        aiMesh *assimpMesh = scene->mMeshes[node->mMeshes[i]];
-        meshes.push_back(processMesh(assimpMesh, scene));			
+        assimpMeshes.push_back(scene->mMeshes[node->mMeshes[i]]);
     }
     // then do the same for each of the node's children
     for(unsigned int i = 0; i < node->mNumChildren; i++) {
-        processNode(node->mChildren[i], scene);			
-    }
-}
-
-Mesh Model::processMesh(aiMesh *assimpMesh, const aiScene *scene) {
-    Mesh mesh(loadMaterial(assimpMesh, scene));
-    mesh.loadTriangles(assimpMesh);
-    return mesh;
-}
-
-shared_ptr<Material> Model::loadMaterial(aiMesh *assimpMesh, const aiScene *assimpScene){
-    if (assimpMesh->mMaterialIndex >= 0) {
-        aiMaterial *assimpMat = assimpScene->mMaterials[assimpMesh->mMaterialIndex];
-        // Access .mtl file
-        int length = objFilePath.length();
-        string mtlFilePath = objFilePath;
-        mtlFilePath.replace(length-3, 3, "mtl");        
-        matType matType = determineMatType(assimpMat, readIllModel(
-                                (assimpMat->GetName()).C_Str(), mtlFilePath));
-
-        switch (matType) {
-            case LAMBERTIAN:
-            default: {  
-                // Look for texture (only 1 is allowed per-mesh)
-                if (assimpMat->GetTextureCount(aiTextureType_DIFFUSE) > 0) {
-                    shared_ptr<ImageTexture> texture = loadTexture(assimpMat, aiTextureType_DIFFUSE);
-                    return make_shared<Lambertian>(texture);  
-                } else {
-                    // If there is no texture to load, use the specified color
-                    aiColor3D albedo;
-                    assimpMat->Get(AI_MATKEY_COLOR_DIFFUSE, albedo);
-                    return make_shared<Lambertian>(Color(albedo.r, albedo.g, albedo.b));
-                }
-            }
-            case METAL: {
-                aiColor3D albedo;
-                assimpMat->Get(AI_MATKEY_COLOR_SPECULAR, albedo);
-                float fuzz;
-                // We consider fuzziness as the opposite of shininess
-                assimpMat->Get(AI_MATKEY_SHININESS, fuzz);
-                fuzz = 1 - (fuzz/1000);
-                return make_shared<Metal>(Color(albedo.r, albedo.g, albedo.b), fuzz);
-            }
-            case DIELECTRIC: {   
-                float iof; // Index Of Refraction
-                assimpMat->Get(AI_MATKEY_REFRACTI, iof);
-                return make_shared<Dielectric>(iof);
-            }
-            case DIFFUSE_LIGHT: {
-                aiColor3D emit;
-                assimpMat->Get(AI_MATKEY_COLOR_EMISSIVE, emit);
-                return make_shared<DiffuseLight>(Color(emit.r, emit.g, emit.b));
+        processNode(node->mChildren[i], scene, assimpMeshes);			
+    }
+}
+
+std::vector<const Material*> Model::loadMaterials(const aiScene *assimpScene,
+                                                  std::vector<MaterialInfo>& infos) {
+    std::vector<const Material*> materials;
+    materials.reserve(assimpScene->mNumMaterials);
+    infos.clear();
+    for (unsigned int i = 0; i < assimpScene->mNumMaterials; i++) {
+        infos.push_back(materialInfo(assimpScene->mMaterials[i]));
+        materials.push_back(makeMaterial(infos.back()));
+    }
+    return materials;
+}
+
+MaterialInfo Model::materialInfo(aiMaterial *assimpMat) {
+    MaterialInfo info;
+    info.model = readIllModel((assimpMat->GetName()).C_Str(), materialLibrary);
+    aiColor3D color;
+    if (assimpMat->Get(AI_MATKEY_COLOR_DIFFUSE, color) == aiReturn_SUCCESS) {
+        info.diffuse = glm::vec3(color.r, color.g, color.b);
+    }
+    if (assimpMat->Get(AI_MATKEY_COLOR_SPECULAR, color) == aiReturn_SUCCESS) {
+        info.specular = glm::vec3(color.r, color.g, color.b);
+    }
+    if (assimpMat->Get(AI_MATKEY_COLOR_EMISSIVE, color) == aiReturn_SUCCESS) {
+        info.emissive = glm::vec3(color.r, color.g, color.b);
+    }
+    assimpMat->Get(AI_MATKEY_SHININESS, info.shininess);
+    assimpMat->Get(AI_MATKEY_REFRACTI, info.refractionIndex);
+    // Only 1 texture is allowed per-mesh
+    if (assimpMat->GetTextureCount(aiTextureType_DIFFUSE) > 0) {
+        aiString texImgFileName; // name of texture image file
+        assimpMat->GetTexture(aiTextureType_DIFFUSE, 0, &texImgFileName);
+        info.diffuseMap = texImgFileName.C_Str();
+    }
+    return info;
+}
+
+const Material* Model::makeMaterial(const MaterialInfo& info){
+    switch (determineMatType(info)) {
+        case LAMBERTIAN:
+        default: {  
+            if (!info.diffuseMap.empty()) {
+                return arena.make<Lambertian>(loadTexture(info.diffuseMap));  
+            } else {
+                // If there is no texture to load, use the specified color
+                return arena.make<Lambertian>(Color(info.diffuse));
             }
         }
-    } else {
-        // default material
-        return make_shared<Lambertian>(Color(0.0f,0.0f,0.0f));
+        case METAL: {
+            // We consider fuzziness as the opposite of shininess
+            float fuzz = 1 - (info.shininess/1000);
+            return arena.make<Metal>(Color(info.specular), fuzz);
+        }
+        case DIELECTRIC: {   
+            // Index Of Refraction
+            return arena.make<Dielectric>(info.refractionIndex);
+        }
+        case DIFFUSE_LIGHT: {
+            return arena.make<DiffuseLight>(Color(info.emissive));
+        }
     }
 }
 
-const std::shared_ptr<ImageTexture> Model::loadTexture(aiMaterial *material, aiTextureType texType){
-    aiString texImgFileName; // name of texture image file
-    material->GetTexture(texType, 0, &texImgFileName);
+const ImageTexture* Model::loadTexture(const string& fileName){
     string tmp = objFilePath;
-    string texImgFilePath = tmp.erase(tmp.find_last_of("/")+1) + texImgFileName.C_Str(); 
-
-    shared_ptr<Image> imgPtr = make_shared<Image>();
-    bool skip = false;
-    for (unsigned int i = 0; i < loadedTexImages.size(); i++) {
-        if(std::strcmp(loadedTexImages[i]->getFilePath().c_str(), texImgFilePath.c_str()) == 0) {
-            imgPtr = loadedTexImages[i];
-            skip = true;
-            break;
-        } 
-    }
-    if (!skip) {
-        imgPtr->load(texImgFilePath);
-        loadedTexImages.push_back(imgPtr);
-    }
-    return make_shared<ImageTexture>(imgPtr);
-}
\ No newline at end of file
+    string texImgFilePath = tmp.erase(tmp.find_last_of("/")+1) + fileName; 
+
+    // Images shared by several materials are only loaded once
+    shared_ptr<Image>& imgPtr = loadedTexImages[texImgFilePath];
+    if (!imgPtr) imgPtr = make_shared<Image>();
+    return arena.make<ImageTexture>(imgPtr);
+}
+
+void Model::loadTexImages() {
+    std::vector<std::pair<const string, shared_ptr<Image>>*> images;
+    for (auto& entry : loadedTexImages) images.push_back(&entry);
+    parallelFor(images.size(), [&](size_t i) {
+        images[i]->second->load(images[i]->first);
+    });
+}
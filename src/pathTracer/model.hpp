@@ -2,39 +2,121 @@
 
 #include "myPT.hpp"
 #include "mesh.hpp"
+#include "sceneCache.hpp"
+#include "sceneArena.hpp"
+#include "compressedBvh.hpp"
+#include "streamedBvh.hpp"
 
 #include <assimp/Importer.hpp>
 #include <assimp/postprocess.h>
+#include <unordered_map>
 
 class Model {
     public:
-        Model(const std::string& objFilePath) : objFilePath(objFilePath) {}
+        // Materials, textures and the BVH are allocated in `arena`
+        Model(const std::string& objFilePath, SceneArena& arena) : objFilePath(objFilePath), arena(arena) {}
 
+        // Loads the model: reads the .mtl file once, builds the materials
+        // (decoding their textures in parallel), then loads the meshes in parallel.
+        // The native .obj loader is tried first (if NATIVE_OBJ_LOADER is defined),
+        // falling back to assimp. Logs the time taken by each phase.
+        // With SCENE_CACHE defined, the model is read from its scene cache instead,
+        // if there's an up to date one.
+        // When geometry streaming is enabled (see `StreamedBvh`) and the model has an
+        // up to date clusters file, only its materials are loaded.
         void initialize();
 
+        // Makes the model ignore (and not write) its scene cache and clusters file,
+        // e.g. to time loading from the .obj file. Must be called before `initialize`.
+        void bypassCaches() {useCaches = false;}
+
         unsigned int numberOfMeshes() const {return meshes.size();}
 
+        // True if the geometry will be streamed from the model's clusters file
+        // (its meshes aren't loaded)
+        bool isStreamed() const {return clusterFile != nullptr;}
+
         const Mesh& getMesh(int index){return meshes[index];}
 
-        // Builds a Bounding Volume Hierarchy from Meshes in Model
-        std::shared_ptr<BvhNode> buildBvh();
+        // Builds a single Bounding Volume Hierarchy over the triangles of all meshes
+        // (or takes it from the scene cache), and logs the model's start-up time.
+        // With SCENE_CACHE defined, a model that wasn't read from the scene cache
+        // is written to it. With COMPRESSED_BVH defined, the BVH is compressed.
+        // When geometry streaming is enabled, the BVH of a model with a clusters
+        // file streams its geometry from it; other models are rendered from
+        // memory, and their clusters file is written for the next runs.
+        const Hittable* buildBvh();
 
     private:
         // A Model is a list of meshes
         std::vector<Mesh> meshes;
         // path of .obj file
-        std::string objFilePath; 
-        // texture images that have already been loaded
-        std::vector<std::shared_ptr<Image>> loadedTexImages; 
+        std::string objFilePath;
+        SceneArena& arena;
+        // materials in the .mtl file
+        comUtils::materials::MaterialLibrary materialLibrary;
+        // material of each mesh
+        std::vector<comUtils::materials::MaterialInfo> meshMaterials;
+        // scene cache the model was read from (null if it was read from the .obj file)
+        std::unique_ptr<SceneCache> sceneCache;
+        // clusters file the geometry is streamed from (null if it's in memory)
+        std::unique_ptr<StreamedBvh::File> clusterFile;
+        // materials of the clusters file
+        std::vector<const Material*> clusterMaterials;
+        // false if the scene cache and clusters file are bypassed
+        bool useCaches = true;
+        // time taken by `initialize`
+        std::chrono::steady_clock::duration loadingTime;
+        // texture images, by file path (each one is loaded once)
+        std::unordered_map<std::string, std::shared_ptr<Image>> loadedTexImages;
+
+        // Loads the model with the native .obj loader.
+        // Returns false if it can't read the file.
+        bool loadNative();
+
+        // Loads the model with assimp
+        void loadWithAssimp();
+
+        // Loads the model from its scene cache.
+        // Returns false if there isn't an up to date one.
+        bool loadSceneCache();
+
+        // Writes the model and its BVH to the scene cache
+        void writeSceneCache(const FlatBvh<Triangle>& bvh, const std::vector<uint32_t>& leafOrder,
+                             double coldMilliseconds);
+
+        // Opens the model's clusters file, and makes its materials.
+        // Returns false if there isn't an up to date one.
+        bool loadClusterFile();
+
+        // Writes the model's triangles to its clusters file, partitioning `bvh`.
+        // `leafOrder` is the triangle index of each primitive of `bvh`.
+        void writeClusterFile(const FlatBvh<Triangle>& bvh, const uint32_t* leafOrder);
+
+        // BVH to render the model with: `bvh` itself, or with COMPRESSED_BVH
+        // defined, its compressed version (made in `arena`)
+        const Hittable* finishBvh(const FlatBvh<Triangle>& bvh);
 
         // Finds all meshes contained in the node and its children
-        // and adds them to the vector `meshes`
-        void processNode(aiNode *node, const aiScene *scene);
+        // and adds them to `assimpMeshes`
+        void processNode(aiNode *node, const aiScene *scene, std::vector<aiMesh*>& assimpMeshes);
+
+        // Creates one material per assimp material, and sets `infos` to their
+        // descriptions. Texture images are only registered in `loadedTexImages`, not loaded.
+        std::vector<const Material*> loadMaterials(const aiScene *assimpScene,
+                                                   std::vector<comUtils::materials::MaterialInfo>& infos);
+
+        // Description of an assimp material, completed with the illumination
+        // model in the .mtl file
+        comUtils::materials::MaterialInfo materialInfo(aiMaterial *assimpMat);
 
-        Mesh processMesh(aiMesh *assimpMesh, const aiScene *scene);
+        // Creates the material described by `info`. Its texture image, if any,
+        // is only registered in `loadedTexImages`, not loaded.
+        const Material* makeMaterial(const comUtils::materials::MaterialInfo& info);
 
-        // Loads material (1 per-mesh) for the specified mesh
-        shared_ptr<Material> loadMaterial(aiMesh *assimpMesh, const aiScene *assimpScene);
+        // Texture of image file `fileName` (relative to the .obj file's directory)
+        const ImageTexture* loadTexture(const std::string& fileName);
 
-        const std::shared_ptr<ImageTexture> loadTexture(aiMaterial *material, aiTextureType texType);
-};
\ No newline at end of file
+        // Decodes all images in `loadedTexImages`, in parallel
+        void loadTexImages();
+};
@@ -17,10 +17,53 @@
 // Directory for output file
 #define OUTPUT_DIR "images"
 
+// Directory for the tiled texture files made by the texture cache
+#define TEXTURE_CACHE_DIR "cache/textures"
+
 // Specifies whether the y-axis should be flipped for image coordinates
 // when reading from textures
 #define FLIP_Y_AXIS_TEXTURE
 
+// Image textures are filtered trilinearly across mip levels, picked from the
+// footprint of the ray at the hit point. Comment out to filter bilinearly
+// on the full resolution image instead.
+#define TRILINEAR_TEXTURE_FILTERING
+
+// Models are read by the native .obj loader when possible (see objLoader.hpp),
+// and by assimp otherwise. Comment out to always use assimp.
+#define NATIVE_OBJ_LOADER
+
+// Models are written to a binary scene cache (a .ptscene file next to the .obj
+// file) along with their BVH, and read back from it while it's up to date,
+// skipping parsing and BVH construction. Comment out to always load models from scratch.
+#define SCENE_CACHE
+
+// Triangles store their vertex normals in octahedral encoding (2x16 bits) and their
+// texture coordinates as 16-bit fixed point values, and decode them when shading.
+// Saves 32 bytes per triangle, at the cost of a slight loss of precision.
+// Uncomment to enable.
+// #define COMPACT_VERTICES
+
+// Scenes are rendered with a compressed wide BVH (see compressedBvh.hpp): 8-wide
+// nodes with child boxes quantized to 8 bits, instead of binary nodes with float
+// boxes. Uncomment to enable.
+// #define COMPRESSED_BVH
+
+// Each rendering thread counts rays, BVH traversal work and how paths end, and
+// the counters are reported at the end of the render (a summary, and a JSON file
+// next to the image, see renderStats.hpp). Uncomment to enable.
+// #define RENDER_STATS
+
+// Loading, BVH builds, the sub-images rendered by each thread and image writing
+// are recorded as events on a timeline, written at exit to a Chrome trace file
+// next to the image, for Perfetto (see trace.hpp). Uncomment to enable.
+// #define TRACE_EVENTS
+
+// The BVH nodes visited, primitives tested and time spent by each pixel are
+// written next to the image as false-colour PNGs and raw floats (.pfm), to find
+// the geometry that makes a scene slow (see costHeatmap.hpp). Uncomment to enable.
+// #define COST_HEATMAP
+
 // Vectors, points, colors
 using Vec3 = glm::vec3;
 using Point3 = Vec3; // (distinct names for geometric clarity)
@@ -0,0 +1,373 @@
+#include "objLoader.hpp"
+#include "utilities.hpp"
+
+#include <algorithm>
+#include <charconv>
+#include <cstring>
+#include <memory_resource>
+#include <unordered_map>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+namespace objLoader {
+
+namespace {
+
+// Size of the chunks the file is split into (they end at the end of a line)
+const size_t chunkSize = 256 * 1024;
+
+// A face corner: 0-based indices of its position, texture coordinates and normal
+// (-1 if absent). Until all chunks are parsed, indices given relative to the end
+// of a list are stored relative to the chunk's start, and flagged in `relative`.
+struct Corner {
+    int32_t v, vt, vn;
+    uint8_t relative;
+    bool operator==(const Corner& o) const { return v == o.v && vt == o.vt && vn == o.vn; }
+};
+const uint8_t relativeV = 1, relativeVt = 2, relativeVn = 4;
+
+struct CornerHash {
+    size_t operator()(const Corner& c) const {
+        uint64_t h = uint32_t(c.v);
+        h = h * 0x9E3779B97F4A7C15ull ^ uint32_t(c.vt);
+        h = h * 0x9E3779B97F4A7C15ull ^ uint32_t(c.vn);
+        return h ^ (h >> 29);
+    }
+};
+
+// What's parsed from a chunk of the file
+struct Chunk {
+    const char* begin;
+    const char* end;
+    std::vector<Point3> positions;
+    std::vector<glm::vec2> texCoords;
+    std::vector<Vec3> normals;
+    std::vector<Corner> corners;
+    // End of each face's corners in `corners`
+    std::vector<uint32_t> faceEnds;
+    // `usemtl` lines: index of the first face they apply to, and material name
+    std::vector<std::pair<size_t, std::string>> materialChanges;
+    // Index of the chunk's first position, texture coordinates and normal in the file
+    size_t firstPosition = 0, firstTexCoords = 0, firstNormal = 0;
+    bool ok = true;
+};
+
+// Faces [begin, end) of a chunk
+struct FaceRange {
+    size_t chunk;
+    size_t begin;
+    size_t end;
+};
+
+const char* skipSpaces(const char* p, const char* end) {
+    while (p < end && (*p == ' ' || *p == '\t')) p++;
+    return p;
+}
+
+bool parseFloat(const char*& p, const char* end, float& x) {
+    p = skipSpaces(p, end);
+    // from_chars doesn't accept a leading '+'
+    if (p < end && *p == '+') p++;
+    std::from_chars_result r = std::from_chars(p, end, x);
+    if (r.ec != std::errc()) return false;
+    p = r.ptr;
+    return true;
+}
+
+bool parseInt(const char*& p, const char* end, int64_t& x) {
+    bool negative = false;
+    if (p < end && (*p == '-' || *p == '+')) negative = (*p++ == '-');
+    if (p == end || *p < '0' || *p > '9') return false;
+    x = 0;
+    while (p < end && *p >= '0' && *p <= '9') x = x * 10 + (*p++ - '0');
+    if (negative) x = -x;
+    return true;
+}
+
+// Converts a 1-based .obj index (negative if relative to the end of the list,
+// whose size so far in the chunk is `count`). Returns false for index 0.
+bool convertIndex(int64_t index, size_t count, int32_t& converted, bool& relative) {
+    if (index == 0) return false;
+    relative = index < 0;
+    converted = int32_t(relative ? int64_t(count) + index : index - 1);
+    return true;
+}
+
+// Parses a face corner: v, v/vt, v//vn or v/vt/vn
+bool parseCorner(const char*& p, const char* end, const Chunk& chunk, Corner& c) {
+    int64_t index;
+    bool relative;
+    c = {-1, -1, -1, 0};
+    if (!parseInt(p, end, index) || !convertIndex(index, chunk.positions.size(), c.v, relative)) {
+        return false;
+    }
+    if (relative) c.relative |= relativeV;
+    if (p == end || *p != '/') return true;
+    p++;
+    if (p < end && *p != '/') {
+        if (!parseInt(p, end, index) || !convertIndex(index, chunk.texCoords.size(), c.vt, relative)) {
+            return false;
+        }
+        if (relative) c.relative |= relativeVt;
+    }
+    if (p == end || *p != '/') return true;
+    p++;
+    if (!parseInt(p, end, index) || !convertIndex(index, chunk.normals.size(), c.vn, relative)) {
+        return false;
+    }
+    if (relative) c.relative |= relativeVn;
+    return true;
+}
+
+// Parses one line (without its end of line). Returns false if it isn't supported.
+bool parseLine(const char* p, const char* end, Chunk& chunk) {
+    p = skipSpaces(p, end);
+    const char* keyword = p;
+    while (p < end && *p != ' ' && *p != '\t') p++;
+    size_t length = p - keyword;
+    if (length == 0 || *keyword == '#') return true;
+    auto is = [&](const char* k) { return length == strlen(k) && memcmp(keyword, k, length) == 0; };
+
+    if (is("v")) {
+        Point3 v;
+        if (!parseFloat(p, end, v.x) || !parseFloat(p, end, v.y) || !parseFloat(p, end, v.z)) {
+            return false;
+        }
+        chunk.positions.push_back(v);
+    } else if (is("vt")) {
+        glm::vec2 t(0.0f);
+        if (!parseFloat(p, end, t.x)) return false;
+        // The second coordinate is optional
+        if (!parseFloat(p, end, t.y)) t.y = 0.0f;
+        chunk.texCoords.push_back(t);
+    } else if (is("vn")) {
+        Vec3 n;
+        if (!parseFloat(p, end, n.x) || !parseFloat(p, end, n.y) || !parseFloat(p, end, n.z)) {
+            return false;
+        }
+        chunk.normals.push_back(n);
+    } else if (is("f")) {
+        size_t numberOfCorners = 0;
+        while ((p = skipSpaces(p, end)) < end) {
+            Corner c;
+            if (!parseCorner(p, end, chunk, c)) return false;
+            chunk.corners.push_back(c);
+            numberOfCorners++;
+        }
+        if (numberOfCorners < 3) return false;
+        chunk.faceEnds.push_back(chunk.corners.size());
+    } else if (is("usemtl")) {
+        p = skipSpaces(p, end);
+        const char* nameEnd = end;
+        while (nameEnd > p && (nameEnd[-1] == ' ' || nameEnd[-1] == '\t')) nameEnd--;
+        chunk.materialChanges.emplace_back(chunk.faceEnds.size(), std::string(p, nameEnd));
+    } else if (!(is("o") || is("g") || is("s") || is("mtllib"))) {
+        // Faces are grouped by material only, so objects, groups and smoothing
+        // groups can be ignored. Anything else isn't supported.
+        return false;
+    }
+    return true;
+}
+
+void parseChunk(Chunk& chunk) {
+    const char* p = chunk.begin;
+    while (p < chunk.end) {
+        const char* lineEnd = static_cast<const char*>(memchr(p, '\n', chunk.end - p));
+        if (!lineEnd) lineEnd = chunk.end;
+        const char* next = lineEnd + (lineEnd < chunk.end);
+        if (lineEnd > p && lineEnd[-1] == '\r') lineEnd--;
+        // Lines continued with '\' aren't supported
+        if ((lineEnd > p && lineEnd[-1] == '\\') || !parseLine(p, lineEnd, chunk)) {
+            chunk.ok = false;
+            return;
+        }
+        p = next;
+    }
+}
+
+// Turns the chunk's indices into indices in the file's lists, and checks them
+bool resolveIndices(Chunk& chunk, size_t positions, size_t texCoords, size_t normals) {
+    auto resolve = [](int32_t& index, bool relative, size_t first, size_t count) {
+        if (relative) index += int32_t(first);
+        return index >= (relative ? 0 : -1) && index < int64_t(count);
+    };
+    for (Corner& c : chunk.corners) {
+        if (!resolve(c.v, c.relative & relativeV, chunk.firstPosition, positions) || c.v < 0
+            || !resolve(c.vt, c.relative & relativeVt, chunk.firstTexCoords, texCoords)
+            || !resolve(c.vn, c.relative & relativeVn, chunk.firstNormal, normals)) {
+            return false;
+        }
+        c.relative = 0;
+    }
+    return true;
+}
+
+// Looks up the data of the file's vertex lists, spread across chunks
+template <typename T>
+class ChunkedList {
+    public:
+        ChunkedList(const std::vector<Chunk>& chunks, std::vector<T> Chunk::*list) {
+            size_t count = 0;
+            for (const Chunk& chunk : chunks) {
+                const std::vector<T>& l = chunk.*list;
+                if (l.empty()) continue;
+                firsts.push_back(count);
+                lists.push_back(&l);
+                count += l.size();
+            }
+        }
+
+        const T& operator[](size_t index) const {
+            size_t i = std::upper_bound(firsts.begin(), firsts.end(), index) - firsts.begin() - 1;
+            return (*lists[i])[index - firsts[i]];
+        }
+
+    private:
+        std::vector<size_t> firsts;
+        std::vector<const std::vector<T>*> lists;
+};
+
+// Builds the indexed triangles of the faces in `ranges`
+void buildMesh(const std::vector<Chunk>& chunks, const std::vector<FaceRange>& ranges, ObjMesh& mesh) {
+    ChunkedList<Point3> positions(chunks, &Chunk::positions);
+    ChunkedList<glm::vec2> texCoords(chunks, &Chunk::texCoords);
+    ChunkedList<Vec3> normals(chunks, &Chunk::normals);
+
+    size_t numberOfTriangles = 0;
+    for (const FaceRange& r : ranges) {
+        const Chunk& chunk = chunks[r.chunk];
+        size_t firstCorner = (r.begin > 0) ? chunk.faceEnds[r.begin - 1] : 0;
+        numberOfTriangles += (chunk.faceEnds[r.end - 1] - firstCorner) - 2 * (r.end - r.begin);
+    }
+    mesh.indices.reserve(3 * numberOfTriangles);
+    mesh.vertices.reserve(numberOfTriangles);
+
+    // Corners sharing position, texture coordinates and normal share a vertex.
+    // The map's nodes are never freed one by one: take them from a monotonic buffer,
+    // rather than making one heap allocation per vertex.
+    std::pmr::monotonic_buffer_resource nodeMemory;
+    std::pmr::unordered_map<Corner, uint32_t, CornerHash> vertexIndices(&nodeMemory);
+    vertexIndices.reserve(numberOfTriangles);
+    auto makeVertex = [&](const Corner& c) {
+        Vertex vertex;
+        vertex.position = positions[c.v];
+        if (c.vt >= 0) vertex.texCoords = texCoords[c.vt];
+        if (c.vn >= 0) vertex.normal = normals[c.vn];
+        return vertex;
+    };
+
+    for (const FaceRange& r : ranges) {
+        const Chunk& chunk = chunks[r.chunk];
+        for (size_t face = r.begin; face < r.end; face++) {
+            const Corner* corners = chunk.corners.data() + ((face > 0) ? chunk.faceEnds[face - 1] : 0);
+            size_t numberOfCorners = chunk.corners.data() + chunk.faceEnds[face] - corners;
+            // Triangulate as a fan around the first corner
+            for (size_t k = 1; k + 1 < numberOfCorners; k++) {
+                const Corner* triangle[3] = {&corners[0], &corners[k], &corners[k + 1]};
+                if (triangle[0]->vn < 0 || triangle[1]->vn < 0 || triangle[2]->vn < 0) {
+                    // No normals: the vertices get the face normal, so they can't be shared
+                    Vertex v[3];
+                    for (int j = 0; j < 3; j++) v[j] = makeVertex(*triangle[j]);
+                    Vec3 normal = glm::cross(v[1].position - v[0].position, v[2].position - v[0].position);
+                    float length = glm::length(normal);
+                    for (int j = 0; j < 3; j++) {
+                        if (length > 0) v[j].normal = normal / length;
+                        mesh.indices.push_back(mesh.vertices.size());
+                        mesh.vertices.push_back(v[j]);
+                    }
+                    continue;
+                }
+                for (int j = 0; j < 3; j++) {
+                    auto [it, inserted] = vertexIndices.try_emplace(*triangle[j], mesh.vertices.size());
+                    if (inserted) mesh.vertices.push_back(makeVertex(*triangle[j]));
+                    mesh.indices.push_back(it->second);
+                }
+            }
+        }
+    }
+}
+
+}
+
+bool load(const std::string& filePath, std::vector<ObjMesh>& meshes) {
+    int fd = open(filePath.c_str(), O_RDONLY);
+    if (fd < 0) return false;
+    off_t length = lseek(fd, 0, SEEK_END);
+    void* base = (length > 0) ? mmap(nullptr, length, PROT_READ, MAP_PRIVATE, fd, 0) : MAP_FAILED;
+    close(fd);
+    if (base == MAP_FAILED) return false;
+    // Chunks are read concurrently: have the whole file read ahead
+    madvise(base, length, MADV_WILLNEED);
+    const char* data = static_cast<const char*>(base);
+    const char* dataEnd = data + length;
+
+    // Split the file in chunks of whole lines
+    std::vector<Chunk> chunks;
+    for (const char* p = data; p < dataEnd;) {
+        const char* end = (dataEnd - p > ptrdiff_t(chunkSize)) ? p + chunkSize : dataEnd;
+        const char* newline = static_cast<const char*>(memchr(end, '\n', dataEnd - end));
+        end = newline ? newline + 1 : dataEnd;
+        Chunk& chunk = chunks.emplace_back();
+        chunk.begin = p;
+        chunk.end = end;
+        p = end;
+    }
+
+    parallelFor(chunks.size(), [&](size_t i) { parseChunk(chunks[i]); });
+    munmap(base, length);
+
+    // Where each chunk's vertex data starts in the file's lists
+    size_t positions = 0, texCoords = 0, normals = 0;
+    for (Chunk& chunk : chunks) {
+        if (!chunk.ok) return false;
+        chunk.firstPosition = positions;
+        chunk.firstTexCoords = texCoords;
+        chunk.firstNormal = normals;
+        positions += chunk.positions.size();
+        texCoords += chunk.texCoords.size();
+        normals += chunk.normals.size();
+    }
+    if (positions > size_t(INT32_MAX)) return false;
+    std::vector<char> resolved(chunks.size());
+    parallelFor(chunks.size(), [&](size_t i) {
+        resolved[i] = resolveIndices(chunks[i], positions, texCoords, normals);
+    });
+    for (char ok : resolved) {
+        if (!ok) return false;
+    }
+
+    // Group faces by material, in the order the materials are first used
+    std::vector<std::string> materialNames;
+    std::vector<std::vector<FaceRange>> meshRanges;
+    std::unordered_map<std::string, size_t> meshIndices;
+    std::string material;
+    auto addRange = [&](size_t chunk, size_t begin, size_t end) {
+        if (begin == end) return;
+        auto [it, inserted] = meshIndices.try_emplace(material, meshRanges.size());
+        if (inserted) {
+            materialNames.push_back(material);
+            meshRanges.emplace_back();
+        }
+        meshRanges[it->second].push_back({chunk, begin, end});
+    };
+    for (size_t i = 0; i < chunks.size(); i++) {
+        size_t begin = 0;
+        for (const auto& [firstFace, name] : chunks[i].materialChanges) {
+            addRange(i, begin, firstFace);
+            material = name;
+            begin = firstFace;
+        }
+        addRange(i, begin, chunks[i].faceEnds.size());
+    }
+
+    meshes.clear();
+    meshes.resize(meshRanges.size());
+    parallelFor(meshes.size(), [&](size_t i) {
+        meshes[i].materialName = materialNames[i];
+        buildMesh(chunks, meshRanges[i], meshes[i]);
+    });
+    return true;
+}
+
+}
@@ -0,0 +1,29 @@
+#pragma once
+
+#include "myPT.hpp"
+#include "triangle.hpp"
+
+#include <cstdint>
+
+// Fast path for loading Wavefront .obj files without assimp: the file is
+// memory-mapped and split in chunks of whole lines, which are parsed in parallel,
+// and faces are written directly as indexed triangle meshes.
+namespace objLoader {
+
+    // All faces of the file sharing a material, as indexed triangles
+    struct ObjMesh {
+        // Name given by `usemtl` (empty for faces before any `usemtl`)
+        std::string materialName;
+        std::vector<Vertex> vertices;
+        // Three per triangle
+        std::vector<uint32_t> indices;
+    };
+
+    // Loads the faces of .obj file `filePath`, grouped by material, in order of
+    // first use. Polygons are triangulated as fans; faces without normals get
+    // the face normal.
+    // Returns false if the file can't be read, is malformed, or uses features
+    // this loader doesn't support (lines, points, free-form geometry...):
+    // callers should then fall back to assimp.
+    bool load(const std::string& filePath, std::vector<ObjMesh>& meshes);
+}
@@ -0,0 +1,91 @@
+#include "radianceCache.hpp"
+
+#include <algorithm>
+#include <cmath>
+
+namespace {
+    // Number of cells in the table
+    const size_t tableSize = size_t(1) << 18;
+    // Cells a key is looked for in, from the one it hashes to
+    const int maxProbes = 8;
+    // Width of the cells, in pixels where the camera sees them
+    const float cellPixels = 8.0f;
+    // Records a cell needs before it's used
+    const uint32_t minRecords = 16;
+    // Fixed point scale of the sums of radiance
+    const float fixedPointScale = float(1 << 20);
+    // Recorded radiance is clamped to this, so that a few very bright records
+    // (e.g. from paths that found a small emitter) don't overflow the sums
+    const float maxRadiance = 1e4f;
+}
+
+radianceCache::HashGrid::HashGrid(const Point3& cameraCenter, float pixelSpreadAngle)
+    : cells(tableSize), cameraCenter(cameraCenter), pixelSpreadAngle(pixelSpreadAngle) {}
+
+float radianceCache::HashGrid::cellSize(const Point3& p) const {
+    float size = cellPixels * pixelSpreadAngle * glm::length(p - cameraCenter);
+    // Rounded up to a power of two, so that cells of a size tile space
+    return std::ldexp(1.0f, std::clamp(int(std::ceil(std::log2(size))), -60, 60));
+}
+
+uint64_t radianceCache::HashGrid::key(const Point3& p, const Vec3& normal) const {
+    float size = cellSize(p);
+    int level;
+    std::frexp(size, &level);
+    // Dominant axis of the normal, and its sign
+    Vec3 a = glm::abs(normal);
+    int axis = a.x > a.y ? (a.x > a.z ? 0 : 2) : (a.y > a.z ? 1 : 2);
+    uint64_t h = uint32_t(level + 64) | uint32_t(axis * 2 + (normal[axis] < 0)) << 8;
+    for (int i = 0; i < 3; i++) {
+        h = h * 0x9E3779B97F4A7C15ull ^ uint32_t(int32_t(std::floor(p[i] / size)));
+    }
+    h ^= h >> 29;
+    return h ? h : 1;
+}
+
+radianceCache::HashGrid::Cell* radianceCache::HashGrid::find(uint64_t key, bool insert) {
+    size_t mask = cells.size() - 1;
+    for (int probe = 0; probe < maxProbes; probe++) {
+        Cell& cell = cells[(key + probe) & mask];
+        uint64_t found = cell.key.load(std::memory_order_relaxed);
+        if (found == key) return &cell;
+        if (found != 0) continue;
+        if (!insert) return nullptr;
+        // Free: claim it, unless another thread just did (for this key or another)
+        if (cell.key.compare_exchange_strong(found, key, std::memory_order_relaxed) || found == key) {
+            return &cell;
+        }
+    }
+    return nullptr;
+}
+
+void radianceCache::HashGrid::record(const Point3& p, const Vec3& normal, const Color& radiance) {
+    if (!std::isfinite(radiance.r + radiance.g + radiance.b)) return;
+    Cell* cell = find(key(p, normal), true);
+    if (!cell) return;
+    for (int i = 0; i < 3; i++) {
+        float value = std::clamp(radiance[i], 0.0f, maxRadiance);
+        cell->sums[i].fetch_add(uint64_t(value * fixedPointScale), std::memory_order_relaxed);
+    }
+    // Releases the sums along with the count
+    cell->count.fetch_add(1, std::memory_order_release);
+}
+
+bool radianceCache::HashGrid::lookup(const Point3& p, const Vec3& normal, Color& radiance) const {
+    const Cell* cell = find(key(p, normal));
+    if (!cell) return false;
+    // Records may be added concurrently: the count is read first, so that the
+    // sums include at least the records it counts
+    uint32_t count = cell->count.load(std::memory_order_acquire);
+    if (count < minRecords) return false;
+    for (int i = 0; i < 3; i++) {
+        radiance[i] = float(cell->sums[i].load(std::memory_order_relaxed)) / (fixedPointScale * count);
+    }
+    return true;
+}
+
+size_t radianceCache::HashGrid::numberOfCells() const {
+    size_t n = 0;
+    for (const Cell& cell : cells) n += cell.key.load(std::memory_order_relaxed) != 0;
+    return n;
+}
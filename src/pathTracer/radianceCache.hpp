@@ -0,0 +1,65 @@
+#pragma once
+
+#include "myPT.hpp"
+
+#include <atomic>
+#include <cstdint>
+
+// RADIANCE CACHE
+// World-space cache of the light reflected by diffuse surfaces, in a spatial
+// hash grid: each cell is keyed by its integer coordinates, its size and the
+// dominant axis of the surface's normal (so that the two sides of a wall don't
+// share cells), and found in a fixed-size table by linear probing. Cells are
+// sized to cover a few pixels where the camera sees them, so they're finer
+// close to the camera.
+// Paths record the light reflected at each diffuse vertex as they're traced,
+// and, with the cache enabled, stop after a few bounces at a cell that has
+// enough records, taking its mean instead of tracing further. Much faster,
+// but biased: the cache blurs lighting over cells, and it's made of paths
+// that were themselves cut short.
+// Recording is lock-free: cells are claimed with an atomic compare-and-swap of
+// their key, and accumulate radiance in 64-bit fixed point with atomic additions.
+namespace radianceCache {
+    class HashGrid {
+        public:
+            // Cells are sized for a camera at `cameraCenter` whose pixels
+            // subtend `pixelSpreadAngle`
+            HashGrid(const Point3& cameraCenter, float pixelSpreadAngle);
+
+            // Width of the cells at `p`
+            float cellSize(const Point3& p) const;
+
+            // Adds `radiance`, reflected at `p` on a surface with normal `normal`,
+            // to its cell (dropped if the table is full around the cell)
+            void record(const Point3& p, const Vec3& normal, const Color& radiance);
+            // Mean radiance recorded in the cell of `p` and `normal`, if it has
+            // enough records to be used (returns false otherwise)
+            bool lookup(const Point3& p, const Vec3& normal, Color& radiance) const;
+
+            // Cells that have records
+            size_t numberOfCells() const;
+            // Memory used by the table, in bytes
+            size_t memoryUsage() const { return cells.size() * sizeof(Cell); }
+
+        private:
+            struct Cell {
+                // Key of the cell's coordinates (0 for free cells)
+                std::atomic<uint64_t> key{0};
+                // Sums of the recorded radiance, in fixed point
+                std::atomic<uint64_t> sums[3] = {};
+                std::atomic<uint32_t> count{0};
+            };
+            // Size is a power of two
+            std::vector<Cell> cells;
+
+            Point3 cameraCenter;
+            float pixelSpreadAngle;
+
+            // Key of the cell of `p` and `normal` (never 0)
+            uint64_t key(const Point3& p, const Vec3& normal) const;
+            // Cell with `key`, which is claimed if it isn't in the table yet and
+            // `insert` is set (null if it isn't found)
+            Cell* find(uint64_t key, bool insert);
+            const Cell* find(uint64_t key) const { return const_cast<HashGrid*>(this)->find(key, false); }
+    };
+}
@@ -0,0 +1,146 @@
+#include "renderStats.hpp"
+
+#include <fstream>
+#include <iomanip>
+#include <mutex>
+
+void renderStats::Counters::merge(const Counters& other) {
+    for (int i = 0; i < numberOfRayTypes; i++) rays[i] += other.rays[i];
+    nodesVisited += other.nodesVisited;
+    primitiveTests += other.primitiveTests;
+    for (int i = 0; i <= maxPathLength; i++) pathLengths[i] += other.pathLengths[i];
+    for (int i = 0; i < numberOfTerminations; i++) terminations[i] += other.terminations[i];
+    samples += other.samples;
+    if (samplesPerSecond.size() < other.samplesPerSecond.size()) {
+        samplesPerSecond.resize(other.samplesPerSecond.size(), 0);
+    }
+    for (size_t i = 0; i < other.samplesPerSecond.size(); i++) samplesPerSecond[i] += other.samplesPerSecond[i];
+}
+
+#ifdef RENDER_STATS
+
+namespace {
+    using Clock = std::chrono::steady_clock;
+
+    Clock::time_point start = Clock::now();
+    // Merged counters of the threads that are done, and each of them on its own
+    renderStats::Counters totals;
+    std::vector<renderStats::Counters> threads;
+    std::mutex mutex;
+
+    const char* rayTypeNames[renderStats::numberOfRayTypes] = {"primary", "secondary", "shadow"};
+    const char* terminationNames[renderStats::numberOfTerminations] = {"depthLimit", "miss", "absorbed", "roulette", "cache"};
+
+    double percent(uint64_t part, uint64_t total) { return total ? 100.0 * part / total : 0.0; }
+
+    void writeArray(std::ostream& out, const uint64_t* values, size_t n) {
+        out << "[";
+        for (size_t i = 0; i < n; i++) out << (i ? ", " : "") << values[i];
+        out << "]";
+    }
+
+    void writeCounters(std::ostream& out, const renderStats::Counters& c, const std::string& indent) {
+        uint64_t rays = 0;
+        for (uint64_t n : c.rays) rays += n;
+        out << "{\n" << indent << "  \"rays\": {";
+        for (int i = 0; i < renderStats::numberOfRayTypes; i++) {
+            out << (i ? ", " : "") << "\"" << rayTypeNames[i] << "\": " << c.rays[i];
+        }
+        out << ", \"total\": " << rays << "},\n"
+            << indent << "  \"nodesVisited\": " << c.nodesVisited << ",\n"
+            << indent << "  \"primitiveTests\": " << c.primitiveTests << ",\n"
+            << indent << "  \"nodesPerRay\": " << (rays ? double(c.nodesVisited) / rays : 0.0) << ",\n"
+            << indent << "  \"testsPerRay\": " << (rays ? double(c.primitiveTests) / rays : 0.0) << ",\n"
+            << indent << "  \"pathLengths\": ";
+        writeArray(out, c.pathLengths, renderStats::maxPathLength + 1);
+        out << ",\n" << indent << "  \"terminations\": {";
+        for (int i = 0; i < renderStats::numberOfTerminations; i++) {
+            out << (i ? ", " : "") << "\"" << terminationNames[i] << "\": " << c.terminations[i];
+        }
+        out << "},\n" << indent << "  \"samples\": " << c.samples << ",\n"
+            << indent << "  \"samplesPerSecond\": ";
+        writeArray(out, c.samplesPerSecond.data(), c.samplesPerSecond.size());
+        out << "\n" << indent << "}";
+    }
+}
+
+void renderStats::countSamples(uint64_t n) {
+    Counters& counters = details::counters;
+    counters.samples += n;
+    size_t second = std::chrono::duration_cast<std::chrono::seconds>(Clock::now() - start).count();
+    if (counters.samplesPerSecond.size() <= second) counters.samplesPerSecond.resize(second + 1, 0);
+    counters.samplesPerSecond[second] += n;
+}
+
+void renderStats::begin() {
+    std::lock_guard<std::mutex> lock(mutex);
+    start = Clock::now();
+    totals = Counters();
+    threads.clear();
+}
+
+void renderStats::finishThread() {
+    std::lock_guard<std::mutex> lock(mutex);
+    totals.merge(details::counters);
+    threads.push_back(details::counters);
+    details::counters = Counters();
+}
+
+void renderStats::report(const std::string& jsonPath) {
+    std::lock_guard<std::mutex> lock(mutex);
+    double seconds = std::chrono::duration<double>(Clock::now() - start).count();
+    uint64_t rays = 0;
+    for (uint64_t n : totals.rays) rays += n;
+    uint64_t paths = 0, pathRays = 0;
+    for (int i = 0; i <= maxPathLength; i++) {
+        paths += totals.pathLengths[i];
+        pathRays += i * totals.pathLengths[i];
+    }
+
+    std::streamsize precision = std::clog.precision(3);
+    std::clog << "Render statistics (" << threads.size() << " threads, " << seconds << " s)\n"
+              << "  rays:   " << rays;
+    for (int i = 0; i < numberOfRayTypes; i++) {
+        std::clog << (i ? ", " : " (") << rayTypeNames[i] << " " << percent(totals.rays[i], rays) << "%";
+    }
+    std::clog << ")\n"
+              << "  BVH:    " << (rays ? double(totals.nodesVisited) / rays : 0.0) << " nodes visited, "
+              << (rays ? double(totals.primitiveTests) / rays : 0.0) << " primitives tested per ray\n"
+              << "  paths:  " << paths << ", " << (paths ? double(pathRays) / paths : 0.0) << " rays long on average";
+    for (int i = 0; i < numberOfTerminations; i++) {
+        std::clog << (i ? ", " : " (ended by ") << terminationNames[i] << " " << percent(totals.terminations[i], paths) << "%";
+    }
+    std::clog << ")\n  length: ";
+    for (int i = 1; i <= maxPathLength; i++) {
+        if (totals.pathLengths[i] == 0) continue;
+        std::clog << i << (i == maxPathLength ? "+" : "") << ": " << percent(totals.pathLengths[i], paths) << "%  ";
+    }
+    std::clog << "\n  samples/s:";
+    // The last second is usually partial: left out of the rates
+    size_t fullSeconds = totals.samplesPerSecond.empty() ? 0 : totals.samplesPerSecond.size() - 1;
+    for (size_t i = 0; i < fullSeconds; i++) std::clog << " " << totals.samplesPerSecond[i];
+    std::clog << (fullSeconds ? "" : " -") << " (" << uint64_t(seconds > 0 ? totals.samples / seconds : 0.0) << " on average)\n";
+    for (size_t i = 0; i < threads.size(); i++) {
+        uint64_t threadRays = 0;
+        for (uint64_t n : threads[i].rays) threadRays += n;
+        std::clog << "  thread #" << i + 1 << ": " << threadRays << " rays, " << threads[i].samples << " samples\n";
+    }
+    std::clog.precision(precision);
+
+    std::ofstream file(jsonPath);
+    if (!file) {
+        std::clog << "Failed writing render statistics to " << jsonPath << "\n";
+        return;
+    }
+    file << "{\n  \"seconds\": " << seconds << ",\n  \"totals\": ";
+    writeCounters(file, totals, "  ");
+    file << ",\n  \"threads\": [";
+    for (size_t i = 0; i < threads.size(); i++) {
+        file << (i ? ", " : "");
+        writeCounters(file, threads[i], "  ");
+    }
+    file << "]\n}\n";
+    std::clog << "Render statistics written to " << jsonPath << "\n";
+}
+
+#endif
@@ -0,0 +1,83 @@
+#pragma once
+
+#include "myPT.hpp"
+#include "costHeatmap.hpp"
+
+#include <algorithm>
+#include <cstdint>
+
+// RENDER STATISTICS
+// Counters of the work done by a render: rays by type, BVH nodes visited and
+// primitives tested, path lengths and how paths ended, and samples finished
+// over time. Each thread counts in its own (thread-local) counters, with no
+// synchronization, and merges them into the totals when it's done.
+// Counting is only compiled in with RENDER_STATS (see myPT.hpp): otherwise the
+// functions below are empty, and calls to them compile to nothing.
+namespace renderStats {
+    enum RayType { Primary, Secondary, Shadow, numberOfRayTypes };
+
+    // Why a path ended: at the bounce limit, on a ray that missed the scene,
+    // on a surface that doesn't scatter (e.g. an emitter), killed by Russian
+    // roulette, or at a cell of the radiance cache
+    enum Termination { DepthLimit, Miss, Absorbed, Roulette, Cached, numberOfTerminations };
+
+    // Paths with more rays than this are counted in the last bin of the histogram
+    const int maxPathLength = 32;
+
+    struct Counters {
+        uint64_t rays[numberOfRayTypes] = {};
+        // Over all closest-hit and any-hit queries
+        uint64_t nodesVisited = 0;
+        uint64_t primitiveTests = 0;
+        // Number of paths by number of rays along them (not counting shadow rays)
+        uint64_t pathLengths[maxPathLength + 1] = {};
+        uint64_t terminations[numberOfTerminations] = {};
+        uint64_t samples = 0;
+        // Samples finished in each second since the start of the render
+        std::vector<uint64_t> samplesPerSecond;
+
+        void merge(const Counters& other);
+    };
+
+#ifdef RENDER_STATS
+    namespace details {
+        inline thread_local Counters counters;
+    }
+
+    inline void countRay(RayType type) { details::counters.rays[type]++; }
+
+    // A BVH query that visited `nodes` nodes and tested `tests` primitives
+    // (also counted for the cost heatmap of the current pixel)
+    inline void countTraversal(uint32_t nodes, uint32_t tests) {
+        details::counters.nodesVisited += nodes;
+        details::counters.primitiveTests += tests;
+        costHeatmap::countTraversal(nodes, tests);
+    }
+
+    // A path that ended for `reason` after `length` rays
+    inline void countPath(Termination reason, int length) {
+        details::counters.terminations[reason]++;
+        details::counters.pathLengths[std::min(length, maxPathLength)]++;
+    }
+
+    // `n` samples finished by the calling thread
+    void countSamples(uint64_t n);
+
+    // Resets the totals, at the start of a render
+    void begin();
+
+    // Adds the counters of the calling thread to the totals, and resets them
+    void finishThread();
+
+    // Logs a summary of the totals, and writes them to `jsonPath`
+    void report(const std::string& jsonPath);
+#else
+    inline void countRay(RayType) {}
+    inline void countTraversal(uint32_t nodes, uint32_t tests) { costHeatmap::countTraversal(nodes, tests); }
+    inline void countPath(Termination, int) {}
+    inline void countSamples(uint64_t) {}
+    inline void begin() {}
+    inline void finishThread() {}
+    inline void report(const std::string&) {}
+#endif
+}
@@ -0,0 +1,92 @@
+#pragma once
+
+#include "myPT.hpp"
+
+#include <memory_resource>
+#include <type_traits>
+
+// Memory for everything that lives as long as a scene: primitives, BVH nodes,
+// materials and textures. Allocations are carved out of large blocks taken
+// from the heap, and are never freed one by one: all blocks are released at
+// once when the arena is destroyed.
+// Destructors are only run (at that point) for objects made with `make` whose
+// type needs one. Not thread-safe: scenes are built by a single thread.
+class SceneArena {
+    public:
+        struct Stats {
+            // Bytes handed out by the arena
+            size_t bytes;
+            // Blocks taken from the heap, and their total size
+            size_t blocks;
+            size_t blockBytes;
+            // Objects made with `make`
+            size_t objects;
+        };
+
+        SceneArena() : arena(initialBlockSize, &upstream) {}
+
+        ~SceneArena() {
+            // Objects may refer to the ones made before them: destroy in reverse order
+            for (auto it = destructors.rbegin(); it != destructors.rend(); ++it) it->second(it->first);
+        }
+
+        SceneArena(const SceneArena&) = delete;
+        SceneArena& operator=(const SceneArena&) = delete;
+
+        // Constructs a `T` in the arena. It's destroyed along with the arena.
+        template <typename T, typename... Args>
+        T* make(Args&&... args) {
+            T* object = new (allocate(sizeof(T), alignof(T))) T(std::forward<Args>(args)...);
+            if constexpr (!std::is_trivially_destructible_v<T>) {
+                destructors.push_back({object, [](void* p) { static_cast<T*>(p)->~T(); }});
+            }
+            objects++;
+            return object;
+        }
+
+        // For containers whose storage lives in the arena (e.g. `std::pmr::vector`)
+        std::pmr::memory_resource* resource() { return &counted; }
+
+        Stats stats() const { return {counted.bytes, upstream.blocks, upstream.bytes, objects}; }
+
+    private:
+        // Size of the first block (each new block is larger than the previous one)
+        static const size_t initialBlockSize = 64 * 1024;
+
+        // Forwards to another resource, counting allocations
+        class CountingResource : public std::pmr::memory_resource {
+            public:
+                CountingResource(std::pmr::memory_resource* target) : target(target) {}
+
+                size_t blocks = 0;
+                size_t bytes = 0;
+
+            private:
+                std::pmr::memory_resource* target;
+
+                void* do_allocate(size_t size, size_t alignment) override {
+                    blocks++;
+                    bytes += size;
+                    return target->allocate(size, alignment);
+                }
+
+                void do_deallocate(void* p, size_t size, size_t alignment) override {
+                    target->deallocate(p, size, alignment);
+                }
+
+                bool do_is_equal(const std::pmr::memory_resource& other) const noexcept override {
+                    return this == &other;
+                }
+        };
+
+        // Heap blocks taken by the arena
+        CountingResource upstream{std::pmr::new_delete_resource()};
+        std::pmr::monotonic_buffer_resource arena;
+        // What's handed out by the arena
+        CountingResource counted{&arena};
+        // Objects to destroy with the arena, in construction order
+        std::vector<std::pair<void*, void (*)(void*)>> destructors;
+        size_t objects = 0;
+
+        void* allocate(size_t size, size_t alignment) { return counted.allocate(size, alignment); }
+};
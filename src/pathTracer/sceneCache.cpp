@@ -0,0 +1,213 @@
+#include "sceneCache.hpp"
+
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+using comUtils::materials::MaterialInfo;
+
+SceneCache::~SceneCache() {
+    if (base) munmap(const_cast<unsigned char*>(base), length);
+}
+
+std::string SceneCache::cachePath(const std::string& objFilePath) {
+    return std::filesystem::path(objFilePath).replace_extension(".ptscene").string();
+}
+
+std::string SceneCache::mtlFilePath(const std::string& objFilePath) {
+    return std::filesystem::path(objFilePath).replace_extension(".mtl").string();
+}
+
+SceneCache::SourceStamp SceneCache::stamp(const std::string& filePath) {
+    namespace fs = std::filesystem;
+    std::error_code error;
+    uintmax_t size = fs::file_size(filePath, error);
+    if (error) return {-1, -1};
+    fs::file_time_type time = fs::last_write_time(filePath, error);
+    if (error) return {-1, -1};
+    return {int64_t(size), int64_t(time.time_since_epoch().count())};
+}
+
+bool SceneCache::open(const std::string& objFilePath) {
+    std::string path = cachePath(objFilePath);
+    int fd = ::open(path.c_str(), O_RDONLY);
+    if (fd < 0) return false;
+    off_t fileLength = lseek(fd, 0, SEEK_END);
+    void* mapped = (fileLength >= off_t(sizeof(Header)))
+                   ? mmap(nullptr, fileLength, PROT_READ, MAP_PRIVATE, fd, 0) : MAP_FAILED;
+    close(fd);
+    if (mapped == MAP_FAILED) return false;
+    base = static_cast<const unsigned char*>(mapped);
+    length = fileLength;
+
+    const Header& h = header();
+    auto fits = [this](const Section& s, size_t elementSize) {
+        return s.offset % alignment == 0 && s.offset <= length
+               && s.count <= (length - s.offset) / elementSize;
+    };
+    bool valid = std::memcmp(h.magic, "PTSCENE", 8) == 0
+                 && h.version == version
+                 && h.vertexSize == sizeof(Vertex) && h.nodeSize == sizeof(Node)
+                 && h.obj == stamp(objFilePath) && h.mtl == stamp(mtlFilePath(objFilePath))
+                 && fits(h.meshes, sizeof(MeshRecord)) && fits(h.strings, 1)
+                 && fits(h.vertices, sizeof(Vertex)) && fits(h.indices, sizeof(uint32_t))
+                 && fits(h.nodes, sizeof(Node)) && fits(h.leafOrder, sizeof(uint32_t));
+    // Every mesh must lie within the buffers, and every index must be in range,
+    // so that a damaged file can't make rendering read out of bounds
+    for (size_t i = 0; i < h.meshes.count && valid; i++) {
+        const MeshRecord& m = section<MeshRecord>(h.meshes)[i];
+        valid = m.firstVertex + m.numberOfVertices <= h.vertices.count
+                && m.firstIndex + m.numberOfIndices <= h.indices.count
+                && m.diffuseMapOffset + m.diffuseMapLength <= h.strings.count;
+        const uint32_t* indices = section<uint32_t>(h.indices) + m.firstIndex;
+        for (size_t j = 0; j < m.numberOfIndices && valid; j++) {
+            valid = indices[j] < m.numberOfVertices;
+        }
+    }
+    for (size_t i = 0; i < h.nodes.count && valid; i++) {
+        const Node& node = section<Node>(h.nodes)[i];
+        valid = (node.count > 0) ? node.index + size_t(node.count) <= h.leafOrder.count
+                                 : node.index > i + 1 && node.index < h.nodes.count && node.axis < 3;
+    }
+    // Nor overflow the traversal stack
+    valid = valid && FlatBvh<Triangle>::fitsTraversalStack(section<Node>(h.nodes), h.nodes.count);
+    for (size_t i = 0; i < h.leafOrder.count && valid; i++) {
+        valid = section<uint32_t>(h.leafOrder)[i] < h.leafOrder.count;
+    }
+    if (!valid) {
+        munmap(mapped, length);
+        base = nullptr;
+        length = 0;
+        return false;
+    }
+    // Everything will be read once, in order
+    madvise(mapped, length, MADV_WILLNEED);
+    return true;
+}
+
+size_t SceneCache::numberOfMeshes() const {
+    return header().meshes.count;
+}
+
+SceneCache::MeshData SceneCache::mesh(size_t index) const {
+    const MeshRecord& m = section<MeshRecord>(header().meshes)[index];
+    MeshData data;
+    data.material.model = static_cast<comUtils::materials::illModel>(m.model);
+    data.material.diffuse = glm::vec3(m.diffuse[0], m.diffuse[1], m.diffuse[2]);
+    data.material.specular = glm::vec3(m.specular[0], m.specular[1], m.specular[2]);
+    data.material.emissive = glm::vec3(m.emissive[0], m.emissive[1], m.emissive[2]);
+    data.material.shininess = m.shininess;
+    data.material.refractionIndex = m.refractionIndex;
+    data.material.diffuseMap.assign(section<char>(header().strings) + m.diffuseMapOffset, m.diffuseMapLength);
+    data.vertices = section<Vertex>(header().vertices) + m.firstVertex;
+    data.numberOfVertices = m.numberOfVertices;
+    data.indices = section<uint32_t>(header().indices) + m.firstIndex;
+    data.numberOfIndices = m.numberOfIndices;
+    return data;
+}
+
+const SceneCache::Node* SceneCache::nodes() const {
+    return section<Node>(header().nodes);
+}
+
+size_t SceneCache::numberOfNodes() const {
+    return header().nodes.count;
+}
+
+const uint32_t* SceneCache::leafOrder() const {
+    return section<uint32_t>(header().leafOrder);
+}
+
+size_t SceneCache::numberOfTriangles() const {
+    return header().leafOrder.count;
+}
+
+double SceneCache::coldMilliseconds() const {
+    return header().coldMilliseconds;
+}
+
+bool SceneCache::write(const std::string& objFilePath, const std::vector<MeshData>& meshes,
+                       const Node* nodes, size_t numberOfNodes,
+                       const std::vector<uint32_t>& leafOrder, double coldMilliseconds) {
+    Header h = {};
+    std::memcpy(h.magic, "PTSCENE", 8);
+    h.version = version;
+    h.vertexSize = sizeof(Vertex);
+    h.nodeSize = sizeof(Node);
+    h.obj = stamp(objFilePath);
+    h.mtl = stamp(mtlFilePath(objFilePath));
+    h.coldMilliseconds = coldMilliseconds;
+
+    std::vector<MeshRecord> records;
+    std::string strings;
+    size_t numberOfVertices = 0, numberOfIndices = 0;
+    for (const MeshData& mesh : meshes) {
+        const MaterialInfo& material = mesh.material;
+        MeshRecord r = {};
+        r.model = material.model;
+        for (int i = 0; i < 3; i++) {
+            r.diffuse[i] = material.diffuse[i];
+            r.specular[i] = material.specular[i];
+            r.emissive[i] = material.emissive[i];
+        }
+        r.shininess = material.shininess;
+        r.refractionIndex = material.refractionIndex;
+        r.diffuseMapOffset = strings.size();
+        r.diffuseMapLength = material.diffuseMap.size();
+        strings += material.diffuseMap;
+        r.firstVertex = numberOfVertices;
+        r.numberOfVertices = mesh.numberOfVertices;
+        r.firstIndex = numberOfIndices;
+        r.numberOfIndices = mesh.numberOfIndices;
+        numberOfVertices += mesh.numberOfVertices;
+        numberOfIndices += mesh.numberOfIndices;
+        records.push_back(r);
+    }
+
+    // Lay out the sections one after the other
+    uint64_t offset = sizeof(Header);
+    auto place = [&offset](Section& s, size_t count, size_t elementSize) {
+        offset = (offset + alignment - 1) / alignment * alignment;
+        s = {offset, count};
+        offset += count * elementSize;
+    };
+    place(h.meshes, records.size(), sizeof(MeshRecord));
+    place(h.strings, strings.size(), 1);
+    place(h.vertices, numberOfVertices, sizeof(Vertex));
+    place(h.indices, numberOfIndices, sizeof(uint32_t));
+    place(h.nodes, numberOfNodes, sizeof(Node));
+    place(h.leafOrder, leafOrder.size(), sizeof(uint32_t));
+
+    // Written under a temporary name, so that an interrupted write
+    // doesn't leave a truncated file behind
+    std::string path = cachePath(objFilePath);
+    std::string tempPath = path + ".tmp";
+    std::ofstream file(tempPath, std::ios::binary);
+    auto writeAt = [&file](uint64_t position, const void* data, size_t size) {
+        // Pad up to the start of the section
+        static const char zeros[alignment] = {};
+        file.write(zeros, position - uint64_t(file.tellp()));
+        file.write(static_cast<const char*>(data), size);
+    };
+    file.write(reinterpret_cast<const char*>(&h), sizeof(h));
+    writeAt(h.meshes.offset, records.data(), records.size() * sizeof(MeshRecord));
+    writeAt(h.strings.offset, strings.data(), strings.size());
+    for (size_t i = 0; i < meshes.size(); i++) {
+        uint64_t position = h.vertices.offset + records[i].firstVertex * sizeof(Vertex);
+        writeAt(position, meshes[i].vertices, meshes[i].numberOfVertices * sizeof(Vertex));
+    }
+    for (size_t i = 0; i < meshes.size(); i++) {
+        uint64_t position = h.indices.offset + records[i].firstIndex * sizeof(uint32_t);
+        writeAt(position, meshes[i].indices, meshes[i].numberOfIndices * sizeof(uint32_t));
+    }
+    writeAt(h.nodes.offset, nodes, numberOfNodes * sizeof(Node));
+    writeAt(h.leafOrder.offset, leafOrder.data(), leafOrder.size() * sizeof(uint32_t));
+    file.close();
+    if (!file) return false;
+    std::error_code error;
+    std::filesystem::rename(tempPath, path, error);
+    return !error;
+}
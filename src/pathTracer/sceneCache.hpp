@@ -0,0 +1,131 @@
+#pragma once
+
+#include "myPT.hpp"
+#include "flatBvh.hpp"
+
+#include <cstdint>
+
+// Binary cache of a model, written next to its .obj file once the model has been
+// loaded the slow way: the vertex and index buffers of each mesh, its material
+// (texture references included) and the flattened BVH over all triangles.
+// Later runs map the file and skip parsing and BVH construction.
+// The file is versioned and tied to the size and modification time of the .obj
+// and .mtl files: when either changes, it's ignored (and rewritten).
+class SceneCache {
+    public:
+        using Node = FlatBvh<Triangle>::Node;
+
+        // A mesh, as stored in the cache
+        struct MeshData {
+            comUtils::materials::MaterialInfo material;
+            const Vertex* vertices;
+            size_t numberOfVertices;
+            const uint32_t* indices;
+            size_t numberOfIndices;
+        };
+
+        SceneCache() {}
+
+        ~SceneCache();
+
+        SceneCache(const SceneCache&) = delete;
+        SceneCache& operator=(const SceneCache&) = delete;
+
+        // Path of the cache of model `objFilePath`
+        static std::string cachePath(const std::string& objFilePath);
+
+        // Size and modification time of a source file (-1 if it doesn't exist)
+        struct SourceStamp {
+            int64_t size;
+            int64_t modificationTime;
+            bool operator==(const SourceStamp& o) const {
+                return size == o.size && modificationTime == o.modificationTime;
+            }
+        };
+
+        static SourceStamp stamp(const std::string& filePath);
+
+        // Path of the .mtl file of model `objFilePath`
+        static std::string mtlFilePath(const std::string& objFilePath);
+
+        // Maps the cache of model `objFilePath`.
+        // Returns false if there isn't one, or if it's out of date.
+        bool open(const std::string& objFilePath);
+
+        size_t numberOfMeshes() const;
+
+        // Mesh number `index`. Its buffers point into the mapped file.
+        MeshData mesh(size_t index) const;
+
+        // BVH nodes, in `FlatBvh` order
+        const Node* nodes() const;
+        size_t numberOfNodes() const;
+
+        // For each BVH primitive, in the order leaves reference them, the index
+        // of its triangle, counting the triangles of all meshes in mesh order
+        const uint32_t* leafOrder() const;
+        size_t numberOfTriangles() const;
+
+        // Time taken to load the model and build its BVH without the cache,
+        // when the cache was written
+        double coldMilliseconds() const;
+
+        // Writes the cache of model `objFilePath`. Returns false on failure.
+        static bool write(const std::string& objFilePath, const std::vector<MeshData>& meshes,
+                          const Node* nodes, size_t numberOfNodes,
+                          const std::vector<uint32_t>& leafOrder, double coldMilliseconds);
+
+    private:
+        static const uint32_t version = 2;
+        // Sections of the file start at multiples of this
+        static const size_t alignment = 64;
+
+        // Location of an array in the file
+        struct Section {
+            uint64_t offset;
+            uint64_t count;
+        };
+
+        struct Header {
+            char magic[8];
+            uint32_t version;
+            // Sizes of the stored structures, so that a file written with
+            // a different layout is rejected
+            uint32_t vertexSize;
+            uint32_t nodeSize;
+            SourceStamp obj;
+            SourceStamp mtl;
+            double coldMilliseconds;
+            Section meshes;
+            // Characters of the texture file names
+            Section strings;
+            Section vertices;
+            Section indices;
+            Section nodes;
+            Section leafOrder;
+        };
+
+        struct MeshRecord {
+            int32_t model;
+            float diffuse[3];
+            float specular[3];
+            float emissive[3];
+            float shininess;
+            float refractionIndex;
+            // Diffuse texture file name, in the strings section
+            uint64_t diffuseMapOffset;
+            uint64_t diffuseMapLength;
+            uint64_t firstVertex;
+            uint64_t numberOfVertices;
+            uint64_t firstIndex;
+            uint64_t numberOfIndices;
+        };
+
+        const unsigned char* base = nullptr;
+        size_t length = 0;
+
+        const Header& header() const { return *reinterpret_cast<const Header*>(base); }
+
+        template <typename T>
+        const T* section(const Section& s) const { return reinterpret_cast<const T*>(base + s.offset); }
+};
@@ -1,11 +1,25 @@
 #include "scenes.hpp"
 
-using std::shared_ptr;
 using std::make_shared;
 
-shared_ptr<Hittable> ptScenes::externalModel(const std::string& objFilePath) {
-    Model model(objFilePath);
+namespace {
+    // BVH over `prims`, made in `arena` (compressed, with COMPRESSED_BVH defined)
+    template <typename Prim>
+    const Hittable* makeBvh(std::vector<Prim> prims, SceneArena& arena) {
+#ifdef COMPRESSED_BVH
+        FlatBvh<Prim> bvh(std::move(prims));
+        return arena.make<CompressedBvh<Prim>>(bvh, arena.resource());
+#else
+        return arena.make<FlatBvh<Prim>>(std::move(prims), nullptr, arena.resource());
+#endif
+    }
+}
+
+const Hittable* ptScenes::externalModel(const std::string& objFilePath, SceneArena& arena) {
+    Model model(objFilePath, arena);
     model.initialize();
+    // The geometry of a streamed model isn't loaded: its start-up log has the totals
+    if (model.isStreamed()) return model.buildBvh();
 
     unsigned int nMeshes = model.numberOfMeshes();
     std::clog << "Number of meshes in scene: " << nMeshes << "\n";
@@ -20,53 +34,55 @@ shared_ptr<Hittable> ptScenes::externalModel(const std::string& objFilePath) {
     return model.buildBvh();
 }
 
-shared_ptr<Hittable> ptScenes::oneWeekendSpheres() {
-    HittableList scene;
-    auto groundMaterial = make_shared<Lambertian>(Color(0.5, 0.5, 0.5));
-    scene.add(make_shared<Sphere>(Point3(0,-1000,0), 1000, groundMaterial));
+const Hittable* ptScenes::oneWeekendSpheres(SceneArena& arena) {
+    // All spheres: use the sphere-only BVH
+    std::vector<Sphere> scene;
+    auto groundMaterial = arena.make<Lambertian>(Color(0.5, 0.5, 0.5));
+    scene.emplace_back(Point3(0,-1000,0), 1000, groundMaterial);
     
     for (int a = -11; a < 11; a++) {
         for (int b = -11; b < 11; b++) {
             auto chooseMat = randomFloat();
             Point3 center(a + 0.9*randomFloat(), 0.2, b + 0.9*randomFloat());   
             if (glm::length(center - Point3(4, 0.2, 0)) > 0.9) {
-                shared_ptr<Material> sphereMaterial;
+                const Material* sphereMaterial;
                 if (chooseMat < 0.8) {
                     // diffuse
                     Color albedo = randomVec3() * randomVec3();
-                    sphereMaterial = make_shared<Lambertian>(albedo);
-                    scene.add(make_shared<Sphere>(center, 0.2, sphereMaterial));    
+                    sphereMaterial = arena.make<Lambertian>(albedo);
+                    scene.emplace_back(center, 0.2, sphereMaterial);    
                 } else if (chooseMat < 0.95) {
                     // metal
                     Color albedo = randomVec3(0.5, 1);
                     float fuzz = randomFloat(0, 0.5);
-                    sphereMaterial = make_shared<Metal>(albedo, fuzz);
-                    scene.add(make_shared<Sphere>(center, 0.2, sphereMaterial));
+                    sphereMaterial = arena.make<Metal>(albedo, fuzz);
+                    scene.emplace_back(center, 0.2, sphereMaterial);
                 } else {
                     // glass
-                    sphereMaterial = make_shared<Dielectric>(1.5);
-                    scene.add(make_shared<Sphere>(center, 0.2, sphereMaterial));
+                    sphereMaterial = arena.make<Dielectric>(1.5);
+                    scene.emplace_back(center, 0.2, sphereMaterial);
                 }
             }
         }
     }
 
-    auto material1 = make_shared<Dielectric>(1.5);
-    scene.add(make_shared<Sphere>(Point3(0, 1, 0), 1.0, material1));
-    auto material2 = make_shared<Lambertian>(Color(0.4, 0.2, 0.1));
-    scene.add(make_shared<Sphere>(Point3(-4, 1, 0), 1.0, material2));
-    auto material3 = make_shared<Metal>(Color(0.7, 0.6, 0.5), 0.0);
-    scene.add(make_shared<Sphere>(Point3(4, 1, 0), 1.0, material3));
+    auto material1 = arena.make<Dielectric>(1.5);
+    scene.emplace_back(Point3(0, 1, 0), 1.0, material1);
+    auto material2 = arena.make<Lambertian>(Color(0.4, 0.2, 0.1));
+    scene.emplace_back(Point3(-4, 1, 0), 1.0, material2);
+    auto material3 = arena.make<Metal>(Color(0.7, 0.6, 0.5), 0.0);
+    scene.emplace_back(Point3(4, 1, 0), 1.0, material3);
 
-    return make_shared<BvhNode>(scene);
+    return makeBvh(std::move(scene), arena);
 }
 
-shared_ptr<Hittable> ptScenes::cornellBox() {
-    HittableList scene;
-    auto red   = make_shared<Lambertian>(Color(.65, .05, .05));
-    auto white = make_shared<Lambertian>(Color(.73, .73, .73));
-    auto green = make_shared<Lambertian>(Color(.12, .45, .15));
-    auto light = make_shared<DiffuseLight>(Color(15, 15, 15));
+const Hittable* ptScenes::cornellBox(SceneArena& arena) {
+    // Triangles and spheres: use the mixed primitive BVH
+    std::vector<Primitive> scene;
+    auto red   = arena.make<Lambertian>(Color(.65, .05, .05));
+    auto white = arena.make<Lambertian>(Color(.73, .73, .73));
+    auto green = arena.make<Lambertian>(Color(.12, .45, .15));
+    auto light = arena.make<DiffuseLight>(Color(15, 15, 15));
 
     Vertex v0; v0.position = Point3(555,0,0);
     Vertex v1; v1.position = Point3(555,555,0);
@@ -84,24 +100,24 @@ shared_ptr<Hittable> ptScenes::cornellBox() {
 
     // left wall
     v0.normal = v1.normal = v2.normal = v3.normal = leftWallNormal;
-    scene.add(make_shared<Triangle>(v0, v1, v2, green));
-    scene.add(make_shared<Triangle>(v1, v2, v3, green));
+    scene.push_back(Triangle(v0, v1, v2, green));
+    scene.push_back(Triangle(v1, v2, v3, green));
     // right wall
     v4.normal = v5.normal = v6.normal = v7.normal = rightWallNormal;
-    scene.add(make_shared<Triangle>(v4, v5, v6, red));
-    scene.add(make_shared<Triangle>(v5, v6, v7, red));
+    scene.push_back(Triangle(v4, v5, v6, red));
+    scene.push_back(Triangle(v5, v6, v7, red));
     // floor
     v4.normal = v0.normal = v6.normal = v2.normal = floorNormal;
-    scene.add(make_shared<Triangle>(v4, v0, v6, white));
-    scene.add(make_shared<Triangle>(v0, v6, v2, white));
+    scene.push_back(Triangle(v4, v0, v6, white));
+    scene.push_back(Triangle(v0, v6, v2, white));
     // ceiling
     v3.normal = v7.normal = v1.normal = v5.normal = ceilingNormal;
-    scene.add(make_shared<Triangle>(v3, v7, v1, white));
-    scene.add(make_shared<Triangle>(v7, v1, v5, white));
+    scene.push_back(Triangle(v3, v7, v1, white));
+    scene.push_back(Triangle(v7, v1, v5, white));
     // back wall
     v6.normal = v2.normal = v7.normal = v3.normal = backWallNormal;
-    scene.add(make_shared<Triangle>(v6, v2, v7, white));
-    scene.add(make_shared<Triangle>(v2, v7, v3, white));
+    scene.push_back(Triangle(v6, v2, v7, white));
+    scene.push_back(Triangle(v2, v7, v3, white));
     
     // light
     Vertex v8, v9, v10, v11;
@@ -109,22 +125,24 @@ shared_ptr<Hittable> ptScenes::cornellBox() {
     v9.position = Point3(213, 554, 332);
     v10.position = Point3(343, 554, 227);
     v11.position = Point3(213, 554, 227);
-    scene.add(make_shared<Triangle>(v8, v9, v10, light));
-    scene.add(make_shared<Triangle>(v9, v10, v11, light));
+    scene.push_back(Triangle(v8, v9, v10, light));
+    scene.push_back(Triangle(v9, v10, v11, light));
 
     // spheres
-    scene.add(make_shared<Sphere>(Point3(400,82.5,335), 82.5, make_shared<Metal>(Color(1,1,1), 0)));
-    scene.add(make_shared<Sphere>(Point3(150,82.5,150), 82.5, make_shared<Dielectric>(1.5)));
+    scene.push_back(Sphere(Point3(400,82.5,335), 82.5, arena.make<Metal>(Color(1,1,1), 0)));
+    scene.push_back(Sphere(Point3(150,82.5,150), 82.5, arena.make<Dielectric>(1.5)));
 
-    return make_shared<BvhNode>(scene);
+    return makeBvh(std::move(scene), arena);
 }
 
-shared_ptr<Hittable> ptScenes::mirrorRoom() {
-    HittableList scene;
-    auto mirror = make_shared<Metal>(Color(.93,.93,.93), 0.0);
-    auto white = make_shared<Lambertian>(Color(0.88, 0.88, 0.88));
-    auto light = make_shared<DiffuseLight>(Color(25, 25, 25));
-    auto checker = make_shared<CheckerTexture>(50.0, Color(0.88, 0.88, 0.88), Color(0.0, 0.0, 0.0));
+const Hittable* ptScenes::mirrorRoom(SceneArena& arena) {
+    // Triangles and spheres: use the mixed primitive BVH
+    std::vector<Primitive> scene;
+    auto mirror = arena.make<Metal>(Color(.93,.93,.93), 0.0);
+    auto white = arena.make<Lambertian>(Color(0.88, 0.88, 0.88));
+    auto light = arena.make<DiffuseLight>(Color(25, 25, 25));
+    auto checker = arena.make<CheckerTexture>(50.0, arena.make<SolidColor>(Color(0.88, 0.88, 0.88)),
+                                              arena.make<SolidColor>(Color(0.0, 0.0, 0.0)));
 
     Vertex v0; v0.position = Point3(555,0,0);
     Vertex v1; v1.position = Point3(555,555,0);
@@ -143,28 +161,28 @@ shared_ptr<Hittable> ptScenes::mirrorRoom() {
 
     // floor
     v4.normal = v0.normal = v6.normal = v2.normal = floorNormal;
-    scene.add(make_shared<Triangle>(v0, v2, v4, make_shared<Lambertian>(checker)));
-    scene.add(make_shared<Triangle>(v2, v6, v4, make_shared<Lambertian>(checker)));
+    scene.push_back(Triangle(v0, v2, v4, arena.make<Lambertian>(checker)));
+    scene.push_back(Triangle(v2, v6, v4, arena.make<Lambertian>(checker)));
     // left wall
     v0.normal = v1.normal = v2.normal = v3.normal = leftWallNormal;
-    scene.add(make_shared<Triangle>(v0, v1, v2, white));
-    scene.add(make_shared<Triangle>(v1, v2, v3, white));
+    scene.push_back(Triangle(v0, v1, v2, white));
+    scene.push_back(Triangle(v1, v2, v3, white));
     // right wall
     v4.normal = v5.normal = v6.normal = v7.normal = rightWallNormal;
-    scene.add(make_shared<Triangle>(v4, v5, v6, white));
-    scene.add(make_shared<Triangle>(v5, v6, v7, white));
+    scene.push_back(Triangle(v4, v5, v6, white));
+    scene.push_back(Triangle(v5, v6, v7, white));
     // ceiling
     v3.normal = v7.normal = v1.normal = v5.normal = ceilingNormal;
-    scene.add(make_shared<Triangle>(v3, v7, v1, white));
-    scene.add(make_shared<Triangle>(v7, v1, v5, white));
+    scene.push_back(Triangle(v3, v7, v1, white));
+    scene.push_back(Triangle(v7, v1, v5, white));
     // back wall
     v6.normal = v2.normal = v7.normal = v3.normal = backWallNormal;
-    scene.add(make_shared<Triangle>(v6, v2, v7, mirror));
-    scene.add(make_shared<Triangle>(v2, v7, v3, mirror));
+    scene.push_back(Triangle(v6, v2, v7, mirror));
+    scene.push_back(Triangle(v2, v7, v3, mirror));
     // front wall
     v4.normal = v0.normal = v1.normal = v5.normal = frontWallNormal;
-    scene.add(make_shared<Triangle>(v4, v0, v1, mirror));
-    scene.add(make_shared<Triangle>(v4, v1, v5, mirror));
+    scene.push_back(Triangle(v4, v0, v1, mirror));
+    scene.push_back(Triangle(v4, v1, v5, mirror));
     
     // light
     Vertex v8, v9, v10, v11;
@@ -172,14 +190,39 @@ shared_ptr<Hittable> ptScenes::mirrorRoom() {
     v9.position = Point3(213,554,332);
     v10.position = Point3(343,554,227);
     v11.position = Point3(213, 554,227);
-    scene.add(make_shared<Triangle>(v8, v9, v10, light));
-    scene.add(make_shared<Triangle>(v9, v10, v11, light));
+    scene.push_back(Triangle(v8, v9, v10, light));
+    scene.push_back(Triangle(v9, v10, v11, light));
 
     // sphere
-    auto sphereTexture = make_shared<ImageTexture>(
-                         make_shared<Image>("images/textures/pexels.jpg"));
-    auto sphereSurface = make_shared<Lambertian>(sphereTexture);
-    scene.add(make_shared<Sphere>(Point3(278,278,278), 40, sphereSurface));
+    auto sphereTexture = arena.make<ImageTexture>(
+                  make_shared<Image>("images/textures/pexels.jpg"));
+    auto sphereSurface = arena.make<Lambertian>(sphereTexture);
+    scene.push_back(Sphere(Point3(278,278,278), 40, sphereSurface));
+
+    return makeBvh(std::move(scene), arena);
+}
+
+Camera ptScenes::oneWeekendSpheresCamera() {
+    Camera cam(16.0f/9.0f, 1920, 20, Vec3(13,2,3), Vec3(0,0,0));
+    cam.setSamplesPerPixel(10);
+    cam.setMaxDepth(50);
+    cam.setDefocusAngle(0.6);
+    cam.setFocusDist(10.0);
+    cam.setBackground(Color(0.70, 0.80, 1.00));
+    return cam;
+}
+
+Camera ptScenes::cornellBoxCamera() {
+    Camera cam(1, 800, 40, Point3(278,278,-800), Point3(278,278,0));
+    cam.setSamplesPerPixel(10000);
+    cam.setMaxDepth(7);
+    return cam;
+}
 
-    return make_shared<BvhNode>(scene);
+Camera ptScenes::mirrorRoomCamera() {
+    //Camera cam(1, 100, 60, Point3(400,400,50), Point3(250,250,700));
+    Camera cam(1, 1000, 45, Point3(100,300,550), Point3(305,300,75));
+    cam.setSamplesPerPixel(1000);
+    cam.setMaxDepth(40);
+    return cam;
 }
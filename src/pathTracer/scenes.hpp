@@ -3,17 +3,29 @@
 #include "sphere.hpp"
 #include "material.hpp"
 #include "bvh.hpp"
+#include "flatBvh.hpp"
+#include "compressedBvh.hpp"
 #include "triangle.hpp"
 #include "texture.hpp"
+#include "camera.hpp"
 
 #include "model.hpp"
+#include "sceneArena.hpp"
 
+// Each scene is allocated in `arena`, and lives as long as it
 namespace ptScenes {
-    std::shared_ptr<Hittable> externalModel(const std::string& objFilepath);
+    const Hittable* externalModel(const std::string& objFilepath, SceneArena& arena);
     
-    std::shared_ptr<Hittable> oneWeekendSpheres();
+    const Hittable* oneWeekendSpheres(SceneArena& arena);
 
-    std::shared_ptr<Hittable> cornellBox();
+    const Hittable* cornellBox(SceneArena& arena);
 
-    std::shared_ptr<Hittable> mirrorRoom();
+    const Hittable* mirrorRoom(SceneArena& arena);
+
+    // Cameras of the hard-coded scenes (all settings but the image name)
+    Camera oneWeekendSpheresCamera();
+
+    Camera cornellBoxCamera();
+
+    Camera mirrorRoomCamera();
 };
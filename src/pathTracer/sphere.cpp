@@ -1,49 +1,47 @@
 #include "sphere.hpp"
+#include "material.hpp"
 
-Sphere::Sphere(const Point3& center, float radius, std::shared_ptr<Material> mat)
+Sphere::Sphere(const Point3& center, float radius, const Material* mat)
             : center(center), radius(std::fmax(0, radius)), mat(mat) {
+    needsTexCoords = mat->usesTexCoords();
     // Initialize bounding box
     Vec3 rvec = Vec3(radius, radius, radius);
     bbox = Aabb(center - rvec, center + rvec);
 }
 
-bool Sphere::hit(const Ray& r, Interval rayT, HitRecord& rec) const {
-    /*
-    C sphere center, r ray
-    O ray origin, d direction
-
-    P(t) = O + td
-    P(t) is on sphere if (C-P(t))⋅(C-P(t)) = r^2
-    which means
-    (t^2)d⋅d − 2td⋅(C−O) + (C−O)⋅(C−O) − r^2 = 0
-
-    h = -b/2 = d⋅(C−O)
-    */
-    Vec3 oc = center - r.origin();
-    Vec3 d = r.direction();
-    float a = glm::dot(d, d);
-    float h = glm::dot(d, oc);
-    float c = dot(oc, oc) - radius * radius;
-    float discriminant = h * h - a * c;
-
-    if (discriminant < 0) return false;
-
-    // Find the nearest root that lies in the acceptable range
-    float sqrtd = sqrt(discriminant);
-    float root = (h - sqrtd) / a;
-    if (!rayT.surrounds(root)) {
-        root = (h + sqrtd) / a;
-        if (!rayT.surrounds(root)) {
-            return false;
-        }
-    }
-    rec.t = root;
+void Sphere::computeSurfaceInteraction(const Ray& r, HitRecord& rec) const {
     rec.p = r.at(rec.t);
     Vec3 outwardNormal = (rec.p - center) / radius;
     rec.setFaceNormal(r, outwardNormal);
-    getSphereUV(outwardNormal, rec.u, rec.v);
+    if (needsTexCoords) {
+        getSphereUV(outwardNormal, rec.u, rec.v);
+        // u spans 2*pi*radius and v spans pi*radius: use their geometric mean
+        rec.uvFootprint = rec.footprint / (std::sqrt(2.0f) * pi * radius);
+    } else {
+        rec.u = rec.v = 0.0f;
+    }
     rec.material = mat;
-    return true;
+}
+
+void Sphere::collectEmitters(std::vector<const Hittable*>& emitters) const {
+    if (mat->isEmissive()) emitters.push_back(this);
+}
+
+float Sphere::area() const {
+    return 4 * pi * radius * radius;
+}
+
+Point3 Sphere::sampleSurface(float u1, float u2, Vec3& normal) const {
+    // Uniform direction on the unit sphere
+    float z = 1.0f - 2.0f*u1;
+    float r = std::sqrt(std::fmax(0.0f, 1.0f - z*z));
+    float phi = 2 * pi * u2;
+    normal = Vec3(r * std::cos(phi), r * std::sin(phi), z);
+    return center + radius * normal;
+}
+
+Vec3 Sphere::geometricNormal(const Point3& q) const {
+    return (q - center) / radius;
 }
 
 void Sphere::getSphereUV(const Point3& p, float& u, float& v) {
@@ -7,18 +7,88 @@
 #include "interval.hpp"
 #include "aabb.hpp"
 
-class Sphere : public Hittable {
+// `final`, so that calls through a `Sphere` (e.g. in `FlatBvh<Sphere>`)
+// are resolved at compile time and can be inlined
+class Sphere final : public Hittable {
     public:
-        Sphere(const Point3& center, float radius, std::shared_ptr<Material> mat);
+        Sphere(const Point3& center, float radius, const Material* mat);
 
         bool hit(const Ray& r, Interval rayT, HitRecord& rec) const override;
 
+        void computeSurfaceInteraction(const Ray& r, HitRecord& rec) const override;
+
+        bool occluded(const Ray& r, Interval rayT) const override;
+
         Aabb boundingBox() const override {return bbox;}
+
+        void collectEmitters(std::vector<const Hittable*>& emitters) const override;
+
+        const Material* getMaterial() const override {return mat;}
+
+        float area() const override;
+
+        Point3 sampleSurface(float u1, float u2, Vec3& normal) const override;
+
+        Vec3 geometricNormal(const Point3& q) const override;
         
     private:
         static void getSphereUV(const Point3& p, float& u, float& v);
+        // Finds the nearest root of the ray-sphere equation that lies in `rayT`
+        bool intersect(const Ray& r, Interval rayT, float& root) const;
         Point3 center;
         float radius;
-        std::shared_ptr<Material> mat;
+        // Owned by the scene (see `SceneArena`)
+        const Material* mat;
+        // Whether `mat` needs texture coordinates to be computed
+        bool needsTexCoords;
         Aabb bbox;
-};
\ No newline at end of file
+};
+
+// Intersection routines are defined here so that they can be inlined
+// in the traversal loop
+
+inline bool Sphere::hit(const Ray& r, Interval rayT, HitRecord& rec) const {
+    float root;
+    if (!intersect(r, rayT, root)) return false;
+    rec.t = root;
+    rec.object = this;
+    return true;
+}
+
+inline bool Sphere::occluded(const Ray& r, Interval rayT) const {
+    float root;
+    return intersect(r, rayT, root);
+}
+
+inline bool Sphere::intersect(const Ray& r, Interval rayT, float& root) const {
+    /*
+    C sphere center, r ray
+    O ray origin, d direction
+
+    P(t) = O + td
+    P(t) is on sphere if (C-P(t))⋅(C-P(t)) = r^2
+    which means
+    (t^2)d⋅d − 2td⋅(C−O) + (C−O)⋅(C−O) − r^2 = 0
+
+    h = -b/2 = d⋅(C−O)
+    */
+    Vec3 oc = center - r.origin();
+    Vec3 d = r.direction();
+    float a = glm::dot(d, d);
+    float h = glm::dot(d, oc);
+    float c = dot(oc, oc) - radius * radius;
+    float discriminant = h * h - a * c;
+
+    if (discriminant < 0) return false;
+
+    // Find the nearest root that lies in the acceptable range
+    float sqrtd = sqrt(discriminant);
+    root = (h - sqrtd) / a;
+    if (!rayT.surrounds(root)) {
+        root = (h + sqrtd) / a;
+        if (!rayT.surrounds(root)) {
+            return false;
+        }
+    }
+    return true;
+}
@@ -0,0 +1,441 @@
+#include "streamedBvh.hpp"
+
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <fcntl.h>
+#include <unistd.h>
+
+using comUtils::materials::MaterialInfo;
+
+namespace {
+    // Bumped when the meaning of the stored structures changes (version 2: the
+    // range of compact texture coordinates)
+    const uint32_t version = 2;
+
+    // Location of an array in the file
+    struct Section {
+        uint64_t offset;
+        uint64_t count;
+    };
+
+    struct Header {
+        char magic[8];
+        uint32_t version;
+        // Sizes of the stored structures, so that a file written with
+        // a different layout is rejected
+        uint32_t nodeSize;
+        uint32_t triangleSize;
+        uint32_t padding;
+        SceneCache::SourceStamp obj;
+        SceneCache::SourceStamp mtl;
+        uint64_t numberOfTriangles;
+        Section materials;
+        // Characters of the texture file names
+        Section strings;
+        Section topNodes;
+        Section clusters;
+    };
+
+    struct MaterialRecord {
+        int32_t model;
+        float diffuse[3];
+        float specular[3];
+        float emissive[3];
+        float shininess;
+        float refractionIndex;
+        // Diffuse texture file name, in the strings section
+        uint64_t diffuseMapOffset;
+        uint64_t diffuseMapLength;
+    };
+
+    // Reads `size` bytes at `offset`. Returns false if they can't all be read.
+    bool readAt(int fd, uint64_t offset, void* data, size_t size) {
+        char* destination = static_cast<char*>(data);
+        while (size > 0) {
+            ssize_t read = pread(fd, destination, size, offset);
+            if (read <= 0) return false;
+            destination += read;
+            offset += read;
+            size -= read;
+        }
+        return true;
+    }
+
+    template <typename T>
+    bool readSection(int fd, size_t length, const Section& s, std::vector<T>& elements) {
+        if (s.offset > length || s.count > (length - s.offset) / sizeof(T)) return false;
+        elements.resize(s.count);
+        return readAt(fd, s.offset, elements.data(), s.count * sizeof(T));
+    }
+}
+
+StreamedBvh::File::~File() {
+    if (fd >= 0) close(fd);
+}
+
+StreamedBvh::File::File(File&& other)
+    : fd(other.fd), length(other.length), triangles(other.triangles),
+      materialInfos(std::move(other.materialInfos)), topNodes(std::move(other.topNodes)),
+      clusters(std::move(other.clusters)) {
+    other.fd = -1;
+}
+
+bool StreamedBvh::File::open(const std::string& objFilePath) {
+    fd = ::open(filePath(objFilePath).c_str(), O_RDONLY);
+    if (fd < 0) return false;
+    length = lseek(fd, 0, SEEK_END);
+
+    Header h;
+    std::vector<MaterialRecord> records;
+    std::vector<char> strings;
+    bool valid = length >= sizeof(Header) && readAt(fd, 0, &h, sizeof(h))
+                 && std::memcmp(h.magic, "PTCLUST", 8) == 0 && h.version == version
+                 && h.nodeSize == sizeof(Node) && h.triangleSize == sizeof(TriangleRecord)
+                 && h.obj == SceneCache::stamp(objFilePath)
+                 && h.mtl == SceneCache::stamp(SceneCache::mtlFilePath(objFilePath))
+                 && readSection(fd, length, h.materials, records)
+                 && readSection(fd, length, h.strings, strings)
+                 && readSection(fd, length, h.topNodes, topNodes)
+                 && readSection(fd, length, h.clusters, clusters)
+                 && !topNodes.empty();
+    // Only the top level is checked here: clusters are checked when they're read
+    for (size_t i = 0; i < records.size() && valid; i++) {
+        valid = records[i].diffuseMapOffset + records[i].diffuseMapLength <= strings.size();
+    }
+    for (size_t i = 0; i < topNodes.size() && valid; i++) {
+        const Node& node = topNodes[i];
+        valid = (node.count > 0) ? node.index < clusters.size()
+                                 : node.index > i + 1 && node.index < topNodes.size() && node.axis < 3;
+    }
+    valid = valid && Cluster::fitsTraversalStack(topNodes.data(), topNodes.size());
+    for (size_t i = 0; i < clusters.size() && valid; i++) {
+        const ClusterRecord& c = clusters[i];
+        valid = c.numberOfNodes > 0 && c.offset <= length
+                && c.numberOfNodes * sizeof(Node) + c.numberOfTriangles * sizeof(TriangleRecord) <= length - c.offset;
+    }
+    if (!valid) {
+        close(fd);
+        fd = -1;
+        topNodes.clear();
+        clusters.clear();
+        return false;
+    }
+
+    triangles = h.numberOfTriangles;
+    materialInfos.clear();
+    for (const MaterialRecord& r : records) {
+        MaterialInfo info;
+        info.model = static_cast<comUtils::materials::illModel>(r.model);
+        info.diffuse = glm::vec3(r.diffuse[0], r.diffuse[1], r.diffuse[2]);
+        info.specular = glm::vec3(r.specular[0], r.specular[1], r.specular[2]);
+        info.emissive = glm::vec3(r.emissive[0], r.emissive[1], r.emissive[2]);
+        info.shininess = r.shininess;
+        info.refractionIndex = r.refractionIndex;
+        info.diffuseMap.assign(strings.data() + r.diffuseMapOffset, r.diffuseMapLength);
+        materialInfos.push_back(info);
+    }
+    return true;
+}
+
+StreamedBvh::StreamedBvh(File file, std::vector<const Material*> materials)
+    : file(std::move(file)), materials(std::move(materials)), slots(this->file.clusters.size()) {}
+
+StreamedBvh::Stats StreamedBvh::stats() {
+    return {loads.load(), evictions.load(), bytesRead.load(), totalResidentBytes.load()};
+}
+
+std::string StreamedBvh::filePath(const std::string& objFilePath) {
+    return std::filesystem::path(objFilePath).replace_extension(".ptclusters").string();
+}
+
+bool StreamedBvh::write(const std::string& objFilePath, const Cluster& bvh,
+                        const std::vector<MaterialInfo>& materials,
+                        const std::function<TriangleRecord(size_t)>& triangle) {
+    const auto& nodes = bvh.getNodes();
+    if (nodes.empty()) return false;
+
+    // Nodes and primitives of each subtree: since nodes are in depth-first order,
+    // they're both contiguous, and children come after their parent
+    struct Extent {
+        uint32_t nodeEnd;
+        uint32_t primitiveStart;
+        uint32_t primitiveEnd;
+    };
+    std::vector<Extent> extents(nodes.size());
+    for (size_t i = nodes.size(); i-- > 0;) {
+        const Node& node = nodes[i];
+        if (node.count > 0) {
+            extents[i] = {uint32_t(i + 1), node.index, node.index + node.count};
+        } else {
+            extents[i] = {extents[node.index].nodeEnd, extents[i + 1].primitiveStart,
+                          extents[node.index].primitiveEnd};
+        }
+    }
+
+    // The clusters are the largest subtrees with at most `clusterSize` primitives.
+    // The nodes above them make the top level.
+    std::vector<Node> topNodes;
+    std::vector<uint32_t> clusterRoots;
+    std::function<uint32_t(uint32_t)> collect = [&](uint32_t i) {
+        uint32_t topIndex = topNodes.size();
+        topNodes.push_back(nodes[i]);
+        const Extent& e = extents[i];
+        if (nodes[i].count > 0 || e.primitiveEnd - e.primitiveStart <= clusterSize) {
+            topNodes[topIndex].index = clusterRoots.size();
+            topNodes[topIndex].count = 1;
+            clusterRoots.push_back(i);
+        } else {
+            collect(i + 1);
+            uint32_t right = collect(nodes[i].index);
+            topNodes[topIndex].index = right;
+        }
+        return topIndex;
+    };
+    collect(0);
+
+    Header h = {};
+    std::memcpy(h.magic, "PTCLUST", 8);
+    h.version = version;
+    h.nodeSize = sizeof(Node);
+    h.triangleSize = sizeof(TriangleRecord);
+    h.obj = SceneCache::stamp(objFilePath);
+    h.mtl = SceneCache::stamp(SceneCache::mtlFilePath(objFilePath));
+    h.numberOfTriangles = bvh.numberOfPrimitives();
+
+    std::vector<MaterialRecord> records;
+    std::string strings;
+    for (const MaterialInfo& material : materials) {
+        MaterialRecord r = {};
+        r.model = material.model;
+        for (int i = 0; i < 3; i++) {
+            r.diffuse[i] = material.diffuse[i];
+            r.specular[i] = material.specular[i];
+            r.emissive[i] = material.emissive[i];
+        }
+        r.shininess = material.shininess;
+        r.refractionIndex = material.refractionIndex;
+        r.diffuseMapOffset = strings.size();
+        r.diffuseMapLength = material.diffuseMap.size();
+        strings += material.diffuseMap;
+        records.push_back(r);
+    }
+
+    // Lay out the tables, then the clusters, each on its own pages
+    uint64_t offset = sizeof(Header);
+    auto place = [&offset](Section& s, size_t count, size_t elementSize) {
+        offset = (offset + alignof(uint64_t) - 1) / alignof(uint64_t) * alignof(uint64_t);
+        s = {offset, count};
+        offset += count * elementSize;
+    };
+    place(h.materials, records.size(), sizeof(MaterialRecord));
+    place(h.strings, strings.size(), 1);
+    place(h.topNodes, topNodes.size(), sizeof(Node));
+    place(h.clusters, clusterRoots.size(), sizeof(File::ClusterRecord));
+    std::vector<File::ClusterRecord> clusters;
+    for (uint32_t root : clusterRoots) {
+        const Extent& e = extents[root];
+        offset = (offset + pageSize - 1) / pageSize * pageSize;
+        File::ClusterRecord c = {};
+        c.offset = offset;
+        c.numberOfNodes = e.nodeEnd - root;
+        c.numberOfTriangles = e.primitiveEnd - e.primitiveStart;
+        clusters.push_back(c);
+        offset += c.numberOfNodes * sizeof(Node) + c.numberOfTriangles * sizeof(TriangleRecord);
+    }
+
+    // Written under a temporary name, so that an interrupted write
+    // doesn't leave a truncated file behind
+    std::string path = filePath(objFilePath);
+    std::string tempPath = path + ".tmp";
+    std::ofstream out(tempPath, std::ios::binary);
+    auto writeAt = [&out](uint64_t position, const void* data, size_t size) {
+        // Pad up to the start of the section
+        static const char zeros[pageSize] = {};
+        out.write(zeros, position - uint64_t(out.tellp()));
+        out.write(static_cast<const char*>(data), size);
+    };
+    // The header and cluster table are rewritten at the end, once the clusters
+    // holding emitters are known
+    out.write(reinterpret_cast<const char*>(&h), sizeof(h));
+    writeAt(h.materials.offset, records.data(), records.size() * sizeof(MaterialRecord));
+    writeAt(h.strings.offset, strings.data(), strings.size());
+    writeAt(h.topNodes.offset, topNodes.data(), topNodes.size() * sizeof(Node));
+    writeAt(h.clusters.offset, clusters.data(), clusters.size() * sizeof(File::ClusterRecord));
+    std::vector<Node> clusterNodes;
+    std::vector<TriangleRecord> triangles;
+    for (size_t c = 0; c < clusterRoots.size(); c++) {
+        uint32_t root = clusterRoots[c];
+        const Extent& e = extents[root];
+        // Indices become relative to the cluster
+        clusterNodes.assign(nodes.begin() + root, nodes.begin() + e.nodeEnd);
+        for (Node& node : clusterNodes) node.index -= (node.count > 0) ? e.primitiveStart : root;
+        triangles.clear();
+        for (size_t i = e.primitiveStart; i < e.primitiveEnd; i++) {
+            triangles.push_back(triangle(i));
+            const MaterialInfo& material = materials[triangles.back().material];
+            if (comUtils::materials::determineMatType(material) == comUtils::materials::DIFFUSE_LIGHT) clusters[c].emissive = 1;
+        }
+        writeAt(clusters[c].offset, clusterNodes.data(), clusterNodes.size() * sizeof(Node));
+        out.write(reinterpret_cast<const char*>(triangles.data()), triangles.size() * sizeof(TriangleRecord));
+    }
+    out.seekp(h.clusters.offset);
+    out.write(reinterpret_cast<const char*>(clusters.data()), clusters.size() * sizeof(File::ClusterRecord));
+    out.close();
+    if (!out) return false;
+    std::error_code error;
+    std::filesystem::rename(tempPath, path, error);
+    return !error;
+}
+
+bool StreamedBvh::hit(const Ray& r, Interval rayT, HitRecord& rec) const {
+    const std::vector<Node>& nodes = file.topNodes;
+    Vec3 invDir = 1.0f / r.direction();
+
+    // Keeps the cluster of the closest hit alive, while the others may be evicted
+    std::shared_ptr<const Cluster> hitCluster;
+    uint32_t stack[64];
+    int stackSize = 0;
+    uint32_t current = 0;
+    while (true) {
+        const Node& node = nodes[current];
+        if (node.bbox.hit(r.origin(), invDir, rayT)) {
+            if (node.count > 0) {
+                std::shared_ptr<const Cluster> cluster = acquire(node.index);
+                if (cluster->hit(r, rayT, rec)) {
+                    rayT.max = rec.t;
+                    hitCluster = std::move(cluster);
+                }
+            } else {
+                // Same order as `FlatBvh`: the child that comes first along the ray
+                if (invDir[node.axis] < 0) {
+                    stack[stackSize++] = current + 1;
+                    current = node.index;
+                } else {
+                    stack[stackSize++] = node.index;
+                    current = current + 1;
+                }
+                continue;
+            }
+        }
+        if (stackSize == 0) break;
+        current = stack[--stackSize];
+    }
+    if (!hitCluster) return false;
+    lastHit = std::move(hitCluster);
+    return true;
+}
+
+bool StreamedBvh::occluded(const Ray& r, Interval rayT) const {
+    const std::vector<Node>& nodes = file.topNodes;
+    Vec3 invDir = 1.0f / r.direction();
+
+    uint32_t stack[64];
+    int stackSize = 0;
+    uint32_t current = 0;
+    while (true) {
+        const Node& node = nodes[current];
+        if (node.bbox.hit(r.origin(), invDir, rayT)) {
+            if (node.count > 0) {
+                if (acquire(node.index)->occluded(r, rayT)) return true;
+            } else {
+                stack[stackSize++] = node.index;
+                current = current + 1;
+                continue;
+            }
+        }
+        if (stackSize == 0) break;
+        current = stack[--stackSize];
+    }
+    return false;
+}
+
+void StreamedBvh::collectEmitters(std::vector<const Hittable*>& emitters) const {
+    for (size_t i = 0; i < file.clusters.size(); i++) {
+        if (file.clusters[i].emissive) acquire(i, true)->collectEmitters(emitters);
+    }
+}
+
+std::shared_ptr<const StreamedBvh::Cluster> StreamedBvh::acquire(uint32_t index, bool pin) const {
+    Slot& slot = slots[index];
+    // Only written when it changes, so that threads using the same cluster
+    // don't keep taking its cache line from each other
+    uint64_t now = clock.load(std::memory_order_relaxed);
+    if (slot.lastUse.load(std::memory_order_relaxed) != now) slot.lastUse.store(now, std::memory_order_relaxed);
+    if (pin) slot.pinned = true;
+
+    while (true) {
+        std::shared_ptr<const Cluster> cluster = std::atomic_load(&slot.cluster);
+        if (cluster) return cluster;
+
+        uint8_t expected = Empty;
+        if (slot.state.compare_exchange_strong(expected, Loading)) {
+            cluster = load(index);
+            std::lock_guard<std::mutex> lock(mutex);
+            std::atomic_store(&slot.cluster, cluster);
+            slot.lastUse = ++clock;
+            slot.bytes = file.clusters[index].numberOfNodes * sizeof(Node)
+                         + file.clusters[index].numberOfTriangles * sizeof(Triangle);
+            slot.state = Resident;
+            residentBytes += slot.bytes;
+            totalResidentBytes += slot.bytes;
+            evict(index);
+            loaded.notify_all();
+            return cluster;
+        }
+
+        // Another thread is loading it (or just evicted it): since the state
+        // only changes under the mutex, it's settled once the wait returns
+        std::unique_lock<std::mutex> lock(mutex);
+        loaded.wait(lock, [&slot] { return slot.state != Loading; });
+    }
+}
+
+std::shared_ptr<const StreamedBvh::Cluster> StreamedBvh::load(uint32_t index) const {
+    const File::ClusterRecord& c = file.clusters[index];
+    std::vector<Node> nodes(c.numberOfNodes);
+    std::vector<TriangleRecord> records(c.numberOfTriangles);
+    size_t nodeBytes = nodes.size() * sizeof(Node);
+    bool valid;
+    {
+        std::lock_guard<std::mutex> lock(ioMutex);
+        valid = readAt(file.fd, c.offset, nodes.data(), nodeBytes)
+                && readAt(file.fd, c.offset + nodeBytes, records.data(), records.size() * sizeof(TriangleRecord));
+    }
+    for (size_t i = 0; i < nodes.size() && valid; i++) {
+        const Node& node = nodes[i];
+        valid = (node.count > 0) ? node.index + size_t(node.count) <= records.size()
+                                 : node.index > i + 1 && node.index < nodes.size() && node.axis < 3;
+    }
+    valid = valid && Cluster::fitsTraversalStack(nodes.data(), nodes.size());
+    for (size_t i = 0; i < records.size() && valid; i++) valid = records[i].material < materials.size();
+    if (!valid) fatalError("Error: damaged clusters file (cluster " + std::to_string(index) + ")");
+    loads++;
+    bytesRead += nodeBytes + records.size() * sizeof(TriangleRecord);
+
+    std::pmr::vector<Triangle> triangles;
+    triangles.reserve(records.size());
+    for (const TriangleRecord& t : records) {
+        triangles.emplace_back(t.vertices[0], t.vertices[1], t.vertices[2], materials[t.material]);
+    }
+    return std::make_shared<const Cluster>(nodes.data(), nodes.size(), std::move(triangles));
+}
+
+void StreamedBvh::evict(uint32_t loadedIndex) const {
+    while (residentBytes > budget) {
+        // Least recently used cluster that can be released. The cluster that was
+        // just loaded isn't, even if the budget can't hold it.
+        Slot* victim = nullptr;
+        for (uint32_t i = 0; i < slots.size(); i++) {
+            Slot& slot = slots[i];
+            if (i != loadedIndex && slot.state == Resident && !slot.pinned
+                && (!victim || slot.lastUse < victim->lastUse)) victim = &slot;
+        }
+        if (!victim) break;
+        std::atomic_store(&victim->cluster, std::shared_ptr<const Cluster>());
+        victim->state = Empty;
+        residentBytes -= victim->bytes;
+        totalResidentBytes -= victim->bytes;
+        evictions++;
+    }
+}
@@ -0,0 +1,170 @@
+#pragma once
+
+#include "myPT.hpp"
+#include "flatBvh.hpp"
+#include "sceneCache.hpp"
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+
+// Geometry of a model that doesn't need to fit in memory: its triangles are
+// split into spatially coherent clusters, each with its own BVH, stored in
+// page-aligned blocks of a file next to the .obj file (*.ptclusters).
+// Only a small top-level BVH, whose leaves are the clusters, is kept in memory.
+// A cluster is read from the file (with a single sequential read) when a ray
+// first enters its bounds, and when the resident clusters exceed the memory
+// budget, the least recently used ones are released. Clusters holding emitters
+// are never released, since lights refer to their triangles.
+// Like the scene cache, the file is tied to the size and modification time of
+// the .obj and .mtl files.
+class StreamedBvh final : public Hittable {
+    public:
+        using Cluster = FlatBvh<Triangle>;
+        using Node = Cluster::Node;
+
+        struct Stats {
+            uint64_t loads;
+            uint64_t evictions;
+            uint64_t bytesRead;
+            size_t residentBytes;
+        };
+
+        // A triangle, as stored in the file
+        struct TriangleRecord {
+            Vertex vertices[3];
+            // Index of its material, in the materials of the file
+            uint32_t material;
+        };
+
+        // An open clusters file: everything but the clusters themselves
+        class File {
+            public:
+                File() {}
+                ~File();
+                File(File&& other);
+                File& operator=(const File&) = delete;
+
+                // Opens the clusters file of model `objFilePath`.
+                // Returns false if there isn't one, or if it's out of date.
+                bool open(const std::string& objFilePath);
+
+                const std::vector<comUtils::materials::MaterialInfo>& materials() const { return materialInfos; }
+
+                size_t numberOfClusters() const { return clusters.size(); }
+                size_t numberOfTriangles() const { return triangles; }
+
+            private:
+                friend class StreamedBvh;
+
+                struct ClusterRecord {
+                    uint64_t offset;
+                    uint32_t numberOfNodes;
+                    uint32_t numberOfTriangles;
+                    // Nonzero if some of its triangles are emitters
+                    uint32_t emissive;
+                    uint32_t padding;
+                };
+
+                int fd = -1;
+                size_t length = 0;
+                size_t triangles = 0;
+                std::vector<comUtils::materials::MaterialInfo> materialInfos;
+                // Top-level BVH: the leaves (count 1) are clusters, whose index is `index`
+                std::vector<Node> topNodes;
+                std::vector<ClusterRecord> clusters;
+        };
+
+        // Takes the clusters file; `materials` are made from its material descriptions
+        StreamedBvh(File file, std::vector<const Material*> materials);
+
+        // The memory budget of the resident clusters of each model, in bytes.
+        // A budget of 0 disables streaming: models are fully loaded in memory.
+        static void setBudget(size_t bytes) { budget = bytes; }
+        static size_t getBudget() { return budget; }
+        static bool enabled() { return budget > 0; }
+
+        // Counters summed over all models
+        static Stats stats();
+
+        // Path of the clusters file of model `objFilePath`
+        static std::string filePath(const std::string& objFilePath);
+
+        // Writes the clusters file of model `objFilePath`, partitioning `bvh`,
+        // which is built over all of its triangles. `triangle(i)` is the record
+        // of primitive `i` of `bvh` (in the order leaves reference them).
+        // Returns false on failure.
+        static bool write(const std::string& objFilePath, const Cluster& bvh,
+                          const std::vector<comUtils::materials::MaterialInfo>& materials,
+                          const std::function<TriangleRecord(size_t)>& triangle);
+
+        bool hit(const Ray& r, Interval rayT, HitRecord& rec) const override;
+
+        bool occluded(const Ray& r, Interval rayT) const override;
+
+        Aabb boundingBox() const override { return file.topNodes.empty() ? Aabb::empty : file.topNodes[0].bbox; }
+
+        // Loads the clusters holding emitters, and keeps them resident
+        void collectEmitters(std::vector<const Hittable*>& emitters) const override;
+
+    private:
+        // Largest number of triangles in a cluster
+        static const size_t clusterSize = 16384;
+        // Clusters start at multiples of this in the file
+        static const size_t pageSize = 4096;
+
+        // States of a slot
+        enum : uint8_t { Empty, Loading, Resident };
+
+        struct Slot {
+            // Read and replaced with the atomic functions of `std::shared_ptr`,
+            // so that resident clusters are acquired without locking
+            std::shared_ptr<const Cluster> cluster;
+            // Only one thread reads a cluster: the one that moves it from `Empty`
+            // to `Loading` (the others wait for it)
+            std::atomic<uint8_t> state{Empty};
+            std::atomic<bool> pinned{false};
+            // Value of `clock` when the cluster was last used
+            std::atomic<uint64_t> lastUse{0};
+            size_t bytes = 0;
+        };
+
+        File file;
+        std::vector<const Material*> materials;
+        mutable std::vector<Slot> slots;
+        // Counts the loads: clusters used since the last load have the same stamp,
+        // which is all the eviction needs to tell them apart
+        mutable std::atomic<uint64_t> clock{0};
+        mutable size_t residentBytes = 0;
+        // Guards the loaded clusters' bookkeeping and their eviction (clusters
+        // are read from the file outside of it)
+        mutable std::mutex mutex;
+        // Serializes the reads of clusters from the file, so that they stay
+        // sequential rather than interleaved
+        mutable std::mutex ioMutex;
+        // Signaled when a cluster has been loaded
+        mutable std::condition_variable loaded;
+
+        inline static std::atomic<size_t> budget{0};
+        inline static std::atomic<uint64_t> loads{0};
+        inline static std::atomic<uint64_t> evictions{0};
+        inline static std::atomic<uint64_t> bytesRead{0};
+        inline static std::atomic<size_t> totalResidentBytes{0};
+        // Cluster of the last closest hit found by each thread: kept alive until
+        // the thread's next query, so that the hit triangle can be shaded
+        inline static thread_local std::shared_ptr<const Cluster> lastHit;
+
+        // Cluster `index`, read from the file if it isn't resident
+        std::shared_ptr<const Cluster> acquire(uint32_t index, bool pin = false) const;
+
+        // Reads cluster `index` from the file
+        std::shared_ptr<const Cluster> load(uint32_t index) const;
+
+        // Releases least recently used clusters, other than `loadedIndex`, until
+        // the resident ones fit the budget (clusters in use by a thread are freed
+        // when it's done with them). Called with `mutex` held.
+        void evict(uint32_t loadedIndex) const;
+};
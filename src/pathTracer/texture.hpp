@@ -4,20 +4,26 @@
 #include "image.hpp"
 #include "interval.hpp"
 
+#include <algorithm>
+
 class Texture {
     public:
         virtual ~Texture() = default;
-        virtual Color value(float u, float v, const Point3& p) const = 0;
+        // `uvFootprint` is the width of the lookup's footprint, in u,v units
+        // (0 for a point lookup). Textures stored as images use it to filter.
+        virtual Color value(float u, float v, const Point3& p, float uvFootprint) const = 0;
+        // Whether `value` depends on the u,v texture coordinates
+        virtual bool usesTexCoords() const { return false; }
 };
 
-class SolidColor : public Texture {
+class SolidColor final : public Texture {
     public:
         SolidColor(const Color& albedo) : albedo(albedo) {}
 
         SolidColor(float r, float g, float b)
             : SolidColor(Color(r, g, b)) {}
 
-        Color value(float u, float v, const Point3& p) const override {
+        Color value(float u, float v, const Point3& p, float uvFootprint) const override {
             return albedo;
         }
 
@@ -28,15 +34,12 @@ class SolidColor : public Texture {
 using std::shared_ptr;
 using std::make_shared;
 
-class CheckerTexture : public Texture {
+class CheckerTexture final : public Texture {
     public:
-        CheckerTexture(float scale, shared_ptr<Texture> even, shared_ptr<Texture> odd)
+        CheckerTexture(float scale, const Texture* even, const Texture* odd)
             : scale(scale), even(even), odd(odd) {}
 
-        CheckerTexture(float scale, const Color& c1, const Color& c2)
-            : CheckerTexture(scale, make_shared<SolidColor>(c1), make_shared<SolidColor>(c2)) {}
-
-        Color value(float u, float v, const Point3& p) const override {
+        Color value(float u, float v, const Point3& p, float uvFootprint) const override {
             float invScale = 1.0f / scale;
             int xInteger = int(std::floor(invScale * p.x));
             int yInteger = int(std::floor(invScale * p.y));
@@ -44,20 +47,24 @@ class CheckerTexture : public Texture {
 
             bool isEven = (xInteger + yInteger + zInteger) % 2 == 0;
 
-            return isEven ? even->value(u, v, p) : odd->value(u, v, p);
+            return isEven ? even->value(u, v, p, uvFootprint) : odd->value(u, v, p, uvFootprint);
+        }
+
+        bool usesTexCoords() const override {
+            return even->usesTexCoords() || odd->usesTexCoords();
         }
 
     private:
         float scale;
-        shared_ptr<Texture> even;
-        shared_ptr<Texture> odd;
+        const Texture* even;
+        const Texture* odd;
 };
 
-class ImageTexture : public Texture {
+class ImageTexture final : public Texture {
     public:
         ImageTexture(std::shared_ptr<Image> image) : image(image) {}
 
-        Color value(float u, float v, const Point3& p) const override {
+        Color value(float u, float v, const Point3& p, float uvFootprint) const override {
             // If we have no texture data, then return solid cyan as a debugging aid
             if (image->height() <= 0) return Color(0, 1, 1);
 
@@ -70,15 +77,19 @@ class ImageTexture : public Texture {
                 v = 1.0 - v;  
             #endif
 
-            int i = int(u * image->width());
-            int j = int(v * image->height());
-            auto pixel = image->pixelData(i, j);
-
-            auto colorScale = 1.0 / 255.0;
-            return Color(colorScale * pixel[0], colorScale * pixel[1],
-                         colorScale * pixel[2]);
+            #ifdef TRILINEAR_TEXTURE_FILTERING
+                // Pick mip levels so that the footprint covers about one texel
+                float lod = (uvFootprint > 0)
+                            ? std::log2(uvFootprint * std::max(image->width(), image->height()))
+                            : 0.0f;
+                return image->trilinear(u, v, lod);
+            #else
+                return image->bilinear(u, v, 0);
+            #endif
         }
 
+        bool usesTexCoords() const override { return true; }
+
     private:
         std::shared_ptr<Image> image;
 };
\ No newline at end of file
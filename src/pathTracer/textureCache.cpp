@@ -0,0 +1,127 @@
+#include "textureCache.hpp"
+
+#include <filesystem>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+TextureCache& TextureCache::instance() {
+    static TextureCache cache;
+    return cache;
+}
+
+void TextureCache::setBudget(size_t bytes) {
+    // Pages are released with madvise, which only works on whole pages of the system
+    long systemPageSize = sysconf(_SC_PAGESIZE);
+    if (bytes > 0 && (systemPageSize <= 0 || pageSize % systemPageSize != 0)) {
+        std::clog << "Warning: texture cache disabled (memory pages of " << systemPageSize
+                  << " bytes don't divide its pages of " << pageSize << " bytes)\n";
+        bytes = 0;
+    }
+    budget = bytes;
+}
+
+std::string TextureCache::tiledFilePath(const std::string& sourcePath) {
+    // Name after the source file, plus a hash of its full path to tell apart
+    // files with the same name in different directories
+    std::filesystem::path source(sourcePath);
+    size_t pathHash = std::hash<std::string>{}(std::filesystem::absolute(source).string());
+    char hashString[17];
+    snprintf(hashString, sizeof(hashString), "%016zx", pathHash);
+    return std::string(TEXTURE_CACHE_DIR) + "/" + source.stem().string() + "-" + hashString + ".tiles";
+}
+
+TextureCache::Mapping* TextureCache::map(const std::string& filePath, size_t headerSize) {
+    int fd = open(filePath.c_str(), O_RDONLY);
+    if (fd < 0) return nullptr;
+    off_t length = lseek(fd, 0, SEEK_END);
+    void* base = (length > off_t(headerSize))
+                 ? mmap(nullptr, length, PROT_READ, MAP_PRIVATE, fd, 0) : MAP_FAILED;
+    close(fd);
+    if (base == MAP_FAILED) return nullptr;
+    // Access is random: don't read ahead around faulting pages
+    madvise(base, length, MADV_RANDOM);
+
+    std::lock_guard<std::mutex> lock(mutex);
+    Mapping& m = mappings.emplace_back();
+    m.cache = this;
+    m.base = static_cast<unsigned char*>(base);
+    m.length = length;
+    m.headerSize = headerSize;
+    m.numberOfPages = (length - headerSize) / pageSize;
+    m.state = std::make_unique<std::atomic<uint8_t>[]>(m.numberOfPages);
+    for (size_t i = 0; i < m.numberOfPages; i++) m.state[i].store(0);
+    return &m;
+}
+
+void TextureCache::unmap(Mapping* mapping) {
+    std::lock_guard<std::mutex> lock(mutex);
+    for (size_t i = 0; i < mapping->numberOfPages; i++) {
+        if (mapping->state[i] & Mapping::resident) residentPages--;
+    }
+    munmap(mapping->base, mapping->length);
+    // The entry stays in `mappings` (other mappings' addresses must not change),
+    // but without pages it's skipped by the clock hand
+    mapping->base = nullptr;
+    mapping->numberOfPages = 0;
+    mapping->state.reset();
+}
+
+TextureCache::Stats TextureCache::stats() const {
+    std::lock_guard<std::mutex> lock(mutex);
+    Stats s{0, 0, evictions, residentPages * pageSize};
+    for (const Counters& c : counters) {
+        s.hits += c.hits.load(std::memory_order_relaxed);
+        s.misses += c.misses.load(std::memory_order_relaxed);
+    }
+    return s;
+}
+
+TextureCache::Counters* TextureCache::registerThread() {
+    std::lock_guard<std::mutex> lock(mutex);
+    localCounters = &counters.emplace_back();
+    return localCounters;
+}
+
+void TextureCache::pageIn(Mapping& mapping, size_t page) {
+    Counters* c = localCounters ? localCounters : registerThread();
+    std::lock_guard<std::mutex> lock(mutex);
+    // Another thread may have paged it in meanwhile
+    if (mapping.state[page] & Mapping::resident) {
+        c->hits.store(c->hits.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+        return;
+    }
+    c->misses.store(c->misses.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+    // The page itself is faulted in by the caller's read
+    mapping.state[page] = Mapping::resident | Mapping::referenced;
+    residentPages++;
+    evict();
+}
+
+void TextureCache::evict() {
+    // Pages read by other threads while they're released are simply faulted
+    // in again from the file, so readers never need to take the lock
+    while (residentPages * pageSize > budget && residentPages > 1) {
+        if (handMapping >= mappings.size()) handMapping = 0;
+        Mapping& m = mappings[handMapping];
+        if (handPage >= m.numberOfPages) {
+            handMapping++;
+            handPage = 0;
+            continue;
+        }
+        std::atomic<uint8_t>& s = m.state[handPage];
+        uint8_t value = s.load();
+        if (value & Mapping::referenced) {
+            // Second chance
+            s.fetch_and(uint8_t(~Mapping::referenced));
+        } else if ((value & Mapping::resident) && s.compare_exchange_strong(value, 0)) {
+            // (not evicted if a reader referenced it meanwhile)
+            if (madvise(m.base + m.headerSize + handPage * pageSize, pageSize, MADV_DONTNEED) != 0) {
+                fatalError("Error: failed releasing a texture cache page");
+            }
+            residentPages--;
+            evictions++;
+        }
+        handPage++;
+    }
+}
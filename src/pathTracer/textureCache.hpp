@@ -0,0 +1,121 @@
+#pragma once
+
+#include "myPT.hpp"
+
+#include <atomic>
+#include <cstdint>
+#include <deque>
+#include <mutex>
+
+// Keeps tiled, mipmapped texture files (see `Image`) memory-mapped, and
+// bounds how much of them is resident: pages are brought in on first access,
+// and when the resident pages exceed the memory budget, the least recently
+// used ones are released (CLOCK approximation of LRU).
+// A single cache is shared by all textures and all rendering threads.
+class TextureCache {
+    public:
+        // Unit in which texture data is paged in and out
+        static const size_t pageSize = 4096;
+
+        struct Stats {
+            uint64_t hits;
+            uint64_t misses;
+            uint64_t evictions;
+            size_t residentBytes;
+        };
+
+        // A memory-mapped file: `headerSize` bytes of header, followed by pages
+        // of texture data
+        class Mapping {
+            public:
+                // Start of the data pages
+                const void* data() const { return base + headerSize; }
+
+                // Start of the header
+                const void* header() const { return base; }
+
+                // Must be called before reading data page `page`
+                void touch(size_t page) {
+                    std::atomic<uint8_t>& s = state[page];
+                    uint8_t value = s.load(std::memory_order_relaxed);
+                    // The reference bit is only set while the page is still resident:
+                    // if it's evicted meanwhile, the exchange fails with `value` 0
+                    while (value & resident) {
+                        if ((value & referenced)
+                            || s.compare_exchange_weak(value, value | referenced, std::memory_order_relaxed)) {
+                            countHit();
+                            return;
+                        }
+                    }
+                    cache->pageIn(*this, page);
+                }
+
+            private:
+                friend class TextureCache;
+                // Page state flags
+                static const uint8_t resident = 1;
+                static const uint8_t referenced = 2;
+
+                TextureCache* cache;
+                unsigned char* base;
+                size_t length;
+                size_t headerSize;
+                size_t numberOfPages;
+                std::unique_ptr<std::atomic<uint8_t>[]> state;
+        };
+
+        // The cache shared by all textures
+        static TextureCache& instance();
+
+        // A budget of 0 disables the cache (textures are fully loaded in memory).
+        // So does a system whose memory pages don't divide `pageSize`.
+        void setBudget(size_t bytes);
+        size_t getBudget() const { return budget; }
+        bool enabled() const { return budget > 0; }
+
+        // Directory and file name of the tiled file made from image `sourcePath`
+        static std::string tiledFilePath(const std::string& sourcePath);
+
+        // Maps file `filePath`, whose data pages start after `headerSize` bytes.
+        // Returns null if the file can't be mapped.
+        Mapping* map(const std::string& filePath, size_t headerSize);
+
+        void unmap(Mapping* mapping);
+
+        // Counters summed over all threads
+        Stats stats() const;
+
+    private:
+        TextureCache() {}
+
+        // Per-thread counters, so that threads don't contend on them
+        struct alignas(64) Counters {
+            std::atomic<uint64_t> hits{0};
+            std::atomic<uint64_t> misses{0};
+        };
+        inline static thread_local Counters* localCounters = nullptr;
+
+        size_t budget = 0;
+        std::deque<Mapping> mappings;
+        std::deque<Counters> counters;
+        // Clock hand: next page considered for eviction
+        size_t handMapping = 0;
+        size_t handPage = 0;
+        size_t residentPages = 0;
+        uint64_t evictions = 0;
+        // Guards everything but the counters of each thread
+        mutable std::mutex mutex;
+
+        static void countHit() {
+            Counters* c = localCounters ? localCounters : instance().registerThread();
+            c->hits.store(c->hits.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+        }
+
+        Counters* registerThread();
+
+        // Slow path of `Mapping::touch`, for a page that isn't resident
+        void pageIn(Mapping& mapping, size_t page);
+
+        // Releases pages until the resident ones fit the budget
+        void evict();
+};
@@ -0,0 +1,131 @@
+#include "trace.hpp"
+
+#ifdef TRACE_EVENTS
+
+#include <cstring>
+#include <fstream>
+#include <iomanip>
+#include <mutex>
+
+namespace {
+    using Clock = std::chrono::steady_clock;
+
+    // Start of the timeline
+    const Clock::time_point epoch = Clock::now();
+
+    uint64_t now() {
+        return std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now() - epoch).count();
+    }
+
+    struct Event {
+        const char* name;
+        const char* category;
+        uint64_t start;
+        uint64_t end;
+        char detail[80];
+    };
+
+    // Events of a thread, written only by that thread
+    struct Buffer {
+        // Events kept per thread (tracing is for coarse events: this is plenty)
+        static const size_t capacity = 8192;
+
+        std::vector<Event> events = std::vector<Event>(capacity);
+        // Events recorded so far (the last `capacity` are kept)
+        uint64_t count = 0;
+        int threadId;
+        const char* threadName = nullptr;
+    };
+
+    // Buffers of every thread that recorded an event, kept after the thread exits
+    std::vector<std::unique_ptr<Buffer>> buffers;
+    std::mutex buffersMutex;
+
+    // Buffer of the calling thread, registered on first use
+    Buffer& threadBuffer() {
+        thread_local Buffer* buffer = nullptr;
+        if (!buffer) {
+            std::lock_guard<std::mutex> lock(buffersMutex);
+            buffers.push_back(std::make_unique<Buffer>());
+            buffer = buffers.back().get();
+            buffer->threadId = buffers.size();
+        }
+        return *buffer;
+    }
+
+    void writeString(std::ostream& out, const char* s) {
+        out << '"';
+        for (; *s; s++) {
+            if (*s == '"' || *s == '\\') out << '\\';
+            out << *s;
+        }
+        out << '"';
+    }
+}
+
+trace::Scope::Scope(const char* name, const char* category, const char* detail)
+    : name(name), category(category), detail(detail), start(now()) {}
+
+trace::Scope::~Scope() {
+    Buffer& buffer = threadBuffer();
+    Event& event = buffer.events[buffer.count % Buffer::capacity];
+    event.name = name;
+    event.category = category;
+    event.start = start;
+    event.end = now();
+    event.detail[0] = '\0';
+    if (detail) {
+        std::strncpy(event.detail, detail, sizeof(event.detail) - 1);
+        event.detail[sizeof(event.detail) - 1] = '\0';
+    }
+    buffer.count++;
+}
+
+void trace::setThreadName(const char* name) {
+    threadBuffer().threadName = name;
+}
+
+void trace::write(const std::string& filePath) {
+    std::ofstream file(filePath);
+    if (!file) {
+        std::clog << "Failed writing trace to " << filePath << "\n";
+        return;
+    }
+    std::lock_guard<std::mutex> lock(buffersMutex);
+    // Complete ("X") events, in microseconds, and the names of the threads
+    file << std::fixed << std::setprecision(3);
+    file << "{\"displayTimeUnit\": \"ms\", \"traceEvents\": [\n";
+    bool first = true;
+    uint64_t events = 0, dropped = 0;
+    for (const auto& buffer : buffers) {
+        file << (first ? "" : ",\n") << "{\"name\": \"thread_name\", \"ph\": \"M\", \"pid\": 1, \"tid\": "
+             << buffer->threadId << ", \"args\": {\"name\": ";
+        writeString(file, buffer->threadName ? buffer->threadName : "worker");
+        file << "}}";
+        first = false;
+        uint64_t kept = std::min<uint64_t>(buffer->count, Buffer::capacity);
+        dropped += buffer->count - kept;
+        for (uint64_t i = buffer->count - kept; i < buffer->count; i++) {
+            const Event& event = buffer->events[i % Buffer::capacity];
+            file << ",\n{\"name\": ";
+            writeString(file, event.name);
+            file << ", \"cat\": ";
+            writeString(file, event.category);
+            file << ", \"ph\": \"X\", \"pid\": 1, \"tid\": " << buffer->threadId
+                 << ", \"ts\": " << event.start / 1000.0 << ", \"dur\": " << (event.end - event.start) / 1000.0;
+            if (event.detail[0]) {
+                file << ", \"args\": {\"detail\": ";
+                writeString(file, event.detail);
+                file << "}";
+            }
+            file << "}";
+            events++;
+        }
+    }
+    file << "\n]}\n";
+    std::clog << "Trace of " << events << " events written to " << filePath;
+    if (dropped) std::clog << " (" << dropped << " older events overwritten)";
+    std::clog << "\n";
+}
+
+#endif
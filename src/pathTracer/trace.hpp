@@ -0,0 +1,50 @@
+#pragma once
+
+#include "myPT.hpp"
+
+#include <cstdint>
+
+// EVENT TRACING
+// Scoped events (model loading, material parsing, texture decoding, BVH builds,
+// sub-images rendered by each thread, image writing...) recorded on a timeline,
+// and written in the Chrome trace event format, to be opened in Perfetto
+// (ui.perfetto.dev) or chrome://tracing.
+// Each thread records its events in its own ring buffer, without synchronization
+// (when a buffer is full, the oldest events are overwritten).
+// Tracing is only compiled in with TRACE_EVENTS (see myPT.hpp): otherwise
+// scopes are empty, and cost nothing.
+namespace trace {
+#ifdef TRACE_EVENTS
+    // Records an event from its construction to its destruction. `name` and
+    // `category` must be string literals (only their address is kept);
+    // `detail` (e.g. a file name) is copied, and shown as the event's argument.
+    class Scope {
+        public:
+            Scope(const char* name, const char* category, const char* detail = nullptr);
+            ~Scope();
+
+            Scope(const Scope&) = delete;
+            Scope& operator=(const Scope&) = delete;
+
+        private:
+            const char* name;
+            const char* category;
+            const char* detail;
+            uint64_t start;
+    };
+
+    // Name of the calling thread on the timeline (must be a string literal)
+    void setThreadName(const char* name);
+
+    // Writes the events recorded so far by every thread to `filePath`
+    void write(const std::string& filePath);
+#else
+    class Scope {
+        public:
+            Scope(const char*, const char*, const char* = nullptr) {}
+    };
+
+    inline void setThreadName(const char*) {}
+    inline void write(const std::string&) {}
+#endif
+}
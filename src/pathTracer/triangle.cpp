@@ -1,70 +1,80 @@
 #include "triangle.hpp"
+#include "material.hpp"
 
-Triangle::Triangle(Vertex v0, Vertex v1, Vertex v2, std::shared_ptr<Material> mat)
-        : v0(v0), v1(v1), v2(v2), mat(mat) {
+Triangle::Triangle(Vertex v0, Vertex v1, Vertex v2, const Material* mat)
+        : p0(v0.position), mat(mat) {
+    needsTexCoords = mat->usesTexCoords();
     e1 = v1.position - v0.position;
     e2 = v2.position - v0.position;
-    setBoundingBox();
+#ifdef COMPACT_VERTICES
+    normals[0] = compactVertex::encodeNormal(v0.normal);
+    normals[1] = compactVertex::encodeNormal(v1.normal);
+    normals[2] = compactVertex::encodeNormal(v2.normal);
+    texCoords = compactVertex::TexCoords(v0.texCoords, v1.texCoords, v2.texCoords);
+#else
+    normals[0] = v0.normal;
+    normals[1] = v1.normal;
+    normals[2] = v2.normal;
+    texCoords[0] = v0.texCoords;
+    texCoords[1] = v1.texCoords;
+    texCoords[2] = v2.texCoords;
+#endif
+    // Ratio between the sizes of the triangle in texture space and in world space
+    float worldArea = glm::length(glm::cross(e1, e2));
+    glm::vec2 t1 = v1.texCoords - v0.texCoords;
+    glm::vec2 t2 = v2.texCoords - v0.texCoords;
+    float uvArea = std::fabs(t1.x * t2.y - t1.y * t2.x);
+    uvDensity = (worldArea > 0) ? std::sqrt(uvArea / worldArea) : 0.0f;
+    setBoundingBox(v1.position, v2.position);
 }
 
-bool Triangle::hit(const Ray& r, Interval rayT, HitRecord& rec) const {
-    // Check if ray hits triangle using the Muller-Trumbore method
-    Point3 p0 = v0.position;
-    /*
-    P intersection of ray on plane:
-    P = O + td
-    P = p0 + ue1 + ve2
-    
-    O + td = p0 + ue1 + ve2
-    -td + ue1 + ve2 = O - p0
-    */
-    
-    Vec3 pvec = glm::cross(r.direction(), e2);
-    float det = glm::dot(pvec, e1);
-
-    if (std::fabs(det) < 1e-8) return false; // triangle and ray are parallel
-    
-    float invDet = 1.0f / det;
-    
-    // u and v are barycentric coordinates:
-    // P = (1-u-v)v0 + uv1 + vv2
-    // 0 <= u,v <= 1
-    // where P is a point on the triangle
-
-    Vec3 tvec = r.origin() - p0;
-    float u = glm::dot(pvec, tvec) * invDet;
-    if (u < 0.0f || u > 1.0f ) return false;
-
-    Vec3 qvec = glm::cross(tvec, e1);
-    float v = glm::dot(qvec, r.direction()) * invDet;
-    if (v < 0.0f || u + v > 1.0f) return false;
-    
-    float t = glm::dot(qvec, e2) * invDet;
-    if (!rayT.contains(t)) return false;
+void Triangle::computeSurfaceInteraction(const Ray& r, HitRecord& rec) const {
+    float u = rec.b1;
+    float v = rec.b2;
 
-    Point3 intersection = r.at(t);
-   
-    rec.t = t;
-    rec.p = intersection;
+    rec.p = r.at(rec.t);
     rec.material = mat;
 
     // Interpolate normal values from vertices
-    Vec3 normal = v0.normal*(1-u-v) + v1.normal*u + v2.normal*v; 
+    Vec3 normal = vertexNormal(0)*(1-u-v) + vertexNormal(1)*u + vertexNormal(2)*v;
     rec.setFaceNormal(r, normal);
     
     // Interpolate texture coordinates (u and v)
     // (different meaning from barycentric coordinates)
-    rec.u = v0.texCoords.x*(1-u-v) + v1.texCoords.x*u + v2.texCoords.x*v;
-    rec.v = v0.texCoords.y*(1-u-v) + v1.texCoords.y*u + v2.texCoords.y*v;
+    if (needsTexCoords) {
+        glm::vec2 t0 = texCoords[0], t1 = texCoords[1], t2 = texCoords[2];
+        rec.u = t0.x*(1-u-v) + t1.x*u + t2.x*v;
+        rec.v = t0.y*(1-u-v) + t1.y*u + t2.y*v;
+        rec.uvFootprint = rec.footprint * uvDensity;
+    } else {
+        rec.u = rec.v = 0.0f;
+    }
+}
+
+void Triangle::collectEmitters(std::vector<const Hittable*>& emitters) const {
+    if (mat->isEmissive()) emitters.push_back(this);
+}
+
+float Triangle::area() const {
+    return 0.5f * glm::length(glm::cross(e1, e2));
+}
+
+Point3 Triangle::sampleSurface(float u1, float u2, Vec3& normal) const {
+    // Uniform barycentric coordinates (the square root warps the unit square
+    // so that points don't gather near v0)
+    float su = std::sqrt(u1);
+    float b1 = su * (1.0f - u2);
+    float b2 = su * u2;
+    normal = geometricNormal(p0);
+    return p0 + b1*e1 + b2*e2;
+}
 
-    return true;
+Vec3 Triangle::geometricNormal(const Point3& q) const {
+    return glm::normalize(glm::cross(e1, e2));
 }
 
-void Triangle::setBoundingBox() {
+void Triangle::setBoundingBox(const Point3& p1, const Point3& p2) {
     // Compute the triangle's bounding box
-    Point3 p0 = v0.position;
-    Point3 p1 = v1.position;
-    Point3 p2 = v2.position;
 
     float minX = fmin(p0.x, fmin(p1.x, p2.x));
     float minY = fmin(p0.y, fmin(p1.y, p2.y));
@@ -3,6 +3,7 @@
 #include "myPT.hpp"
 #include "ray.hpp"
 #include "hittable.hpp"
+#include "compactVertex.hpp"
 
 struct Vertex {
     Point3 position;
@@ -15,24 +16,121 @@ struct Vertex {
           texCoords(glm::vec2(0.0f,0.0f)){}
 };
 
-class Triangle : public Hittable {
+// `final`, so that calls through a `Triangle` (e.g. in `FlatBvh<Triangle>`)
+// are resolved at compile time and can be inlined
+class Triangle final : public Hittable {
     public:
-        Triangle(Vertex v0, Vertex v1, Vertex v2, std::shared_ptr<Material> mat);
+        Triangle(Vertex v0, Vertex v1, Vertex v2, const Material* mat);
         
         bool hit(const Ray& r, Interval rayT, HitRecord& rec) const override;
+
+        void computeSurfaceInteraction(const Ray& r, HitRecord& rec) const override;
+
+        bool occluded(const Ray& r, Interval rayT) const override;
         
         Aabb boundingBox() const override {return bbox;}
+
+        void collectEmitters(std::vector<const Hittable*>& emitters) const override;
+
+        const Material* getMaterial() const override {return mat;}
+
+        float area() const override;
+
+        Point3 sampleSurface(float u1, float u2, Vec3& normal) const override;
+
+        Vec3 geometricNormal(const Point3& q) const override;
     
     private:
-        // Triangle vertices
-        Vertex v0;
-        Vertex v1;
-        Vertex v2;
+        // Position of the first vertex, and edges towards the other two
+        Point3 p0;
         Vec3 e1; // v1 - v0
         Vec3 e2; // v2 - v0
+
+        // Vertex normals and texture coordinates, only read when shading
+        // (in `computeSurfaceInteraction`)
+#ifdef COMPACT_VERTICES
+        compactVertex::OctNormal normals[3];
+        compactVertex::TexCoords texCoords;
+#else
+        Vec3 normals[3];
+        glm::vec2 texCoords[3];
+#endif
+        // (the two members below fit in the padding after the compact texture coordinates)
+        // Whether `mat` needs texture coordinates to be interpolated
+        bool needsTexCoords;
+        // Texture coordinate units per world unit, used to convert ray footprints
+        float uvDensity;
         
-        std::shared_ptr<Material> mat;
+        // Owned by the scene (see `SceneArena`)
+        const Material* mat;
         Aabb bbox;
 
-        void setBoundingBox();
-};
\ No newline at end of file
+        void setBoundingBox(const Point3& p1, const Point3& p2);
+
+        Vec3 vertexNormal(int i) const {
+#ifdef COMPACT_VERTICES
+            return compactVertex::decodeNormal(normals[i]);
+#else
+            return normals[i];
+#endif
+        }
+
+        // Ray-triangle intersection test. On success, `t` is the ray parameter
+        // and `u`,`v` are the barycentric coordinates of the intersection.
+        bool intersect(const Ray& r, Interval rayT, float& t, float& u, float& v) const;
+};
+
+// Intersection routines are defined here so that they can be inlined
+// in the traversal loop
+
+inline bool Triangle::hit(const Ray& r, Interval rayT, HitRecord& rec) const {
+    float t, u, v;
+    if (!intersect(r, rayT, t, u, v)) return false;
+
+    rec.t = t;
+    rec.object = this;
+    rec.b1 = u;
+    rec.b2 = v;
+
+    return true;
+}
+
+inline bool Triangle::occluded(const Ray& r, Interval rayT) const {
+    float t, u, v;
+    return intersect(r, rayT, t, u, v);
+}
+
+inline bool Triangle::intersect(const Ray& r, Interval rayT, float& t, float& u, float& v) const {
+    // Check if ray hits triangle using the Muller-Trumbore method
+    /*
+    P intersection of ray on plane:
+    P = O + td
+    P = p0 + ue1 + ve2
+    
+    O + td = p0 + ue1 + ve2
+    -td + ue1 + ve2 = O - p0
+    */
+    
+    Vec3 pvec = glm::cross(r.direction(), e2);
+    float det = glm::dot(pvec, e1);
+
+    if (std::fabs(det) < 1e-8) return false; // triangle and ray are parallel
+    
+    float invDet = 1.0f / det;
+    
+    // u and v are barycentric coordinates:
+    // P = (1-u-v)v0 + uv1 + vv2
+    // 0 <= u,v <= 1
+    // where P is a point on the triangle
+
+    Vec3 tvec = r.origin() - p0;
+    u = glm::dot(pvec, tvec) * invDet;
+    if (u < 0.0f || u > 1.0f ) return false;
+
+    Vec3 qvec = glm::cross(tvec, e1);
+    v = glm::dot(qvec, r.direction()) * invDet;
+    if (v < 0.0f || u + v > 1.0f) return false;
+    
+    t = glm::dot(qvec, e2) * invDet;
+    return rayT.contains(t);
+}
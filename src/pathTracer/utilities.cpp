@@ -1,5 +1,8 @@
 #include "utilities.hpp"
 
+#include <algorithm>
+#include <atomic>
+
 using std::fabs;
 
 float randomFloat() {
@@ -55,6 +58,26 @@ bool nearZero(Vec3 v){
     return ((fabs(v.x) < s) && (fabs(v.y) < s) && (fabs(v.z) < s));
 }
 
+float powerHeuristic(float pdfA, float pdfB) {
+    float a = pdfA * pdfA;
+    float b = pdfB * pdfB;
+    if (a + b <= 0) return 0.0f;
+    return a / (a + b);
+}
+
+void parallelFor(size_t count, const std::function<void(size_t)>& body) {
+    size_t nThreads = std::min<size_t>(std::max(1u, std::thread::hardware_concurrency()), count);
+    // Each thread takes the next index that hasn't been taken yet
+    std::atomic<size_t> next(0);
+    auto work = [&]() {
+        for (size_t i = next++; i < count; i = next++) body(i);
+    };
+    std::vector<std::thread> threads;
+    for (size_t t = 1; t < nThreads; t++) threads.emplace_back(work);
+    work();
+    for (std::thread& thread : threads) thread.join();
+}
+
 float linearToGamma(float linear){
     if (linear > 0){
         return sqrt(linear);
@@ -81,6 +104,10 @@ void writeColor(std::ostream &out, const Color &pixelColor) {
     out << rbyte << ' ' << gbyte << ' ' << bbyte << '\n';
 }
 
+float luminance(const Color& c) {
+    return 0.2126f*c.x + 0.7152f*c.y + 0.0722f*c.z;
+}
+
 using std::string, std::ifstream;
 using namespace comUtils::input;
 
@@ -108,4 +135,36 @@ int ptInput::readNumThreads(const std::string& inputFileName){
 
 int ptInput::readNumSubImages(const std::string& inputFileName){
     return details::readParameterAt<int>(inputFileName, 51);
-}
\ No newline at end of file
+}
+
+std::string ptInput::readEnvironmentMap(const std::string& inputFileName){
+    return details::readParameterAt<string>(inputFileName, 55);
+}
+
+float ptInput::readEnvironmentIntensity(const std::string& inputFileName){
+    return details::readParameterAt<float>(inputFileName, 57);
+}
+
+int ptInput::readTextureCacheBudget(const std::string& inputFileName){
+    return details::readParameterAt<int>(inputFileName, 61);
+}
+
+int ptInput::readGeometryBudget(const std::string& inputFileName){
+    return details::readParameterAt<int>(inputFileName, 65);
+}
+
+bool ptInput::readDenoise(const std::string& inputFileName){
+    return details::readParameterAt<int>(inputFileName, 69) != 0;
+}
+
+std::string ptInput::readAovs(const std::string& inputFileName){
+    return details::readParameterAt<string>(inputFileName, 73);
+}
+
+int ptInput::readGuidingPasses(const std::string& inputFileName){
+    return details::readParameterAt<int>(inputFileName, 77);
+}
+
+int ptInput::readRadianceCacheBounces(const std::string& inputFileName){
+    return details::readParameterAt<int>(inputFileName, 81);
+}
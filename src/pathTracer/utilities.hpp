@@ -1,6 +1,7 @@
 #pragma once
 
 #include <math.h>
+#include <functional>
 
 #include "myPT.hpp"
 #include "interval.hpp"
@@ -41,6 +42,18 @@ Vec3 randomInUnitDisk();
 // Returns true if the vector is close to zero in all dimensions
 bool nearZero(Vec3 v);
 
+// SAMPLING
+
+// Multiple importance sampling weight of a sample drawn with density `pdfA`,
+// against a strategy with density `pdfB` (power heuristic, beta = 2)
+float powerHeuristic(float pdfA, float pdfB);
+
+// PARALLELISM
+
+// Calls `body(i)` for every i in [0,count), spreading the calls over all
+// hardware threads. `body` must be safe to call concurrently.
+void parallelFor(size_t count, const std::function<void(size_t)>& body);
+
 // COLORS
 
 // Applies a linear to gamma transform for gamma = 2
@@ -48,6 +61,9 @@ float linearToGamma(float linear);
 
 void writeColor(std::ostream &out, const Color &pixelColor);
 
+// Returns the luminance (perceived brightness) of a linear color
+float luminance(const Color& c);
+
 // CAMERA SETUP FROM INPUT FILE
 
 // needed to solve dependencies
@@ -66,4 +82,34 @@ namespace ptInput {
     // Returns number of sub-images to divide the output image in,
     // as specified in the input file  
     int readNumSubImages(const std::string& inputFileName);
+
+    // Returns the path of the environment map specified in the input file
+    // ("none" if there isn't one)
+    std::string readEnvironmentMap(const std::string& inputFileName);
+
+    // Returns the factor that scales the environment map's radiance
+    float readEnvironmentIntensity(const std::string& inputFileName);
+
+    // Returns the memory budget of the texture cache, in megabytes
+    // (0 if textures should be fully loaded in memory instead)
+    int readTextureCacheBudget(const std::string& inputFileName);
+
+    // Returns the memory budget of a model's resident geometry, in megabytes
+    // (0 if models should be fully loaded in memory instead)
+    int readGeometryBudget(const std::string& inputFileName);
+
+    // Returns whether a denoised image should also be written
+    bool readDenoise(const std::string& inputFileName);
+
+    // Returns the names of the output variables to write (comma-separated),
+    // or "none"
+    std::string readAovs(const std::string& inputFileName);
+
+    // Returns the number of path guiding training passes (0 if path guiding
+    // is disabled)
+    int readGuidingPasses(const std::string& inputFileName);
+
+    // Returns the number of bounces after which paths end in the radiance
+    // cache (0 if the cache is disabled, for unbiased rendering)
+    int readRadianceCacheBounces(const std::string& inputFileName);
 }
\ No newline at end of file
@@ -17,6 +17,10 @@ void Model::loadModel(std::string path) {
     if(!scene || scene->mFlags & AI_SCENE_FLAGS_INCOMPLETE || !scene->mRootNode) {
         fatalError(string("ERROR::ASSIMP::") + import.GetErrorString());
     }
+    // Read the .mtl file once, for all meshes
+    string mtlFilePath = objFilePath;
+    mtlFilePath.replace(objFilePath.length()-3, 3, "mtl");
+    materialLibrary = readMaterialLibrary(mtlFilePath);
     processNode(scene->mRootNode, scene);
 }
 
@@ -70,12 +74,8 @@ Mesh Model::processMesh(aiMesh *mesh, const aiScene *scene) {
     if (mesh->mMaterialIndex >= 0) {
         aiMaterial *material = scene->mMaterials[mesh->mMaterialIndex];
 
-        int strLength = objFilePath.length();
-        string mtlFilePath = objFilePath;
-        mtlFilePath.replace(strLength-3, 3, "mtl");
-     
         matType matType = determineMatType(material,
-                                readIllModel(material->GetName().C_Str(), mtlFilePath));        
+                                readIllModel(material->GetName().C_Str(), materialLibrary));        
 
         Mesh mesh(vertices, indices, matType);
         // Materials other than lambertian have default colors
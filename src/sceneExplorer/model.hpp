@@ -19,6 +19,8 @@ class Model {
         std::string objFilePath;
         std::vector<Mesh> meshes;
         std::vector<Texture> texturesLoaded;
+        // illumination models of the materials in the model's .mtl file
+        comUtils::materials::MaterialLibrary materialLibrary;
 
         void loadModel(std::string path);
         // Process all of the node's meshes (if any),
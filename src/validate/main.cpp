@@ -0,0 +1,296 @@
+#include "../pathTracer/myPT.hpp"
+#include "../pathTracer/scenes.hpp"
+#include "../pathTracer/imageFiles.hpp"
+#include "metrics.hpp"
+
+#include <filesystem>
+#include <iomanip>
+
+// IMAGE VALIDATION SUITE
+// Renders reduced versions of the hard-coded scenes several times, with fixed
+// seeds, and compares the mean image with a stored reference (written by an
+// earlier run with --update, from a build known to be right). Besides RMSE,
+// relMSE and a FLIP-like perceptual error, the per-pixel variance of both means
+// (estimated from the spread of the renders) tells whether a difference is
+// larger than noise: the mean difference over each tile of pixels, and over the
+// whole image, is tested against its standard error. Any significant difference
+// fails the validation, e.g. after a change that biased the renderer.
+
+struct Options {
+    std::string references = "validation/references";
+    // Renders the references instead of validating against them
+    bool update = false;
+    unsigned int seed = 1;
+    int threads = std::max(1u, std::thread::hardware_concurrency());
+    int imageWidth = 96;
+    int samplesPerPixel = 16;
+    // Independent renders of each scene, for the per-pixel variance
+    int renders = 4;
+    // Probability of flagging a scene when nothing changed (over all its tests)
+    double falseAlarmRate = 1e-3;
+    // Size of the tiles of pixels tested together
+    int tileSize = 8;
+};
+
+struct ValidationScene {
+    std::string name;
+    const Hittable* (*make)(SceneArena&);
+    Camera (*camera)();
+};
+
+std::vector<ValidationScene> validationScenes() {
+    return {{"oneWeekendSpheres", ptScenes::oneWeekendSpheres, ptScenes::oneWeekendSpheresCamera},
+            {"cornellBox", ptScenes::cornellBox, ptScenes::cornellBoxCamera},
+            {"mirrorRoom", ptScenes::mirrorRoom, ptScenes::mirrorRoomCamera}};
+}
+
+// Mean of the renders of a scene, and the variance of that mean, per pixel and channel
+struct Estimate {
+    metrics::Image mean;
+    metrics::Image variance;
+};
+
+// Reads the linear colors of a render back (rather than the 8-bit image, whose
+// gamma and clamping would make its mean depend on the variance of the render)
+metrics::Image readRender(const std::string& filePath) {
+    metrics::Image image;
+    if (!imageFiles::readPfm(filePath, image.width, image.height, image.rgb)) {
+        fatalError("Error: failed reading rendered image " + filePath);
+    }
+    return image;
+}
+
+// Seed of the randomly generated scenes, which must be the same as the reference's
+// whatever the seed of the renders
+const unsigned int sceneSeed = 1;
+
+// Renders `validationScene` with seeds `seed`, `seed`+1, ...
+Estimate renderScene(const ValidationScene& validationScene, const Options& options, unsigned int seed) {
+    // The logs of scene construction and rendering aren't part of the report
+    std::streambuf* log = std::clog.rdbuf(nullptr);
+    std::streambuf* out = std::cout.rdbuf(nullptr);
+    std::vector<metrics::Image> renders;
+    {
+        SceneArena arena;
+        srand(sceneSeed);
+        const Hittable* scene = validationScene.make(arena);
+        Camera cam = validationScene.camera();
+        cam.setImageWidth(options.imageWidth);
+        cam.setSamplesPerPixel(options.samplesPerPixel);
+        cam.setNumThreads(options.threads);
+        cam.setLinearImage(true);
+        // The radiance cache is biased by design
+        cam.setRadianceCacheBounces(0);
+        std::string name = "validate_" + validationScene.name;
+        cam.setImageName(name);
+        for (int i = 0; i < options.renders; i++) {
+            srand(seed + i);
+            cam.render(*scene);
+            renders.push_back(readRender(std::string(OUTPUT_DIR) + "/" + name + ".pfm"));
+        }
+    }
+    std::clog.rdbuf(log);
+    std::cout.rdbuf(out);
+
+    Estimate estimate;
+    estimate.mean = estimate.variance = renders[0];
+    int n = renders.size();
+    for (size_t i = 0; i < renders[0].rgb.size(); i++) {
+        double sum = 0, sumOfSquares = 0;
+        for (const metrics::Image& render : renders) {
+            sum += render.rgb[i];
+            sumOfSquares += double(render.rgb[i]) * render.rgb[i];
+        }
+        double mean = sum / n;
+        // Unbiased sample variance, divided by n for the variance of the mean
+        double sampleVariance = n > 1 ? std::max(0.0, (sumOfSquares - n * mean * mean) / (n - 1)) : 0.0;
+        estimate.mean.rgb[i] = mean;
+        estimate.variance.rgb[i] = sampleVariance / n;
+    }
+    return estimate;
+}
+
+std::string referencePath(const Options& options, const std::string& scene, const std::string& what) {
+    return options.references + "/" + scene + "_" + what + ".pfm";
+}
+
+bool readReference(const Options& options, const std::string& scene, Estimate& reference) {
+    return imageFiles::readPfm(referencePath(options, scene, "mean"), reference.mean.width,
+                               reference.mean.height, reference.mean.rgb)
+        && imageFiles::readPfm(referencePath(options, scene, "variance"), reference.variance.width,
+                               reference.variance.height, reference.variance.rgb);
+}
+
+void writeReference(const Options& options, const std::string& scene, const Estimate& reference) {
+    std::filesystem::create_directories(options.references);
+    for (auto [what, image] : {std::pair{"mean", &reference.mean}, std::pair{"variance", &reference.variance}}) {
+        std::string filePath = referencePath(options, scene, what);
+        if (!imageFiles::writePfm(filePath, image->width, image->height, image->rgb.data())) {
+            fatalError("Error: failed writing reference " + filePath);
+        }
+    }
+}
+
+// Value exceeded by a standard normal variable with probability `p` (one tail)
+double normalQuantile(double p) {
+    double low = 0, high = 40;
+    for (int i = 0; i < 100; i++) {
+        double z = (low + high) / 2;
+        (0.5 * std::erfc(z / std::sqrt(2.0)) > p ? low : high) = z;
+    }
+    return low;
+}
+
+struct Significance {
+    // Largest z-score of the mean difference over each tile, and over the image
+    double maxTileZ = 0;
+    double imageZ = 0;
+    // Tiles (and channels) whose mean difference is significant
+    int significantTiles = 0;
+    int tests = 0;
+    bool imageSignificant = false;
+};
+
+// Tests whether the mean difference between `test` and `reference`, over each
+// tile and over the whole image, is larger than the noise of both estimates.
+// Pixels are independent, so the variance of a sum of differences is the sum
+// of their variances. `zMap` receives the z-score of each pixel (channel mean).
+Significance testDifferences(const Estimate& test, const Estimate& reference, const Options& options,
+                             std::vector<float>& zMap) {
+    int width = test.mean.width, height = test.mean.height;
+    int tilesX = (width + options.tileSize - 1) / options.tileSize;
+    int tilesY = (height + options.tileSize - 1) / options.tileSize;
+    Significance result;
+    result.tests = tilesX * tilesY * 3;
+    // Two-sided tests; the false alarm rate is split between the image test and
+    // the tile tests (Bonferroni correction)
+    double tileThreshold = normalQuantile(options.falseAlarmRate / 2 / (2 * result.tests));
+    double imageThreshold = normalQuantile(options.falseAlarmRate / 2 / (2 * 3));
+    auto zScore = [](double difference, double variance) {
+        // No noise at all: any difference is significant
+        if (variance <= 0) return std::abs(difference) > 1e-6 ? infinity : 0.0;
+        return difference / std::sqrt(variance);
+    };
+
+    zMap.assign(size_t(width) * height, 0.0f);
+    for (int c = 0; c < 3; c++) {
+        double imageDifference = 0, imageVariance = 0;
+        for (int ty = 0; ty < tilesY; ty++) {
+            for (int tx = 0; tx < tilesX; tx++) {
+                double difference = 0, variance = 0;
+                for (int y = ty * options.tileSize; y < std::min(height, (ty + 1) * options.tileSize); y++) {
+                    for (int x = tx * options.tileSize; x < std::min(width, (tx + 1) * options.tileSize); x++) {
+                        size_t i = (size_t(y) * width + x) * 3 + c;
+                        double d = test.mean.rgb[i] - reference.mean.rgb[i];
+                        double v = test.variance.rgb[i] + reference.variance.rgb[i];
+                        difference += d;
+                        variance += v;
+                        zMap[i / 3] += zScore(d, v) / 3;
+                    }
+                }
+                double z = std::abs(zScore(difference, variance));
+                result.maxTileZ = std::max(result.maxTileZ, z);
+                if (z > tileThreshold) result.significantTiles++;
+                imageDifference += difference;
+                imageVariance += variance;
+            }
+        }
+        double z = std::abs(zScore(imageDifference, imageVariance));
+        result.imageZ = std::max(result.imageZ, z);
+        if (z > imageThreshold) result.imageSignificant = true;
+    }
+    return result;
+}
+
+// Writes the per-pixel z-scores as an image: red where the test is brighter than
+// the reference, blue where it's darker, saturating at 4 standard errors
+void writeZMap(const std::string& filePath, int width, int height, const std::vector<float>& zMap) {
+    std::vector<uint8_t> rgb(zMap.size() * 3, 0);
+    for (size_t i = 0; i < zMap.size(); i++) {
+        uint8_t value = uint8_t(255 * std::min(1.0f, std::abs(zMap[i]) / 4));
+        rgb[i * 3 + (zMap[i] > 0 ? 0 : 2)] = value;
+    }
+    imageFiles::writePng(filePath, width, height, rgb.data());
+}
+
+Options parseOptions(int argc, char** argv) {
+    Options options;
+    for (int i = 1; i < argc; i++) {
+        std::string option = argv[i];
+        if (option == "--update") {
+            options.update = true;
+            continue;
+        }
+        if (i + 1 >= argc) fatalError("Error: missing value for option " + option);
+        std::string value = argv[++i];
+        if (option == "--references") options.references = value;
+        else if (option == "--seed") options.seed = std::stoul(value);
+        else if (option == "--threads") options.threads = std::max(1, std::stoi(value));
+        else if (option == "--width") options.imageWidth = std::stoi(value);
+        else if (option == "--spp") options.samplesPerPixel = std::stoi(value);
+        else if (option == "--renders") options.renders = std::max(2, std::stoi(value));
+        else if (option == "--alpha") options.falseAlarmRate = std::stod(value);
+        else if (option == "--tile") options.tileSize = std::max(1, std::stoi(value));
+        else fatalError("Error: unknown option " + option);
+    }
+    return options;
+}
+
+int main(int argc, char** argv) {
+    Options options = parseOptions(argc, argv);
+    std::cout << (options.update ? "Rendering validation references: " : "Validation: ")
+              << options.imageWidth << " pixels wide, " << options.renders << " renders of "
+              << options.samplesPerPixel << " samples per pixel, seed " << options.seed << "\n\n";
+    if (!options.update) {
+        std::cout << std::left << std::setw(20) << "scene" << std::right << std::setw(10) << "seconds"
+                  << std::setw(11) << "RMSE" << std::setw(11) << "relMSE" << std::setw(9) << "FLIP"
+                  << std::setw(9) << "max z" << std::setw(9) << "image z" << std::setw(16) << "tiles flagged"
+                  << "\n";
+    }
+
+    int failures = 0;
+    for (const ValidationScene& scene : validationScenes()) {
+        auto start = std::chrono::steady_clock::now();
+        if (options.update) {
+            // Seeds that the validation runs don't use, so that both estimates are independent
+            Estimate reference = renderScene(scene, options, options.seed + 1000000);
+            writeReference(options, scene.name, reference);
+            std::cout << "  " << std::left << std::setw(20) << scene.name << std::right << " written to "
+                      << referencePath(options, scene.name, "{mean,variance}") << "\n";
+            continue;
+        }
+        Estimate reference;
+        // A missing or mismatched reference is a setup error, not a difference
+        if (!readReference(options, scene.name, reference)) {
+            fatalError("Error: no reference for " + scene.name + " in " + options.references
+                       + " (written by make validate-reference)");
+        }
+        Estimate test = renderScene(scene, options, options.seed);
+        double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        if (reference.mean.width != test.mean.width || reference.mean.height != test.mean.height) {
+            fatalError("Error: the reference for " + scene.name + " was made at a different resolution");
+        }
+
+        std::vector<float> zMap;
+        Significance significance = testDifferences(test, reference, options, zMap);
+        writeZMap(std::string(OUTPUT_DIR) + "/validate_" + scene.name + "_z.png", test.mean.width,
+                  test.mean.height, zMap);
+        bool failed = significance.significantTiles > 0 || significance.imageSignificant;
+        failures += failed ? 1 : 0;
+        std::cout << std::left << std::setw(20) << scene.name << std::right << std::fixed
+                  << std::setprecision(1) << std::setw(10) << seconds
+                  << std::scientific << std::setprecision(2)
+                  << std::setw(11) << metrics::rmse(test.mean, reference.mean)
+                  << std::setw(11) << metrics::relMse(test.mean, reference.mean)
+                  << std::fixed << std::setprecision(4) << std::setw(9) << metrics::flip(test.mean, reference.mean)
+                  << std::setprecision(2) << std::setw(9) << significance.maxTileZ
+                  << std::setw(9) << significance.imageZ
+                  << std::setw(8) << significance.significantTiles << "/" << std::left << std::setw(7)
+                  << significance.tests << std::right << (failed ? "FAILED" : "ok") << "\n";
+    }
+    if (!options.update) {
+        std::cout << "\n" << failures << " scene(s) differ significantly from their reference"
+                  << " (z-scores maps in " << OUTPUT_DIR << "/validate_*_z.png)\n";
+    }
+    return failures > 0 ? 1 : 0;
+}
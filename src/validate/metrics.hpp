@@ -0,0 +1,157 @@
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <vector>
+
+// Image comparison metrics, on linear RGB images of the same size (3 floats per
+// pixel, row by row)
+namespace metrics {
+    struct Image {
+        int width = 0;
+        int height = 0;
+        std::vector<float> rgb;
+
+        float at(int x, int y, int c) const {
+            x = std::clamp(x, 0, width - 1);
+            y = std::clamp(y, 0, height - 1);
+            return rgb[(size_t(y) * width + x) * 3 + c];
+        }
+    };
+
+    // Root mean squared error
+    inline double rmse(const Image& test, const Image& reference) {
+        double sum = 0;
+        for (size_t i = 0; i < test.rgb.size(); i++) {
+            double d = test.rgb[i] - reference.rgb[i];
+            sum += d * d;
+        }
+        return std::sqrt(sum / test.rgb.size());
+    }
+
+    // Relative mean squared error: squared errors relative to the squared reference
+    // value (plus a small constant, so that dark pixels don't dominate)
+    inline double relMse(const Image& test, const Image& reference) {
+        double sum = 0;
+        for (size_t i = 0; i < test.rgb.size(); i++) {
+            double d = test.rgb[i] - reference.rgb[i];
+            sum += d * d / (double(reference.rgb[i]) * reference.rgb[i] + 0.01);
+        }
+        return sum / test.rgb.size();
+    }
+
+    namespace details {
+        struct Lab {
+            float l, a, b;
+        };
+
+        inline float labF(float t) {
+            return t > 0.008856f ? std::cbrt(t) : 7.787f * t + 16.0f / 116.0f;
+        }
+
+        // Linear RGB to CIE L*a*b* (D65 white)
+        inline Lab toLab(float r, float g, float b) {
+            float x = (0.4124f * r + 0.3576f * g + 0.1805f * b) / 0.9505f;
+            float y = 0.2126f * r + 0.7152f * g + 0.0722f * b;
+            float z = (0.0193f * r + 0.1192f * g + 0.9505f * b) / 1.0890f;
+            float fx = labF(x), fy = labF(y), fz = labF(z);
+            return {116 * fy - 16, 500 * (fx - fy), 200 * (fy - fz)};
+        }
+
+        // HyAB colour distance: lightness difference plus chromatic distance
+        inline float hyab(const Lab& p, const Lab& q) {
+            return std::abs(p.l - q.l) + std::hypot(p.a - q.a, p.b - q.b);
+        }
+
+        // Gaussian blur of one channel of `image` (separable, standard deviation in pixels)
+        inline std::vector<float> blur(const Image& image, int c, float sigma) {
+            int radius = int(std::ceil(3 * sigma));
+            std::vector<float> weights(2 * radius + 1);
+            float total = 0;
+            for (int k = -radius; k <= radius; k++) {
+                weights[k + radius] = std::exp(-0.5f * k * k / (sigma * sigma));
+                total += weights[k + radius];
+            }
+            for (float& w : weights) w /= total;
+            std::vector<float> rows(size_t(image.width) * image.height);
+            for (int y = 0; y < image.height; y++) {
+                for (int x = 0; x < image.width; x++) {
+                    float sum = 0;
+                    for (int k = -radius; k <= radius; k++) sum += weights[k + radius] * image.at(x + k, y, c);
+                    rows[size_t(y) * image.width + x] = sum;
+                }
+            }
+            std::vector<float> result(rows.size());
+            for (int y = 0; y < image.height; y++) {
+                for (int x = 0; x < image.width; x++) {
+                    float sum = 0;
+                    for (int k = -radius; k <= radius; k++) {
+                        int yk = std::clamp(y + k, 0, image.height - 1);
+                        sum += weights[k + radius] * rows[size_t(yk) * image.width + x];
+                    }
+                    result[size_t(y) * image.width + x] = sum;
+                }
+            }
+            return result;
+        }
+
+        // Gradient magnitude of the (blurred) lightness, normalized to [0,1]
+        inline std::vector<float> edges(const std::vector<Lab>& lab, int width, int height) {
+            auto l = [&](int x, int y) {
+                x = std::clamp(x, 0, width - 1);
+                y = std::clamp(y, 0, height - 1);
+                return lab[size_t(y) * width + x].l / 100.0f;
+            };
+            std::vector<float> result(lab.size());
+            for (int y = 0; y < height; y++) {
+                for (int x = 0; x < width; x++) {
+                    // Sobel operator
+                    float gx = (l(x + 1, y - 1) + 2 * l(x + 1, y) + l(x + 1, y + 1))
+                             - (l(x - 1, y - 1) + 2 * l(x - 1, y) + l(x - 1, y + 1));
+                    float gy = (l(x - 1, y + 1) + 2 * l(x, y + 1) + l(x + 1, y + 1))
+                             - (l(x - 1, y - 1) + 2 * l(x, y - 1) + l(x + 1, y - 1));
+                    result[size_t(y) * width + x] = std::min(1.0f, std::hypot(gx, gy) / 4);
+                }
+            }
+            return result;
+        }
+
+        inline std::vector<Lab> filteredLab(const Image& image) {
+            // Standard deviations of the eye's spatial filter, in pixels, for an
+            // image seen at about 60 pixels per degree: chromatic detail is
+            // resolved less finely than achromatic detail
+            const float sigmas[3] = {0.7f, 0.9f, 1.2f};
+            std::vector<float> channels[3];
+            for (int c = 0; c < 3; c++) channels[c] = blur(image, c, sigmas[c]);
+            std::vector<Lab> lab(channels[0].size());
+            for (size_t i = 0; i < lab.size(); i++) {
+                lab[i] = toLab(std::clamp(channels[0][i], 0.0f, 1.0f), std::clamp(channels[1][i], 0.0f, 1.0f),
+                               std::clamp(channels[2][i], 0.0f, 1.0f));
+            }
+            return lab;
+        }
+    }
+
+    // Perceptual error in [0,1], modelled on NVIDIA's FLIP: colour differences
+    // between the spatially filtered images (HyAB distance in L*a*b*, relative to
+    // the largest one between primaries), amplified where edges differ. Returns
+    // the mean over pixels; per-pixel errors go in `errorMap` if it isn't null.
+    inline double flip(const Image& test, const Image& reference, std::vector<float>* errorMap = nullptr) {
+        using namespace details;
+        std::vector<Lab> labTest = filteredLab(test);
+        std::vector<Lab> labReference = filteredLab(reference);
+        std::vector<float> edgesTest = edges(labTest, test.width, test.height);
+        std::vector<float> edgesReference = edges(labReference, test.width, test.height);
+        const float maxDistance = hyab(toLab(0, 1, 0), toLab(0, 0, 1));
+        double sum = 0;
+        if (errorMap) errorMap->resize(labTest.size());
+        for (size_t i = 0; i < labTest.size(); i++) {
+            float colourError = std::pow(std::min(1.0f, hyab(labTest[i], labReference[i]) / maxDistance), 0.7f);
+            float featureDifference = std::abs(edgesTest[i] - edgesReference[i]);
+            float error = colourError > 0 ? std::pow(colourError, 1 - featureDifference) : 0.0f;
+            if (errorMap) (*errorMap)[i] = error;
+            sum += error;
+        }
+        return sum / labTest.size();
+    }
+}